@@ -2,17 +2,46 @@
 #include "endpoint.hpp"
 #include "signal_manager.hpp"
 
+#include <unistd.h>
+
 /* Constructs the main application object */
 Application::Application(ApplicationConfig &config)
-    : _config(config), _dispatcher(128), _clients(NULL), _cleanupClients(NULL), _wasConfigured(false)
+    : _config(config), _dispatcher(128, config.edgeTriggered, config.eventBackend), _fileCache(_timers, config.fileCacheSize, config.fileCacheValidity), _responseCache(_fileCache, config.responseCacheSize), _gzipCache(config.gzipCacheSize), _clients(NULL), _cleanupClients(NULL), _wasConfigured(false)
 {
     // Check if the configuration is valid
     if (config.servers.size() == 0)
         throw std::runtime_error("Configuration has no servers");
+
+#ifdef __42_LIKES_WASTING_CPU_CYCLES__
+    // Compression on the fly needs zlib, which this build isn't linked with
+    for (size_t server = 0; server < config.servers.size(); server++)
+    {
+        const std::vector<LocalRouteConfig> &routes = config.servers[server].localRoutes;
+        for (size_t route = 0; route < routes.size(); route++)
+        {
+            if (routes[route].compression.enabled)
+                throw std::runtime_error("gzip compression is not supported in this build");
+
+            // Readiness is filtered per sink here, but a script fed a streamed body needs the
+            // readiness of its input and output pipes apart
+            if (routes[route].streamCgiBody)
+                throw std::runtime_error("Streamed CGI bodies are not supported in this build");
+
+            // FastCGI connections are multiplexed by their own records rather than per sink
+            if (!routes[route].fastCgiTypes.empty())
+                throw std::runtime_error("FastCGI is not supported in this build");
+        }
+    }
+
+    // A spilled CGI output is sent with `sendfile()`
+    if (config.cgiOutputBufferSize > 0)
+        throw std::runtime_error("Spilling CGI outputs is not supported in this build");
+#endif // __42_LIKES_WASTING_CPU_CYCLES__
 }
 
-/* Sets up the server according to the constructor-supplied configuration */
-void Application::configure()
+/* Sets up the server according to the constructor-supplied configuration; adopts the
+   given listeners that are shared with other processes instead of binding new ones */
+void Application::configure(const ListenerMap *sharedListeners)
 {
     std::map<uint64_t, ServerConfig *> bindings;
 
@@ -23,13 +52,38 @@ void Application::configure()
     for (size_t index = 0; index < _config.servers.size(); index++)
     {
         ServerConfig &serverConfig = _config.servers[index];
-        uint64_t hostAndPort = static_cast<uint64_t>(serverConfig.host) | (static_cast<uint64_t>(serverConfig.port) << 32);
+        uint64_t hostAndPort = serverConfig.getBindingKey();
 
         const std::map<uint64_t, ServerConfig *>::iterator result = bindings.find(hostAndPort);
         if (result == bindings.end())
         {
-            // The server hasn't been bound yet, so bind it and insert the binding into the map
-            HttpServer *server = new HttpServer(*this, serverConfig);
+            // The server hasn't been bound yet, so bind it (or adopt the shared listener) and
+            // insert the binding into the map
+            uint32_t eventMask = EPOLLIN;
+            int fileno;
+            if (sharedListeners != NULL)
+            {
+                ListenerMap::const_iterator listener = sharedListeners->find(hostAndPort);
+                if (listener == sharedListeners->end())
+                    throw std::logic_error("Missing shared listener for server");
+                fileno = listener->second;
+
+                // Only wake up one of the processes sharing the listener per connection
+                eventMask |= EPOLLEXCLUSIVE;
+            }
+            else
+                fileno = HttpServer::bindListener(serverConfig, _config.workerCount > 1);
+
+            HttpServer *server;
+            try
+            {
+                server = new HttpServer(*this, serverConfig, fileno);
+            }
+            catch (...)
+            {
+                close(fileno);
+                throw;
+            }
             try
             {
                 _servers.push_back(server);
@@ -37,8 +91,9 @@ void Application::configure()
             catch (...)
             {
                 delete server;
+                throw;
             }
-            _dispatcher.subscribe(server->getFileno(), EPOLLIN, server);
+            _dispatcher.subscribeListener(server->getFileno(), eventMask, server);
         }
         else
         {
@@ -49,6 +104,10 @@ void Application::configure()
         bindings[hostAndPort] = &serverConfig;
     }
 
+    // Wait for changes of the files whose responses are cached
+    if (_responseCache.getFileno() >= 0)
+        _dispatcher.subscribe(_responseCache.getFileno(), EPOLLIN, &_responseCache);
+
     _wasConfigured = true;
 }
 
@@ -69,6 +128,11 @@ Application::~Application()
     // Destroy servers
     for (size_t index = 0; index < _servers.size(); index++)
         delete _servers[index];
+
+    // Destroy the FastCGI connections, which the clients' requests were withdrawn from
+    std::map<std::string, FastCgiPool *>::iterator pool = _fastCgiPools.begin();
+    for (; pool != _fastCgiPools.end(); pool++)
+        delete pool->second;
 }
 
 /* Enters the application's main loop until an exit condition occurs */
@@ -79,27 +143,16 @@ void Application::mainLoop()
 
     HttpClient *headClient, *nextClient;
     while (!SignalManager::shouldQuit())
-    { 
-        // Wait up to 5 seconds to dispatch any event(s)
-        _dispatcher.dispatch(5000);
-
-        // Destroy any process with a timeout
-        headClient = _clients;
-        while (headClient != NULL)
-        {
-            // Destroy the process if it is timeout
-            if (headClient->_process != NULL)
-            {
-                if (headClient->_process->getTimeout().isExpired())
-                    headClient->_process->handleTimeout();
-            }
+    {
+        // Wait for events until the next timeout may expire
+        _dispatcher.waitForEvents(_timers.getWaitTime(APPLICATION_MAX_WAIT_MS));
 
-            // Destroy the client if it is timeout
-            if (headClient->_timeout.isExpired())
-                headClient->markForCleanup();
+        // Query the time once so that all timeouts started by the events share it
+        _timers.updateTime();
+        _dispatcher.dispatchEvents();
 
-            headClient = headClient->_next;
-        }
+        // Notify the clients and processes whose timeouts have expired
+        _timers.expire();
 
         // Remove all clients that were marked for cleanup
         headClient = _cleanupClients;
@@ -157,30 +210,84 @@ void Application::removeClient(HttpClient *client)
     delete client;
 }
 
-/* Starts CGI processes for the given client */
-void Application::startCgiProcess(HttpClient *client, const HttpRequest &request, const RoutingInfo &routingInfo)
+/* Starts CGI processes for the given client, which read the body from `spool` if given or
+   are fed the body while it arrives if `streamsBody` is set */
+void Application::startCgiProcess(HttpClient *client, const HttpRequest &request, const RoutingInfo &routingInfo,
+    const BodySpool *spool, bool streamsBody)
 {
     // Create a CGI process
-    CgiProcess *process = new CgiProcess(client, request, routingInfo);
+    CgiProcess *process = new CgiProcess(client, request, routingInfo, spool, streamsBody);
 
-    // Subscribe the process to the dispatcher
+    // Subscribe the process to the dispatcher, a spooled body is already the process' input;
+    // a streamed body is written as it arrives while the output is read from the start
     try
     {
-        _dispatcher.subscribe(process->getProcess().getInputFileno(), EPOLLOUT | EPOLLHUP, process);
-        process->_subscribeFlags |= SUBSCRIBE_FLAG_INPUT;
+        if (streamsBody)
+        {
+            _dispatcher.subscribe(process->getProcess().getInputFileno(), EPOLLHUP, process);
+            process->_subscribeFlags |= SUBSCRIBE_FLAG_INPUT;
+            _dispatcher.subscribe(process->getProcess().getOutputFileno(), EPOLLIN | EPOLLHUP, process);
+            process->_subscribeFlags |= SUBSCRIBE_FLAG_OUTPUT;
+        }
+        else if (process->getProcess().getInputFileno() >= 0)
+        {
+            _dispatcher.subscribe(process->getProcess().getInputFileno(), EPOLLOUT | EPOLLHUP, process);
+            process->_subscribeFlags |= SUBSCRIBE_FLAG_INPUT;
+        }
+        else
+        {
+            _dispatcher.subscribe(process->getProcess().getOutputFileno(), EPOLLIN | EPOLLHUP, process);
+            process->_subscribeFlags |= SUBSCRIBE_FLAG_OUTPUT;
+        }
     }
     catch (...)
     {
         delete process;
         throw;
     }
-    client->_process = process;
+    client->_cgi = process;
+}
+
+/* Passes the script of the given client to its FastCGI application, which reads the body
+   from `spool` if given */
+void Application::startFastCgiRequest(HttpClient *client, const HttpRequest &request, const RoutingInfo &routingInfo,
+    const BodySpool *spool)
+{
+    // Each application gets its pool of connections once the first of its scripts runs
+    const FastCgiAddress &address = *routingInfo.fastCgiAddress;
+    std::map<std::string, FastCgiPool *>::iterator pool = _fastCgiPools.find(address.name);
+    if (pool == _fastCgiPools.end())
+    {
+        FastCgiPool *newPool = new FastCgiPool(*this, address);
+        try
+        {
+            pool = _fastCgiPools.insert(std::make_pair(address.name, newPool)).first;
+        }
+        catch (...)
+        {
+            delete newPool;
+            throw;
+        }
+    }
+
+    // The request waits in the pool if all of its connections are busy
+    FastCgiRequest *fastCgiRequest = new FastCgiRequest(client, request, routingInfo, spool, *pool->second);
+    try
+    {
+        pool->second->submit(fastCgiRequest);
+    }
+    catch (...)
+    {
+        delete fastCgiRequest;
+        throw;
+    }
+    client->_cgi = fastCgiRequest;
 }
 
-/*Close CGI processes for the given client */
+/* Closes the CGI process or FastCGI request of the given client */
 void Application::closeCgiProcess(HttpClient *client)
 {
-    // Destroy the process
-    delete client->_process;
-    client->_process = NULL;
+    // Destroy the process or request
+    delete client->_cgi;
+    client->_cgi = NULL;
 }
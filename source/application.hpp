@@ -3,19 +3,31 @@
 
 #include "config.hpp"
 #include "dispatcher.hpp"
+#include "timer_wheel.hpp"
+#include "file_cache.hpp"
+#include "response_cache.hpp"
+#include "gzip_cache.hpp"
 #include "http_server.hpp"
 #include "http_client.hpp"
+#include "fastcgi.hpp"
 #include "utility.hpp"
 
+#include <map>
 #include <vector>
 
+/* The maximum time in milliseconds to wait for events when no timeout is pending */
+#define APPLICATION_MAX_WAIT_MS 5000
 
 class Application
 {
 public:
     friend class HttpServer;
     friend class HttpClient;
+    friend class CgiBackend;
     friend class CgiProcess;
+    friend class FastCgiRequest;
+    friend class FastCgiConnection;
+    friend class FastCgiPool;
 
     /* Constructs the main application object */
     Application(ApplicationConfig &config);
@@ -23,29 +35,44 @@ public:
     /* Releases all application resources */
     ~Application();
 
-    /* Sets up the server according to the constructor-supplied configuration */
-    void configure();
+    /* Sets up the server according to the constructor-supplied configuration; adopts the
+       given listeners that are shared with other processes instead of binding new ones */
+    void configure(const ListenerMap *sharedListeners = NULL);
 
     /* Enters the application's main loop until an exit condition occurs */
     void mainLoop();
 private:
     ApplicationConfig         &_config;
     Dispatcher                 _dispatcher;
+    TimerWheel                 _timers;
+    FileCache                  _fileCache;
+    ResponseCache              _responseCache;
+    GzipCache                  _gzipCache;
     std::vector<HttpServer *>  _servers;
     HttpClient                *_clients;
     HttpClient                *_cleanupClients;
     bool                       _wasConfigured;
 
+    // Connections to the FastCGI applications by their configured address
+    std::map<std::string, FastCgiPool *> _fastCgiPools;
+
     /* Starts to manage the given client file descriptor according to its server's config */
     void takeClient(int fileno, const ServerConfig &config, uint32_t host, uint16_t port);
 
     /* Immediately releases and destroys the given client; DO NOT use from outside of this class */
     void removeClient(HttpClient *client);
 
-    /* Starts CGI processes for the given client */
-    void startCgiProcess(HttpClient *client, const HttpRequest &request, const RoutingInfo &routingInfo);
+    /* Starts CGI processes for the given client, which read the body from `spool` if given or
+       are fed the body while it arrives if `streamsBody` is set */
+    void startCgiProcess(HttpClient *client, const HttpRequest &request, const RoutingInfo &routingInfo,
+        const BodySpool *spool, bool streamsBody = false);
+
+    /* Passes the script of the given client to its FastCGI application, which reads the body
+       from `spool` if given */
+    void startFastCgiRequest(HttpClient *client, const HttpRequest &request, const RoutingInfo &routingInfo,
+        const BodySpool *spool);
 
-    /*Close CGI processes for the given client */
+    /* Closes the CGI process or FastCGI request of the given client */
     void closeCgiProcess(HttpClient *client);
 };
 
@@ -0,0 +1,163 @@
+#include "cgi_backend.hpp"
+#include "http_client.hpp"
+#include "application.hpp"
+#include "http_exception.hpp"
+
+#include <cstring>
+#include <algorithm>
+#include <fcntl.h>
+#include <stdint.h>
+
+/* Constructs a running script for the given client */
+CgiBackend::CgiBackend(HttpClient *client)
+    : _state(CGI_PROCESS_RUNNING)
+    , _client(client)
+    , _outputMode(CGI_OUTPUT_HEADER)
+    , _outputBodyOffset(0)
+    , _outputSpool(NULL)
+{
+}
+
+/* Removes the spilled body, if any */
+CgiBackend::~CgiBackend()
+{
+    delete _outputSpool;
+}
+
+/* Hands the file holding a spilled body over to the caller, which must release it;
+   returns NULL if the whole output is buffered in memory */
+CachedFile *CgiBackend::takeSpilledBody()
+{
+    if (_outputSpool == NULL)
+        return NULL;
+
+    // The response sends from its own descriptor, the spool closes the original one
+    CachedFile *file = CachedFile::adopt(fcntl(_outputSpool->getFileno(), F_DUPFD_CLOEXEC, 0));
+    if (file == NULL)
+        throw std::runtime_error("Unable to open spilled CGI output");
+    return file;
+}
+
+/* Handles the next bytes of the script's output, returns whether reading should continue */
+bool CgiBackend::handleOutput(Slice data)
+{
+    // Output past the header of a piped body goes to the client right away
+    if (_outputMode == CGI_OUTPUT_PIPED)
+    {
+        _client->forwardCgiOutput(data);
+        return true;
+    }
+
+    // A spilled body goes on in its file
+    if (_outputSpool != NULL)
+        return spillOutput(data);
+
+    // Push the data into the response buffer
+    size_t oldLength = _buffer.size();
+    size_t length = data.getLength();
+    if (SIZE_MAX - oldLength < length || oldLength + length > _client->_application._config.cgiOutputMaxSize)
+    {
+        _state = CGI_PROCESS_FAILURE;
+        return false;
+    }
+    _buffer.resize(oldLength + length);
+    std::memcpy(&_buffer[oldLength], &data[0], length);
+    if (_outputMode == CGI_OUTPUT_HEADER)
+        return scanHeader(oldLength);
+
+    // Keep memory bounded for big outputs the client needs as a whole
+    size_t threshold = _client->_application._config.cgiOutputBufferSize;
+    if (threshold > 0 && _buffer.size() - _outputBodyOffset > threshold)
+        return spillBuffer();
+    return true;
+}
+
+/* Gets whether the client is too far behind on the piped body for more output to be read */
+bool CgiBackend::isOutputCongested() const
+{
+    return _outputMode == CGI_OUTPUT_PIPED && _state == CGI_PROCESS_RUNNING && _client->isCgiOutputCongested();
+}
+
+/* Looks for the end of the output's header in the bytes buffered since `offset`, once found
+   the client decides whether the body is piped; returns whether reading should continue */
+bool CgiBackend::scanHeader(size_t offset)
+{
+    // The delimiter may have started in the previously buffered bytes
+    Slice delimiter = C_SLICE("\r\n\r\n");
+    offset = offset < delimiter.getLength() ? 0 : offset - (delimiter.getLength() - 1);
+    std::vector<uint8_t>::iterator end = std::search(_buffer.begin() + offset, _buffer.end(),
+        &delimiter[0], &delimiter[0] + delimiter.getLength());
+    if (end == _buffer.end())
+    {
+        if (_buffer.size() <= CGI_BACKEND_MAX_HEADER_LENGTH)
+            return true;
+        _state = CGI_PROCESS_FAILURE;
+        return false;
+    }
+
+    // A header the client can't make sense of fails the process
+    size_t headerLength = static_cast<size_t>(end - _buffer.begin());
+    _outputBodyOffset = headerLength + delimiter.getLength();
+    bool isPiped;
+    try
+    {
+        isPiped = _client->startCgiResponse(Slice(reinterpret_cast<const char *>(&_buffer[0]), headerLength));
+    }
+    catch (const std::runtime_error &)
+    {
+        _state = CGI_PROCESS_FAILURE;
+        return false;
+    }
+    if (!isPiped)
+    {
+        _outputMode = CGI_OUTPUT_BUFFERED;
+        return true;
+    }
+
+    // Pass on the start of the body that came along with the header
+    _outputMode = CGI_OUTPUT_PIPED;
+    if (_outputBodyOffset < _buffer.size())
+        _client->forwardCgiOutput(Slice(reinterpret_cast<const char *>(&_buffer[_outputBodyOffset]),
+            _buffer.size() - _outputBodyOffset));
+    std::vector<uint8_t>().swap(_buffer);
+    return true;
+}
+
+/* Moves the buffered body into an unnamed temporary file once it outgrew the memory
+   threshold, only the header stays in memory; returns whether reading should continue */
+bool CgiBackend::spillBuffer()
+{
+    try
+    {
+        _outputSpool = new BodySpool(false);
+    }
+    catch (const HttpException &)
+    {
+        _state = CGI_PROCESS_FAILURE;
+        return false;
+    }
+    if (!spillOutput(Slice(reinterpret_cast<const char *>(&_buffer[_outputBodyOffset]), _buffer.size() - _outputBodyOffset)))
+        return false;
+
+    // Give the memory of the body back
+    std::vector<uint8_t>(_buffer.begin(), _buffer.begin() + _outputBodyOffset).swap(_buffer);
+    return true;
+}
+
+/* Appends output to the spilled body, returns whether reading should continue */
+bool CgiBackend::spillOutput(Slice data)
+{
+    // The spilled body is bounded like one kept in memory, including the buffered header
+    size_t length = _outputBodyOffset + _outputSpool->getLength();
+    if (SIZE_MAX - length < data.getLength()
+     || length + data.getLength() > _client->_application._config.cgiOutputMaxSize)
+    {
+        _state = CGI_PROCESS_FAILURE;
+        return false;
+    }
+    _outputSpool->writeBody(data);
+    if (!_outputSpool->hasFailed())
+        return true;
+    _state = CGI_PROCESS_FAILURE;
+    return false;
+}
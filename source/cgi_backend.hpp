@@ -0,0 +1,96 @@
+#ifndef CGI_BACKEND_hpp
+#define CGI_BACKEND_hpp
+
+#include "slice.hpp"
+#include "file_cache.hpp"
+#include "upload_handler.hpp"
+
+#include <vector>
+#include <stdint.h>
+#include <stddef.h>
+
+/* The longest header a script may write before its body */
+#define CGI_BACKEND_MAX_HEADER_LENGTH 65536
+
+class HttpClient;
+
+enum CgiProcessState
+{
+    CGI_PROCESS_RUNNING,
+    CGI_PROCESS_FAILURE,
+    CGI_PROCESS_TIMEOUT,
+    CGI_PROCESS_SUCCESS,
+};
+
+enum CgiOutputMode
+{
+    CGI_OUTPUT_HEADER,   // The header is still being received
+    CGI_OUTPUT_PIPED,    // The body is passed on to the client as it's produced
+    CGI_OUTPUT_BUFFERED, // The body is buffered until the script ends
+};
+
+/* A script answering the request of a client, run either as a CGI process or by a FastCGI
+   application; its output is turned into the client's response as it arrives */
+class CgiBackend
+{
+public:
+    friend class HttpClient;
+
+    /* Constructs a running script for the given client */
+    CgiBackend(HttpClient *client);
+
+    /* Removes the spilled body, if any */
+    virtual ~CgiBackend();
+
+    /* Gets the script state */
+    inline CgiProcessState getState()
+    {
+        return _state;
+    }
+
+    /* Sets the script state */
+    inline void setState(CgiProcessState state)
+    {
+        _state = state;
+    }
+
+    /* Reads the output of a script that was paused for the client again */
+    virtual void resumeOutput() = 0;
+
+    /* Stops receiving events for the script */
+    virtual void unsubscribe() = 0;
+
+    /* Hands the file holding a spilled body over to the caller, which must release it;
+       returns NULL if the whole output is buffered in memory */
+    CachedFile *takeSpilledBody();
+protected:
+    CgiProcessState      _state;
+    HttpClient          *_client;
+    std::vector<uint8_t> _buffer;
+    CgiOutputMode        _outputMode;
+    size_t               _outputBodyOffset;
+    BodySpool           *_outputSpool;
+
+    /* Handles the next bytes of the script's output, returns whether reading should continue */
+    bool handleOutput(Slice data);
+
+    /* Gets whether the client is too far behind on the piped body for more output to be read */
+    bool isOutputCongested() const;
+private:
+    /* Looks for the end of the output's header in the bytes buffered since `offset`, once found
+       the client decides whether the body is piped; returns whether reading should continue */
+    bool scanHeader(size_t offset);
+
+    /* Moves the buffered body into an unnamed temporary file once it outgrew the memory
+       threshold, only the header stays in memory; returns whether reading should continue */
+    bool spillBuffer();
+
+    /* Appends output to the spilled body, returns whether reading should continue */
+    bool spillOutput(Slice data);
+
+    /* Disable copy-construction and copy-assignment */
+    CgiBackend(const CgiBackend &other);
+    CgiBackend &operator=(const CgiBackend &other);
+};
+
+#endif // CGI_BACKEND_hpp
@@ -4,7 +4,7 @@
 #include "application.hpp"
 #include "signal_manager.hpp"
 
-#include <cstring>
+#include <errno.h>
 #include <stdlib.h>
 #include <limits.h>
 #include <unistd.h>
@@ -22,28 +22,33 @@ CgiPathInfo::CgiPathInfo(const std::string &nodePath)
     workingDirectory = scriptDirectorySlice.toString();
 }
 
-/* Constructs a CGI process from the given client, request and route result */
-CgiProcess::CgiProcess(HttpClient *client, const HttpRequest &request, const RoutingInfo &routingInfo)
-    : _state(CGI_PROCESS_RUNNING)
+/* Constructs a CGI process from the given client, request and route result; the process
+   reads the body from `spool` if given, otherwise it's written from the request unless
+   `streamsBody` is set, in which case it's fed to the process while it arrives */
+CgiProcess::CgiProcess(HttpClient *client, const HttpRequest &request, const RoutingInfo &routingInfo,
+    const BodySpool *spool, bool streamsBody)
+    : CgiBackend(client)
     , _pathInfo(routingInfo.nodePath)
-    , _client(client)
     , _request(request)
     , _process(setupArguments(request, routingInfo, _pathInfo.fileName),
-               setupEnvironment(request, routingInfo),
-               _pathInfo.workingDirectory)
-    , _timeout(TIMEOUT_CGI_MS)
+               setupEnvironment(request, routingInfo, getContentLength(request, spool, streamsBody)),
+               _pathInfo.workingDirectory,
+               spool != NULL ? spool->getFileno() : -1)
+    , _timeout(client->_application._timers, this)
     , _bodyOffset(0)
     , _subscribeFlags(0)
+    , _streamsBody(streamsBody)
+    , _isBodyComplete(false)
+    , _isInputArmed(false)
+    , _isOutputPaused(false)
 {
+    _timeout.start(TIMEOUT_CGI_MS);
 }
 
 /* Destroys the process */
 CgiProcess::~CgiProcess()
 {
-    if (_subscribeFlags & SUBSCRIBE_FLAG_INPUT && _process.getInputFileno() >= 0)
-        _client->_application._dispatcher.unsubscribe(_process.getInputFileno());
-    if (_subscribeFlags & SUBSCRIBE_FLAG_OUTPUT && _process.getOutputFileno() >= 0)
-        _client->_application._dispatcher.unsubscribe(_process.getOutputFileno());
+    unsubscribe();
 }
 
 /* Handles one or multiple events */
@@ -52,91 +57,297 @@ void CgiProcess::handleEvents(uint32_t eventMask)
     if (_state != CGI_PROCESS_RUNNING)
         return;
 
+#ifdef __42_LIKES_WASTING_CPU_CYCLES__
+    // A process may exit with output left in the pipe, so it's read before the status is checked;
+    // the pipe only reports input while it holds data
+    if (eventMask & EPOLLIN)
+    {
+        if (readOutput())
+            pauseCongestedOutput();
+        if (_state != CGI_PROCESS_RUNNING)
+            _client->handleCgiState();
+        return;
+    }
+#endif // __42_LIKES_WASTING_CPU_CYCLES__
+
+#ifndef __42_LIKES_WASTING_CPU_CYCLES__
+    Dispatcher &dispatcher = _client->_application._dispatcher;
+    size_t budget = dispatcher.getDrainBudget();
+#endif // __42_LIKES_WASTING_CPU_CYCLES__
+
     switch (_process.getStatus())
     {
         case PROCESS_RUNNING:
             if (eventMask & EPOLLOUT)
             {
-                if (_bodyOffset < _request.body.size())
-                {
-                    // Write the request body to the process' standard input pipe
-                    ssize_t result = write(_process.getInputFileno(), &_request.body[_bodyOffset], _request.body.size() - _bodyOffset);
-                    if (result < 0)
-                    {
-                        if (SignalManager::shouldQuit())
-                            return;
-                        throw std::runtime_error("Unable to write to CGI process");
-                    }
-                    if (result == 0)
-                        throw std::runtime_error("Unexpected end of stream");
-                    _bodyOffset += static_cast<size_t>(result);
-                }
-
-                // If the whole body was written, close the input pipe and switch into output phase
-                if (_bodyOffset >= _request.body.size())
-                {
-                    _client->_application._dispatcher.unsubscribe(_process.getInputFileno());
-                    _subscribeFlags &= ~SUBSCRIBE_FLAG_INPUT;
-                    _process.closeInput();
-
-                    _client->_application._dispatcher.subscribe(_process.getOutputFileno(), EPOLLIN | EPOLLHUP, this);
-                    _subscribeFlags |= SUBSCRIBE_FLAG_OUTPUT;
-                }
 #ifdef __42_LIKES_WASTING_CPU_CYCLES__
+                writeInput();
                 return;
+#else
+                // Write until the pipe would block since edge-triggered readiness is only reported
+                // once, but only up to the budget so that a fast script doesn't starve the clients
+                size_t count = 0;
+                while (count < budget && writeInput())
+                    count++;
+                if (count == budget && dispatcher.isEdgeTriggered() && (_subscribeFlags & SUBSCRIBE_FLAG_INPUT))
+                    dispatcher.rearm(_process.getInputFileno());
 #endif // __42_LIKES_WASTING_CPU_CYCLES__
             }
-            if (eventMask & EPOLLIN)
+#ifndef __42_LIKES_WASTING_CPU_CYCLES__
+            // A hang-up may be reported before the process can be reaped; reading up to the end of
+            // the output makes sure it is reported again
+            if (eventMask & (EPOLLIN | EPOLLHUP))
             {
-                char buffer[8192];
-
-                // Read up to 8KiB from the process' standard output pipe
-                ssize_t result = read(_process.getOutputFileno(), buffer, sizeof(buffer));
-                if (result < 0)
-                {
-                    if (SignalManager::shouldQuit())
-                        return;
-                    throw std::runtime_error("Unable to read from CGI process");
-                }
-                if (result == 0)
-                {
-                    // This can never happen, see the following example:
-                    // - Child process exits with status 0
-                    //   The pipes are closed as a side-effect
-                    // - Due to the pipes closing, an EPOLLIN or EPOLLOUT event is generated
-                    // - The event handler (this function) calls `_process.getStatus()`
-                    //   `Process` will call `waitpid()` which leads to `PROCESS_EXIT_SUCCESS`
-                    //   and thus, never to `PROCESS_RUNNING` again
-                    // - The zero-length read event is never processed and the process is marked
-                    //   for destruction, leading to its destructor being called after the event
-                    //   buffer is fully processed by `Dispatcher`
-                    throw std::runtime_error("Unexpected end of stream");
-                }
-                size_t length = static_cast<size_t>(result);
-
-                // Push the data into the response buffer
-                size_t oldLength = _buffer.size();
-                if (SIZE_MAX - oldLength < length)
-                    throw std::runtime_error("Response body too large");
-                size_t newLength = oldLength + length;
-                if (newLength > (2ull * 1024ull * 1024ull * 1024ull))
-                    throw std::runtime_error("Response body too large");
-                _buffer.resize(oldLength + length);
-                std::memcpy(&_buffer[oldLength], buffer, length);
-#ifdef __42_LIKES_WASTING_CPU_CYCLES__
-                return;
-#endif // __42_LIKES_WASTING_CPU_CYCLES__
+                // Read until the pipe would block since edge-triggered readiness is only reported
+                // once, until the client is too far behind on the piped body, or up to the budget
+                size_t count = 0;
+                while (count < budget && readOutput() && !pauseCongestedOutput())
+                    count++;
+                if (count == budget && dispatcher.isEdgeTriggered() && (_subscribeFlags & SUBSCRIBE_FLAG_OUTPUT))
+                    dispatcher.rearm(_process.getOutputFileno());
             }
+#endif // __42_LIKES_WASTING_CPU_CYCLES__
             break;
         case PROCESS_EXIT_SUCCESS:
-            _state = CGI_PROCESS_SUCCESS;
-            _client->handleCgiState();
+#ifndef __42_LIKES_WASTING_CPU_CYCLES__
+        {
+            // The process may have exited before the event for its last output was handled,
+            // which is still in the pipe; the exit is handled once it was read
+            size_t count = 0;
+            while (count < budget && readOutput())
+                count++;
+            if (count == budget)
+            {
+                // The output is only subscribed once the input of a streamed body was closed
+                if (dispatcher.isEdgeTriggered() && (_subscribeFlags & SUBSCRIBE_FLAG_OUTPUT))
+                    dispatcher.rearm(_process.getOutputFileno());
+                else if (dispatcher.isEdgeTriggered() && (_subscribeFlags & SUBSCRIBE_FLAG_INPUT))
+                    dispatcher.rearm(_process.getInputFileno());
+                return;
+            }
+        }
+#endif // __42_LIKES_WASTING_CPU_CYCLES__
+            if (_state == CGI_PROCESS_RUNNING)
+                _state = CGI_PROCESS_SUCCESS;
             break;
         case PROCESS_EXIT_FAILURE:
             _state = CGI_PROCESS_FAILURE;
-            _client->handleCgiState();
             break;
     }
+
+    // The client destroys the process once it handled a final state
+    if (_state != CGI_PROCESS_RUNNING)
+        _client->handleCgiState();
+}
+
+/* Reads the output of a process that was paused for the client again */
+void CgiProcess::resumeOutput()
+{
+    if (!_isOutputPaused)
+        return;
+    _client->_application._dispatcher.subscribe(_process.getOutputFileno(), EPOLLIN | EPOLLHUP, this);
+    _subscribeFlags |= SUBSCRIBE_FLAG_OUTPUT;
+    _isOutputPaused = false;
+    _timeout.start(TIMEOUT_CGI_MS);
+}
+
+/* Feeds the next bytes of a streamed body to the process, bytes that don't fit into the
+   pipe are kept until it is writable again */
+void CgiProcess::writeBody(Slice data)
+{
+    // The rest of the body is discarded once the process ended or stopped reading it
+    if (_state != CGI_PROCESS_RUNNING || _process.getInputFileno() < 0 || data.isEmpty())
+        return;
+    _timeout.start(TIMEOUT_CGI_MS);
+    _pendingInput.append(&data[0], data.getLength());
+    if (_isInputArmed)
+        return;
+
+#ifndef __42_LIKES_WASTING_CPU_CYCLES__
+    // Write right away while the pipe has room, which is the common case
+    while (writePendingInput())
+        ;
+#endif // __42_LIKES_WASTING_CPU_CYCLES__
+
+    // Wait for the pipe to become writable for the rest
+    if (!_pendingInput.empty() && _process.getInputFileno() >= 0)
+    {
+        _client->_application._dispatcher.modify(_process.getInputFileno(), EPOLLOUT | EPOLLHUP, this);
+        _isInputArmed = true;
+    }
+}
+
+/* Closes the process' input once the kept bytes of a streamed body were written */
+void CgiProcess::finishBody()
+{
+    _isBodyComplete = true;
+    if (_state == CGI_PROCESS_RUNNING && _pendingInput.empty() && _process.getInputFileno() >= 0)
+        closeInput();
+}
+
+/* Writes a chunk of the request body to the process, returns whether writing should continue */
+bool CgiProcess::writeInput()
+{
+    if (_streamsBody)
+        return writePendingInput();
+
+    if (_bodyOffset < _request.body.size())
+    {
+        // Write the request body to the process' standard input pipe
+        ssize_t result = write(_process.getInputFileno(), &_request.body[_bodyOffset], _request.body.size() - _bodyOffset);
+        if (result < 0)
+        {
+            if (SignalManager::shouldQuit())
+                return false;
+#ifndef __42_LIKES_WASTING_CPU_CYCLES__
+            if (errno == EAGAIN || errno == EWOULDBLOCK)
+                return false;
+#endif // __42_LIKES_WASTING_CPU_CYCLES__
+            throw std::runtime_error("Unable to write to CGI process");
+        }
+        if (result == 0)
+            throw std::runtime_error("Unexpected end of stream");
+        _bodyOffset += static_cast<size_t>(result);
+    }
+
+    // If the whole body was written, close the input pipe and switch into output phase
+    if (_bodyOffset >= _request.body.size())
+    {
+        closeInput();
+        return false;
+    }
+    return true;
+}
+
+/* Writes a chunk of the kept bytes of a streamed body to the process, returns whether
+   writing should continue */
+bool CgiProcess::writePendingInput()
+{
+    if (!_pendingInput.empty())
+    {
+        ssize_t result = write(_process.getInputFileno(), _pendingInput.data(), _pendingInput.size());
+        if (result < 0)
+        {
+            if (SignalManager::shouldQuit())
+                return false;
+#ifndef __42_LIKES_WASTING_CPU_CYCLES__
+            if (errno == EAGAIN || errno == EWOULDBLOCK)
+                return false;
+
+            // A script may answer without reading all of its input, the rest is discarded
+            if (errno != EPIPE)
+#endif // __42_LIKES_WASTING_CPU_CYCLES__
+                throw std::runtime_error("Unable to write to CGI process");
+            _pendingInput.clear();
+            closeInput();
+        }
+        else if (result == 0)
+            throw std::runtime_error("Unexpected end of stream");
+        else
+            _pendingInput.erase(0, static_cast<size_t>(result));
+        if (!_pendingInput.empty())
+            return true;
+    }
+
+    // Once the kept bytes are written, let the client receive more of the body
+    if (_pendingInput.empty() && _isInputArmed)
+    {
+        _isInputArmed = false;
+        if (_process.getInputFileno() >= 0)
+            _client->_application._dispatcher.modify(_process.getInputFileno(), EPOLLHUP, this);
+        _client->resumeCgiBody();
+    }
+    if (_isBodyComplete && _process.getInputFileno() >= 0)
+        closeInput();
+    return false;
+}
+
+/* Closes the process' input and switches into output phase */
+void CgiProcess::closeInput()
+{
+    if (_subscribeFlags & SUBSCRIBE_FLAG_INPUT)
+        _client->_application._dispatcher.unsubscribe(_process.getInputFileno());
+    _subscribeFlags &= ~SUBSCRIBE_FLAG_INPUT;
+    _process.closeInput();
+
+    // The output of a process fed a streamed body is read from the start
+    if (!(_subscribeFlags & SUBSCRIBE_FLAG_OUTPUT))
+    {
+        _client->_application._dispatcher.subscribe(_process.getOutputFileno(), EPOLLIN | EPOLLHUP, this);
+        _subscribeFlags |= SUBSCRIBE_FLAG_OUTPUT;
+    }
+}
+
+/* Unsubscribes the process' pipes from the dispatcher */
+void CgiProcess::unsubscribe()
+{
+    if (_subscribeFlags & SUBSCRIBE_FLAG_INPUT && _process.getInputFileno() >= 0)
+        _client->_application._dispatcher.unsubscribe(_process.getInputFileno());
+    if (_subscribeFlags & SUBSCRIBE_FLAG_OUTPUT && _process.getOutputFileno() >= 0)
+        _client->_application._dispatcher.unsubscribe(_process.getOutputFileno());
+    _subscribeFlags = 0;
+}
+
+/* Reads a chunk of the process' output, returns whether reading should continue */
+bool CgiProcess::readOutput()
+{
+    char buffer[8192];
+
+    // Read up to 8KiB from the process' standard output pipe
+    ssize_t result = read(_process.getOutputFileno(), buffer, sizeof(buffer));
+    if (result < 0)
+    {
+        if (SignalManager::shouldQuit())
+            return false;
+#ifndef __42_LIKES_WASTING_CPU_CYCLES__
+        if (errno == EAGAIN || errno == EWOULDBLOCK)
+            return false;
+#endif // __42_LIKES_WASTING_CPU_CYCLES__
+        throw std::runtime_error("Unable to read from CGI process");
+    }
+    if (result == 0)
+    {
+#ifdef __42_LIKES_WASTING_CPU_CYCLES__
+        // This can never happen, see the following example:
+        // - Child process exits with status 0
+        //   The pipes are closed as a side-effect
+        // - Due to the pipes closing, an EPOLLIN or EPOLLOUT event is generated
+        // - The event handler (this function) calls `_process.getStatus()`
+        //   `Process` will call `waitpid()` which leads to `PROCESS_EXIT_SUCCESS`
+        //   and thus, never to `PROCESS_RUNNING` again
+        // - The zero-length read event is never processed and the process is marked
+        //   for destruction, leading to its destructor being called after the event
+        //   buffer is fully processed by `Dispatcher`
+        throw std::runtime_error("Unexpected end of stream");
+#else
+        // Draining reaches the end of the output before the process may have been reaped, so
+        // have the hang-up reported again for the next event to pick up the exit status
+        if (_client->_application._dispatcher.isEdgeTriggered() && (_subscribeFlags & SUBSCRIBE_FLAG_OUTPUT))
+            _client->_application._dispatcher.rearm(_process.getOutputFileno());
+        return false;
+#endif // __42_LIKES_WASTING_CPU_CYCLES__
+    }
+    size_t length = static_cast<size_t>(result);
+
+    // Output past the header of a piped body goes to the client right away
+    if (_outputMode == CGI_OUTPUT_PIPED)
+        _timeout.start(TIMEOUT_CGI_MS);
+    return handleOutput(Slice(buffer, length));
+}
+
+/* Stops reading the output while the client is too far behind on the piped body, returns
+   whether reading was paused */
+bool CgiProcess::pauseCongestedOutput()
+{
+    if (!isOutputCongested())
+        return false;
+    _client->_application._dispatcher.unsubscribe(_process.getOutputFileno());
+    _subscribeFlags &= ~SUBSCRIBE_FLAG_OUTPUT;
+    _isOutputPaused = true;
+
+    // The client's timeout covers the wait
+    _timeout.stop();
+    return true;
 }
 
 /* Handles an exception that occurred in `handleEvent()` */
@@ -171,7 +382,22 @@ void CgiProcess::handleTimeout()
     if (_state != CGI_PROCESS_RUNNING)
         return;
     _state = CGI_PROCESS_TIMEOUT;
-    _client->handleCgiState();
+
+    // The client destroys this process while handling the state, so keep a reference to it
+    HttpClient *client = _client;
+    try
+    {
+        client->handleCgiState();
+    }
+    // In case of catastrophic failure, drop the client
+    catch (const std::exception &exception)
+    {
+        client->handleException(exception.what());
+    }
+    catch (...)
+    {
+        client->handleException("Thrown type is not derived from std::exception");
+    }
 }
 
 /* Creates a vector of strings for the process arguments */
@@ -187,7 +413,8 @@ std::vector<std::string> CgiProcess::setupArguments(const HttpRequest &request,
 }
 
 /* Creates a vector of strings for the process environment */
-std::vector<std::string> CgiProcess::setupEnvironment(const HttpRequest &request, const RoutingInfo &routingInfo)
+std::vector<std::string> CgiProcess::setupEnvironment(const HttpRequest &request, const RoutingInfo &routingInfo,
+    const std::string &contentLength)
 {
     std::vector<std::string> result;
 
@@ -201,7 +428,8 @@ std::vector<std::string> CgiProcess::setupEnvironment(const HttpRequest &request
 
     // Add the standard CGI environment variables
     result.push_back("AUTH_TYPE=");
-    result.push_back("CONTENT_LENGTH=" + Utility::numberToString(request.body.size()));
+    if (!contentLength.empty())
+        result.push_back("CONTENT_LENGTH=" + contentLength);
     if (contentType != NULL)
         result.push_back("CONTENT_TYPE=" + contentType->getValue());
     result.push_back("GATEWAY_INTERFACE=CGI/1.1");
@@ -242,3 +470,20 @@ std::vector<std::string> CgiProcess::setupEnvironment(const HttpRequest &request
 
     return result;
 }
+
+/* Gets the value of `CONTENT_LENGTH` for the process, empty if the length isn't known before
+   the body of a streamed chunked request ends */
+std::string CgiProcess::getContentLength(const HttpRequest &request, const BodySpool *spool, bool streamsBody)
+{
+    if (spool != NULL)
+        return Utility::numberToString(spool->getLength());
+    if (!streamsBody)
+        return Utility::numberToString(request.body.size());
+
+    // The parser only lets a body through that matches its declared length
+    const HttpRequest::Header *contentLength = request.findHeader(C_SLICE("Content-Length"));
+    size_t length;
+    if (contentLength == NULL || !Utility::parseSize(contentLength->getValue(), length))
+        return std::string();
+    return Utility::numberToString(length);
+}
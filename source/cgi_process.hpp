@@ -3,10 +3,13 @@
 
 #include "process.hpp"
 #include "dispatcher.hpp"
+#include "timeout.hpp"
 #include "http_client.hpp"
 #include "http_request.hpp"
 #include "utility.hpp"
 #include "routing.hpp"
+#include "upload_handler.hpp"
+#include "cgi_backend.hpp"
 
 #include <stdint.h>
 #include <stddef.h>
@@ -16,14 +19,6 @@
 
 class HttpClient;
 
-enum CgiProcessState
-{
-    CGI_PROCESS_RUNNING,
-    CGI_PROCESS_FAILURE,
-    CGI_PROCESS_TIMEOUT,
-    CGI_PROCESS_SUCCESS,
-};
-
 struct CgiPathInfo
 {
     std::string workingDirectory;
@@ -32,14 +27,17 @@ struct CgiPathInfo
     CgiPathInfo(const std::string &nodePath);
 };
 
-class CgiProcess: public Sink
+class CgiProcess: public CgiBackend, public Sink, public TimeoutSink, public BodySink
 {
 public:
     friend class Application;
     friend class HttpClient;
 
-    /* Constructs a CGI process from the given client, request and route result */
-    CgiProcess(HttpClient *client, const HttpRequest &request, const RoutingInfo &routingInfo);
+    /* Constructs a CGI process from the given client, request and route result; the process
+       reads the body from `spool` if given, otherwise it's written from the request unless
+       `streamsBody` is set, in which case it's fed to the process while it arrives */
+    CgiProcess(HttpClient *client, const HttpRequest &request, const RoutingInfo &routingInfo,
+        const BodySpool *spool, bool streamsBody);
 
     /* Destroys the process */
     ~CgiProcess();
@@ -50,18 +48,6 @@ public:
     /* Handles an exception that occurred in `handleEvent()` */
     void handleException(const char *message);
 
-    /* Gets the process state */
-    inline CgiProcessState getState()
-    {
-        return _state;
-    }
-
-    /* Sets the process state */
-    inline void setState(CgiProcessState state)
-    {
-        _state = state;
-    }
-
     /* Gets the underlying process */
     inline Process &getProcess()
     {
@@ -76,22 +62,65 @@ public:
 
     /* Transitions the process into timeout state */
     void handleTimeout();
+
+    /* Feeds the next bytes of a streamed body to the process, bytes that don't fit into the
+       pipe are kept until it is writable again */
+    void writeBody(Slice data);
+
+    /* Closes the process' input once the kept bytes of a streamed body were written */
+    void finishBody();
+
+    /* Reads the output of a process that was paused for the client again */
+    void resumeOutput();
+
+    /* Gets whether bytes of a streamed body are kept because the process doesn't read them */
+    inline bool isInputCongested() const
+    {
+        return !_pendingInput.empty() && _state == CGI_PROCESS_RUNNING;
+    }
+
+    /* Unsubscribes the process' pipes from the dispatcher */
+    void unsubscribe();
+
+    /* Creates a vector of strings for the process environment */
+    static std::vector<std::string> setupEnvironment(const HttpRequest &request, const RoutingInfo &routingInfo,
+        const std::string &contentLength);
+
+    /* Gets the value of `CONTENT_LENGTH` for the process, empty if the length isn't known before
+       the body of a streamed chunked request ends */
+    static std::string getContentLength(const HttpRequest &request, const BodySpool *spool, bool streamsBody);
 private:
-    CgiProcessState      _state;
     CgiPathInfo          _pathInfo;
-    HttpClient          *_client;
     const HttpRequest   &_request;
     Process              _process;
-    std::vector<uint8_t> _buffer;
     Timeout              _timeout;
     size_t               _bodyOffset;
     unsigned int         _subscribeFlags;
+    bool                 _streamsBody;
+    bool                 _isBodyComplete;
+    bool                 _isInputArmed;
+    std::string          _pendingInput;
+    bool                 _isOutputPaused;
+
+    /* Writes a chunk of the request body to the process, returns whether writing should continue */
+    bool writeInput();
+
+    /* Writes a chunk of the kept bytes of a streamed body to the process, returns whether
+       writing should continue */
+    bool writePendingInput();
+
+    /* Closes the process' input and switches into output phase */
+    void closeInput();
+
+    /* Reads a chunk of the process' output, returns whether reading should continue */
+    bool readOutput();
+
+    /* Stops reading the output while the client is too far behind on the piped body, returns
+       whether reading was paused */
+    bool pauseCongestedOutput();
 
     /* Creates a vector of strings for the process arguments */
     static std::vector<std::string> setupArguments(const HttpRequest &request, const RoutingInfo &routingInfo, const std::string &fileName);
-
-    /* Creates a vector of strings for the process environment */
-    static std::vector<std::string> setupEnvironment(const HttpRequest &request, const RoutingInfo &routingInfo);
 };
 
 #endif // CGI_PROCESS_hpp
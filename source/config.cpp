@@ -4,14 +4,69 @@
 /* Initializes a server configuration using the default parameters */
 ServerConfig::ServerConfig()
     : maxBodySize(100000)
+    , listenBacklog(128)
+    , acceptBudget(64)
+    , keepAliveTimeout(15000)
+    , keepAliveRequests(100)
     , nextEndpoint(NULL)
 {
 }
 
+/* Initializes a compression configuration using the default parameters */
+CompressionConfig::CompressionConfig()
+    : enabled(false)
+    , minLength(256)
+{
+    mimeTypes.insert("text/html");
+}
+
+/* Checks whether bodies of the given media type (parameters allowed) may be compressed */
+bool CompressionConfig::allowsType(Slice contentType) const
+{
+    Slice type;
+    if (!contentType.splitStart(';', type))
+        type = contentType;
+    type.stripStart(' ').stripEnd(' ');
+
+    std::set<std::string>::const_iterator iterator = mimeTypes.begin();
+    for (; iterator != mimeTypes.end(); iterator++)
+    {
+        if (*iterator == "*" || Slice(*iterator).equalsIgnoreCase(type))
+            return true;
+    }
+    return false;
+}
+
+/* Initializes a FastCGI address that is yet to be parsed */
+FastCgiAddress::FastCgiAddress()
+    : host(0)
+    , port(0)
+{
+}
+
 /* Initializes a local route configuration using the default parameters */
 LocalRouteConfig::LocalRouteConfig()
     : allowUpload(false)
     , allowListing(false)
+    , servePrecompressed(false)
+    , streamCgiBody(false)
+{
+}
+
+/* Initializes an application configuration using the default parameters */
+ApplicationConfig::ApplicationConfig()
+    : workerCount(1)
+    , workerAffinity(false)
+    , workerMode(WORKER_MODE_THREADS)
+    , edgeTriggered(false)
+    , eventBackend(EVENT_BACKEND_EPOLL)
+    , fileCacheSize(0)
+    , fileCacheValidity(1000)
+    , responseCacheSize(0)
+    , gzipCacheSize(0)
+    , cgiOutputBufferSize(0)
+    , cgiOutputMaxSize(2147483648u)
+    , fastCgiConnections(8)
 {
 }
 
@@ -12,18 +12,67 @@
 
 struct ServerConfig;
 
+/* How the workers of the application are run */
+enum WorkerMode
+{
+    /* All workers are threads of a single process */
+    WORKER_MODE_THREADS,
+    /* Each worker is a supervised child process sharing the master's listeners */
+    WORKER_MODE_PROCESSES
+};
+
+/* Which kernel interface the dispatcher uses to wait for events */
+enum EventBackend
+{
+    /* Readiness is reported by an epoll instance */
+    EVENT_BACKEND_EPOLL,
+    /* Readiness is reported by poll requests on an io_uring instance, which also accepts the
+       connections of listening sockets */
+    EVENT_BACKEND_IO_URING
+};
+
+/* How the responses of a route are compressed on the fly */
+struct CompressionConfig
+{
+    bool                  enabled;
+    size_t                minLength;
+    std::set<std::string> mimeTypes;
+
+    CompressionConfig();
+
+    /* Checks whether bodies of the given media type (parameters allowed) may be compressed */
+    bool allowsType(Slice contentType) const;
+};
+
+/* Where a FastCGI application accepts connections, on a Unix domain socket or a TCP port */
+struct FastCgiAddress
+{
+    std::string name;       // The address as configured, which identifies the application
+    std::string socketPath; // Path of the Unix domain socket, empty for TCP
+    uint32_t    host;
+    uint16_t    port;
+
+    FastCgiAddress();
+};
+
 /* Configuration for a route that requires further processing by the server */
 struct LocalRouteConfig
 {
-    std::string                        path;
-    std::set<HttpMethod>               allowedMethods;
-    std::string                        rootDirectory;
-    std::string                        uploadDirectory;
-    std::string                        indexFile;
-    bool                               allowUpload;
-    bool                               allowListing;
-    std::map<std::string, std::string> cgiTypes;
-    std::set<TokenKind>                parsedTokens;
+    std::string                           path;
+    std::set<HttpMethod>                  allowedMethods;
+    std::string                           rootDirectory;
+    std::string                           uploadDirectory;
+    std::string                           uploadStore;
+    std::string                           uploadStateDirectory;
+    std::string                           indexFile;
+    bool                                  allowUpload;
+    bool                                  allowListing;
+    bool                                  servePrecompressed;
+    bool                                  streamCgiBody;
+    CompressionConfig                     compression;
+    std::map<std::string, std::string>    cgiTypes;
+    std::map<std::string, FastCgiAddress> fastCgiTypes;
+    std::set<TokenKind>                   parsedTokens;
 
     LocalRouteConfig();
 };
@@ -44,6 +93,10 @@ struct ServerConfig
     uint16_t                         port;
     std::map<int, std::string>       errorPages;
     size_t                           maxBodySize;
+    size_t                           listenBacklog;
+    size_t                           acceptBudget;
+    size_t                           keepAliveTimeout;
+    size_t                           keepAliveRequests;
     std::vector<LocalRouteConfig>    localRoutes;
     std::vector<RedirectRouteConfig> redirectRoutes;
     std::set<TokenKind>              parsedTokens;
@@ -53,12 +106,33 @@ struct ServerConfig
 
     /* Searches for the right server configuration based on the name, returns `this` if not found */
     const ServerConfig *findServer(Slice name) const;
+
+    /* Gets a key that is unique for the server's host and port */
+    inline uint64_t getBindingKey() const
+    {
+        return static_cast<uint64_t>(host) | (static_cast<uint64_t>(port) << 32);
+    }
 };
 
 /* Global application configuration; can contain many virtual servers */
 struct ApplicationConfig
 {
     std::vector<ServerConfig> servers;
+    size_t                    workerCount;
+    bool                      workerAffinity;
+    WorkerMode                workerMode;
+    bool                      edgeTriggered;
+    EventBackend              eventBackend;
+    size_t                    fileCacheSize;
+    size_t                    fileCacheValidity;
+    size_t                    responseCacheSize;
+    size_t                    gzipCacheSize;
+    size_t                    cgiOutputBufferSize;
+    size_t                    cgiOutputMaxSize;
+    size_t                    fastCgiConnections;
+    std::set<TokenKind>       parsedTokens;
+
+    ApplicationConfig();
 };
 
 #endif // CONFIG_hpp
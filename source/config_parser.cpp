@@ -1,4 +1,8 @@
 #include "config_parser.hpp"
+#include "utility.hpp"
+
+#include <stdint.h>
+#include <sys/un.h>
 
 // Constructor
 ConfigParser::ConfigParser(const std::vector<Token> &tokens) : _tokens(tokens), _current(0)
@@ -15,6 +19,90 @@ ApplicationConfig ConfigParser::parse()
             applicationConfig.servers.push_back(parseServerConfig(applicationConfig));
         else if (_tokens[_current].kind == SY_COMMEND)
             moveToNextToken();
+        else if (_tokens[_current].kind == KW_WORKERS)
+        {
+            isRedundantToken(_tokens[_current].offset, applicationConfig, KW_WORKERS, _config_input);
+            moveToNextToken();
+            applicationConfig.workerCount = parseWorkerCount();
+            expect(SY_SEMICOLON);
+        }
+        else if (_tokens[_current].kind == KW_WORKER_AFFINITY)
+        {
+            isRedundantToken(_tokens[_current].offset, applicationConfig, KW_WORKER_AFFINITY, _config_input);
+            moveToNextToken();
+            applicationConfig.workerAffinity = parseSwitch("worker_affinity");
+            expect(SY_SEMICOLON);
+        }
+        else if (_tokens[_current].kind == KW_WORKER_MODE)
+        {
+            isRedundantToken(_tokens[_current].offset, applicationConfig, KW_WORKER_MODE, _config_input);
+            moveToNextToken();
+            applicationConfig.workerMode = parseWorkerMode();
+            expect(SY_SEMICOLON);
+        }
+        else if (_tokens[_current].kind == KW_EDGE_TRIGGERED)
+        {
+            isRedundantToken(_tokens[_current].offset, applicationConfig, KW_EDGE_TRIGGERED, _config_input);
+            moveToNextToken();
+            applicationConfig.edgeTriggered = parseSwitch("edge_triggered");
+            expect(SY_SEMICOLON);
+        }
+        else if (_tokens[_current].kind == KW_EVENT_BACKEND)
+        {
+            isRedundantToken(_tokens[_current].offset, applicationConfig, KW_EVENT_BACKEND, _config_input);
+            moveToNextToken();
+            applicationConfig.eventBackend = parseEventBackend();
+            expect(SY_SEMICOLON);
+        }
+        else if (_tokens[_current].kind == KW_FILE_CACHE_SIZE)
+        {
+            isRedundantToken(_tokens[_current].offset, applicationConfig, KW_FILE_CACHE_SIZE, _config_input);
+            moveToNextToken();
+            applicationConfig.fileCacheSize = parseBoundedSizeT("file_cache_size", 0, 65536);
+            expect(SY_SEMICOLON);
+        }
+        else if (_tokens[_current].kind == KW_FILE_CACHE_VALIDITY)
+        {
+            isRedundantToken(_tokens[_current].offset, applicationConfig, KW_FILE_CACHE_VALIDITY, _config_input);
+            moveToNextToken();
+            applicationConfig.fileCacheValidity = parseBoundedSizeT("file_cache_validity", 0, 3600000);
+            expect(SY_SEMICOLON);
+        }
+        else if (_tokens[_current].kind == KW_RESPONSE_CACHE_SIZE)
+        {
+            isRedundantToken(_tokens[_current].offset, applicationConfig, KW_RESPONSE_CACHE_SIZE, _config_input);
+            moveToNextToken();
+            applicationConfig.responseCacheSize = parseBoundedSizeT("response_cache_size", 0, 1073741824);
+            expect(SY_SEMICOLON);
+        }
+        else if (_tokens[_current].kind == KW_GZIP_CACHE_SIZE)
+        {
+            isRedundantToken(_tokens[_current].offset, applicationConfig, KW_GZIP_CACHE_SIZE, _config_input);
+            moveToNextToken();
+            applicationConfig.gzipCacheSize = parseBoundedSizeT("gzip_cache_size", 0, 1073741824);
+            expect(SY_SEMICOLON);
+        }
+        else if (_tokens[_current].kind == KW_CGI_OUTPUT_BUFFER_SIZE)
+        {
+            isRedundantToken(_tokens[_current].offset, applicationConfig, KW_CGI_OUTPUT_BUFFER_SIZE, _config_input);
+            moveToNextToken();
+            applicationConfig.cgiOutputBufferSize = parseBoundedSizeT("cgi_output_buffer_size", 0, 1073741824);
+            expect(SY_SEMICOLON);
+        }
+        else if (_tokens[_current].kind == KW_CGI_OUTPUT_MAX_SIZE)
+        {
+            isRedundantToken(_tokens[_current].offset, applicationConfig, KW_CGI_OUTPUT_MAX_SIZE, _config_input);
+            moveToNextToken();
+            applicationConfig.cgiOutputMaxSize = parseBoundedSizeT("cgi_output_max_size", 1, SIZE_MAX);
+            expect(SY_SEMICOLON);
+        }
+        else if (_tokens[_current].kind == KW_FASTCGI_CONNECTIONS)
+        {
+            isRedundantToken(_tokens[_current].offset, applicationConfig, KW_FASTCGI_CONNECTIONS, _config_input);
+            moveToNextToken();
+            applicationConfig.fastCgiConnections = parseBoundedSizeT("fastcgi_connections", 1, 1024);
+            expect(SY_SEMICOLON);
+        }
         else
             throw ConfigException("Error: Unexpected token in config", _config_input, _tokens[_current].offset);
     }    
@@ -22,6 +110,44 @@ ApplicationConfig ConfigParser::parse()
     return applicationConfig;
 }
 
+// Parsing ApplicationConfig
+size_t ConfigParser::parseWorkerCount()
+{
+    size_t offset = _tokens[_current].offset;
+    size_t count = parseSizeT();
+    if (count < 1 || count > 1024)
+        throw ConfigException("Error: Invalid worker count. Shall be between 1 and 1024", _config_input, offset);
+    return count;
+}
+
+WorkerMode ConfigParser::parseWorkerMode()
+{
+    expect(DATA);
+    WorkerMode mode;
+    if (currentToken().data == "threads")
+        mode = WORKER_MODE_THREADS;
+    else if (currentToken().data == "processes")
+        mode = WORKER_MODE_PROCESSES;
+    else
+        throw ConfigException("Error: Invalid value for worker_mode", _config_input, _tokens[_current].offset);
+    moveToNextToken();
+    return mode;
+}
+
+EventBackend ConfigParser::parseEventBackend()
+{
+    expect(DATA);
+    EventBackend backend;
+    if (currentToken().data == "epoll")
+        backend = EVENT_BACKEND_EPOLL;
+    else if (currentToken().data == "io_uring")
+        backend = EVENT_BACKEND_IO_URING;
+    else
+        throw ConfigException("Error: Invalid value for event_backend", _config_input, _tokens[_current].offset);
+    moveToNextToken();
+    return backend;
+}
+
 // Parsing ServerConfig
 ServerConfig ConfigParser::parseServerConfig(ApplicationConfig &applicationConfig)
 {
@@ -56,6 +182,30 @@ ServerConfig ConfigParser::parseServerConfig(ApplicationConfig &applicationConfi
             serverConfig.maxBodySize = parseSizeT();
             expect(SY_SEMICOLON);
             break;
+        case KW_LISTEN_BACKLOG:
+            isRedundantToken(_tokens[_current].offset, serverConfig, KW_LISTEN_BACKLOG, _config_input);
+            moveToNextToken();
+            serverConfig.listenBacklog = parseBoundedSizeT("listen_backlog", 1, 65535);
+            expect(SY_SEMICOLON);
+            break;
+        case KW_ACCEPT_BUDGET:
+            isRedundantToken(_tokens[_current].offset, serverConfig, KW_ACCEPT_BUDGET, _config_input);
+            moveToNextToken();
+            serverConfig.acceptBudget = parseBoundedSizeT("accept_budget", 1, 4096);
+            expect(SY_SEMICOLON);
+            break;
+        case KW_KEEPALIVE_TIMEOUT:
+            isRedundantToken(_tokens[_current].offset, serverConfig, KW_KEEPALIVE_TIMEOUT, _config_input);
+            moveToNextToken();
+            serverConfig.keepAliveTimeout = parseBoundedSizeT("keepalive_timeout", 0, 3600000);
+            expect(SY_SEMICOLON);
+            break;
+        case KW_KEEPALIVE_REQUESTS:
+            isRedundantToken(_tokens[_current].offset, serverConfig, KW_KEEPALIVE_REQUESTS, _config_input);
+            moveToNextToken();
+            serverConfig.keepAliveRequests = parseBoundedSizeT("keepalive_requests", 1, 1000000);
+            expect(SY_SEMICOLON);
+            break;
         case KW_ERROR_PAGE:
             moveToNextToken();
             currentErrorRedirect = parseErrorRedirects();
@@ -177,6 +327,31 @@ size_t ConfigParser::parseSizeT()
     return num;
 }
 
+size_t ConfigParser::parseBoundedSizeT(const std::string &directive, size_t minimum, size_t maximum)
+{
+    size_t offset = _tokens[_current].offset;
+    size_t value = parseSizeT();
+    if (value < minimum || value > maximum)
+        throw ConfigException("Error: Invalid value for " + directive + ". Shall be between "
+                              + Utility::numberToString(minimum) + " and " + Utility::numberToString(maximum),
+                              _config_input, offset);
+    return value;
+}
+
+bool ConfigParser::parseSwitch(const std::string &directive)
+{
+    expect(DATA);
+    bool value;
+    if (currentToken().data == "on")
+        value = true;
+    else if (currentToken().data == "off")
+        value = false;
+    else
+        throw ConfigException("Error: Invalid value for " + directive, _config_input, _tokens[_current].offset);
+    moveToNextToken();
+    return value;
+}
+
 std::map<int, std::string> ConfigParser::parseErrorRedirects()
 {
     std::map<int, std::string> errorRedirects;
@@ -200,6 +375,7 @@ LocalRouteConfig ConfigParser::parseLocalRouteConfig(ServerConfig &serverConfig)
 {
     LocalRouteConfig localRouteConfig;
     std::map<std::string, std::string> currentCgiFileExtension;
+    std::map<std::string, FastCgiAddress> currentFastCgiFileExtension;
 
     moveToNextToken();
     localRouteConfig.path = parseLocalRoutePath();
@@ -249,12 +425,63 @@ LocalRouteConfig ConfigParser::parseLocalRouteConfig(ServerConfig &serverConfig)
                                              currentCgiFileExtension.end());
             expect(SY_SEMICOLON);
             break;
+        case KW_FASTCGI:
+            moveToNextToken();
+            currentFastCgiFileExtension = parseFastCgiFileExtensions();
+            isRedundantToken(_tokens[_current - 2].offset, localRouteConfig, KW_FASTCGI,
+                             currentFastCgiFileExtension, _config_input);
+            localRouteConfig.fastCgiTypes.insert(currentFastCgiFileExtension.begin(),
+                                                 currentFastCgiFileExtension.end());
+            expect(SY_SEMICOLON);
+            break;
         case KW_ALLOW_UPLOAD:
             isRedundantToken(_tokens[_current].offset, localRouteConfig, KW_ALLOW_UPLOAD, _config_input);
             moveToNextToken();
             localRouteConfig.allowUpload = parseAllowUpload();
             expect(SY_SEMICOLON);
             break;
+        case KW_UPLOAD_STORE:
+            isRedundantToken(_tokens[_current].offset, localRouteConfig, KW_UPLOAD_STORE, _config_input);
+            moveToNextToken();
+            localRouteConfig.uploadStore = parseString();
+            expect(SY_SEMICOLON);
+            break;
+        case KW_UPLOAD_STATE:
+            isRedundantToken(_tokens[_current].offset, localRouteConfig, KW_UPLOAD_STATE, _config_input);
+            moveToNextToken();
+            localRouteConfig.uploadStateDirectory = parseString();
+            expect(SY_SEMICOLON);
+            break;
+        case KW_CGI_STREAM_BODY:
+            isRedundantToken(_tokens[_current].offset, localRouteConfig, KW_CGI_STREAM_BODY, _config_input);
+            moveToNextToken();
+            localRouteConfig.streamCgiBody = parseSwitch("cgi_stream_body");
+            expect(SY_SEMICOLON);
+            break;
+        case KW_PRECOMPRESSED:
+            isRedundantToken(_tokens[_current].offset, localRouteConfig, KW_PRECOMPRESSED, _config_input);
+            moveToNextToken();
+            localRouteConfig.servePrecompressed = parseSwitch("precompressed");
+            expect(SY_SEMICOLON);
+            break;
+        case KW_GZIP:
+            isRedundantToken(_tokens[_current].offset, localRouteConfig, KW_GZIP, _config_input);
+            moveToNextToken();
+            localRouteConfig.compression.enabled = parseSwitch("gzip");
+            expect(SY_SEMICOLON);
+            break;
+        case KW_GZIP_MIN_LENGTH:
+            isRedundantToken(_tokens[_current].offset, localRouteConfig, KW_GZIP_MIN_LENGTH, _config_input);
+            moveToNextToken();
+            localRouteConfig.compression.minLength = parseBoundedSizeT("gzip_min_length", 0, 1073741824);
+            expect(SY_SEMICOLON);
+            break;
+        case KW_GZIP_TYPES:
+            isRedundantToken(_tokens[_current].offset, localRouteConfig, KW_GZIP_TYPES, _config_input);
+            moveToNextToken();
+            localRouteConfig.compression.mimeTypes = parseMimeTypes();
+            expect(SY_SEMICOLON);
+            break;
         case KW_REDIRECT_ADDRESS:
             isRedundantToken(_tokens[_current].offset, localRouteConfig, KW_REDIRECT_ADDRESS, _config_input);
             isRedundantToken(_tokens[_current].offset, localRouteConfig, KW_ROOT, _config_input);
@@ -270,6 +497,12 @@ LocalRouteConfig ConfigParser::parseLocalRouteConfig(ServerConfig &serverConfig)
 
     expect(SY_BRACE_CLOSE);
     isRouteTokensMissing(localRouteConfig.parsedTokens, _tokens[_current].offset,_config_input);
+    if (!localRouteConfig.uploadStore.empty())
+        checkSameFilesystem(localRouteConfig.uploadStore, localRouteConfig.rootDirectory,
+                            "upload_store", _tokens[_current].offset, _config_input);
+    if (!localRouteConfig.uploadStateDirectory.empty())
+        checkSameFilesystem(localRouteConfig.uploadStateDirectory, localRouteConfig.rootDirectory,
+                            "upload_state", _tokens[_current].offset, _config_input);
     return localRouteConfig;
 }
 
@@ -347,6 +580,63 @@ std::map<std::string, std::string> ConfigParser::parseCgiFileExtensions()
     return cgiFileExtensions;
 }
 
+std::map<std::string, FastCgiAddress> ConfigParser::parseFastCgiFileExtensions()
+{
+    std::map<std::string, FastCgiAddress> fastCgiFileExtensions;
+    std::string extension;
+    expect(DATA);
+    extension = currentToken().data;
+    checkValidCgiFileExtension(extension, _tokens[_current].offset, _config_input);
+    moveToNextToken();
+    fastCgiFileExtensions[extension] = parseFastCgiAddress();
+    return fastCgiFileExtensions;
+}
+
+// Parses `unix:<path>` for a Unix domain socket or `<ip>:<port>` for a TCP port
+FastCgiAddress ConfigParser::parseFastCgiAddress()
+{
+    expect(DATA);
+    FastCgiAddress address;
+    address.name = currentToken().data;
+    size_t offset = _tokens[_current].offset;
+    if (address.name.compare(0, 5, "unix:") == 0)
+    {
+        address.socketPath = address.name.substr(5);
+        if (address.socketPath.empty() || address.socketPath.size() >= sizeof(sockaddr_un().sun_path))
+            throw ConfigException("Error: Invalid FastCGI socket path", _config_input, offset);
+    }
+    else
+    {
+        size_t separator = address.name.find(':');
+        if (separator == std::string::npos)
+            throw ConfigException("Error: Invalid FastCGI address", _config_input, offset);
+        address.host = ConvertIpString(address.name.substr(0, separator), offset, _config_input);
+        std::istringstream iss(address.name.substr(separator + 1));
+        iss >> address.port;
+        if (iss.fail() || !iss.eof() || address.port == 0)
+            throw ConfigException("Error: Invalid port number", _config_input, offset);
+    }
+    moveToNextToken();
+    return address;
+}
+
+std::set<std::string> ConfigParser::parseMimeTypes()
+{
+    std::set<std::string> mimeTypes;
+    while (currentToken().kind != SY_SEMICOLON)
+    {
+        expect(DATA);
+        const std::string &type = currentToken().data;
+        if (type != "*" && (type.find('/') == std::string::npos || type.find(';') != std::string::npos))
+            throw ConfigException("Error: Invalid MIME type", _config_input, _tokens[_current].offset);
+        mimeTypes.insert(type);
+        moveToNextToken();
+    }
+    if (mimeTypes.empty())
+        throw ConfigException("Error: Missing MIME types", _config_input, _tokens[_current].offset);
+    return mimeTypes;
+}
+
 // Parse RedirectRouteConfig
 RedirectRouteConfig ConfigParser::parseRedirectRouteConfig(LocalRouteConfig &localRouteConfig)
 {
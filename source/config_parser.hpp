@@ -19,6 +19,12 @@ private:
     size_t _current;
     std::string _config_input;
 
+    // Parsing ApplicationConfig
+    size_t parseWorkerCount();
+    WorkerMode parseWorkerMode();
+
+    EventBackend parseEventBackend();
+
     // Parsing ServerConfig
     ServerConfig parseServerConfig(ApplicationConfig &applicationConfig);
     void parsePortOrIp(ServerConfig &serverConfig);
@@ -30,6 +36,9 @@ private:
     bool parseDirectoryListing();
     bool parseAllowUpload();
     std::map<std::string, std::string> parseCgiFileExtensions();
+    std::map<std::string, FastCgiAddress> parseFastCgiFileExtensions();
+    FastCgiAddress parseFastCgiAddress();
+    std::set<std::string> parseMimeTypes();
 
     // Parsing RedirectRouteConfig
     RedirectRouteConfig parseRedirectRouteConfig(LocalRouteConfig &localRouteConfig);
@@ -45,6 +54,8 @@ private:
     std::string parseLocalRoutePath();
     uint16_t parseUint16();
     size_t parseSizeT();
+    size_t parseBoundedSizeT(const std::string &directive, size_t minimum, size_t maximum);
+    bool parseSwitch(const std::string &directive);
     std::map<int, std::string> parseErrorRedirects();
 
     // Check if there are virtual servers with the same ip+port+server_name
@@ -1,7 +1,15 @@
 #include "config_parser_utility.hpp"
 
 #include <stdlib.h>
+#include <sys/stat.h>
 
+// Checks if the global token is already defined
+void isRedundantToken(size_t offset, ApplicationConfig &applicationConfig, TokenKind tokenKind, std::string config_input)
+{
+    if (applicationConfig.parsedTokens.find(tokenKind) != applicationConfig.parsedTokens.end())
+        throw ConfigException("Error: Redundant token", config_input, offset);
+    applicationConfig.parsedTokens.insert(tokenKind);
+}
 // Checks if the token is already defined for all tokens exept KW_ERROR_PAGE and KW_LOCATION
 void isRedundantToken(size_t offset, ServerConfig &serverConfig, TokenKind tokenKind, std::string config_input)
 {
@@ -51,7 +59,21 @@ void isRedundantToken(size_t offset, LocalRouteConfig &localRouteConfig, TokenKi
                       std::map<std::string, std::string> &currentCgiFileExtension, std::string config_input)
 {
     if (localRouteConfig.cgiTypes.find(currentCgiFileExtension.begin()->first) !=
-        localRouteConfig.cgiTypes.end())
+        localRouteConfig.cgiTypes.end() ||
+        localRouteConfig.fastCgiTypes.find(currentCgiFileExtension.begin()->first) !=
+        localRouteConfig.fastCgiTypes.end())
+        throw ConfigException("Error: Redundant token CGI file extension", config_input, offset);
+    localRouteConfig.parsedTokens.insert(tokenKind);
+}
+
+// Checks if the FastCGI file extension is already defined
+void isRedundantToken(size_t offset, LocalRouteConfig &localRouteConfig, TokenKind tokenKind,
+                      std::map<std::string, FastCgiAddress> &currentFastCgiFileExtension, std::string config_input)
+{
+    if (localRouteConfig.cgiTypes.find(currentFastCgiFileExtension.begin()->first) !=
+        localRouteConfig.cgiTypes.end() ||
+        localRouteConfig.fastCgiTypes.find(currentFastCgiFileExtension.begin()->first) !=
+        localRouteConfig.fastCgiTypes.end())
         throw ConfigException("Error: Redundant token CGI file extension", config_input, offset);
     localRouteConfig.parsedTokens.insert(tokenKind);
 }
@@ -78,6 +100,20 @@ void checkValidCgiFileExtension(const std::string &cgiFileExtension, size_t offs
         throw ConfigException("Error: Invalid CGI file extension", config_input, offset);
 }
 
+// Files are moved or linked between both directories, which only works within a filesystem
+void checkSameFilesystem(const std::string &directory, const std::string &rootDirectory, const char *directive,
+                         size_t offset, std::string config_input)
+{
+    struct stat directoryStatus;
+    struct stat rootStatus;
+
+    if (stat(directory.c_str(), &directoryStatus) != 0 || !S_ISDIR(directoryStatus.st_mode))
+        throw ConfigException(std::string("Error: The ") + directive + " directory doesn't exist", config_input, offset);
+    if (stat(rootDirectory.c_str(), &rootStatus) != 0 || rootStatus.st_dev != directoryStatus.st_dev)
+        throw ConfigException(std::string("Error: The ") + directive + " directory isn't on the filesystem of the root",
+                              config_input, offset);
+}
+
 std::string readFile(const char *path)
 {
     std::ifstream inputStream(path);
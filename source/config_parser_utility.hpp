@@ -5,6 +5,8 @@
 #include "config_parser.hpp"
 #include "config_tokenizer.hpp"
 
+// Checks if the global token is already defined
+void isRedundantToken(size_t offset, ApplicationConfig &applicationConfig, TokenKind tokenKind, std::string config_input);
 // Checks if the token is already defined for all tokens exept KW_ERROR_PAGE and KW_LOCATION
 void isRedundantToken(size_t offset, ServerConfig &serverConfig, TokenKind tokenKind, std::string config_input);
 // Checks if the error redirect (error page) is already defined
@@ -18,6 +20,9 @@ void isRedundantToken(size_t offset, LocalRouteConfig &localRouteConfig, TokenKi
 // Checks if the cgi file extension is already defined
 void isRedundantToken(size_t offset, LocalRouteConfig &localRouteConfig, TokenKind tokenKind,
                       std::map<std::string, std::string> &currentCgiFileExtension, std::string config_input);
+// Checks if the FastCGI file extension is already defined
+void isRedundantToken(size_t offset, LocalRouteConfig &localRouteConfig, TokenKind tokenKind,
+                      std::map<std::string, FastCgiAddress> &currentFastCgiFileExtension, std::string config_input);
 
 // Check if required server config entries/tokens are missing
 void isServerTokensMissing(std::set<TokenKind> &parsedTokens, size_t offset, std::string config_input);
@@ -25,6 +30,9 @@ void isServerTokensMissing(std::set<TokenKind> &parsedTokens, size_t offset, std
 void isRouteTokensMissing(std::set<TokenKind> &parsedTokens, size_t offset, std::string config_input);
 // Check if it is a valid CGI file extension
 void checkValidCgiFileExtension(const std::string &cgiFileExtension, size_t offset, std::string config_input);
+// Check if the directory of the given directive exists on the same filesystem as the route's root
+void checkSameFilesystem(const std::string &directory, const std::string &rootDirectory, const char *directive,
+                         size_t offset, std::string config_input);
 
 // Read then all content of the config file
 std::string readFile(const char *path);
@@ -104,8 +104,56 @@ TokenKind ConfigTokenizer::getTokenKind(const std::string &word)
         return (KW_MAX_BODY_SIZE);
     else if (word == "cgi")
         return (KW_CGI);
+    else if (word == "fastcgi")
+        return (KW_FASTCGI);
     else if (word == "allow_upload")
         return (KW_ALLOW_UPLOAD);
+    else if (word == "upload_store")
+        return (KW_UPLOAD_STORE);
+    else if (word == "upload_state")
+        return (KW_UPLOAD_STATE);
+    else if (word == "cgi_stream_body")
+        return (KW_CGI_STREAM_BODY);
+    else if (word == "precompressed")
+        return (KW_PRECOMPRESSED);
+    else if (word == "gzip")
+        return (KW_GZIP);
+    else if (word == "gzip_min_length")
+        return (KW_GZIP_MIN_LENGTH);
+    else if (word == "gzip_types")
+        return (KW_GZIP_TYPES);
+    else if (word == "listen_backlog")
+        return (KW_LISTEN_BACKLOG);
+    else if (word == "accept_budget")
+        return (KW_ACCEPT_BUDGET);
+    else if (word == "keepalive_timeout")
+        return (KW_KEEPALIVE_TIMEOUT);
+    else if (word == "keepalive_requests")
+        return (KW_KEEPALIVE_REQUESTS);
+    else if (word == "workers")
+        return (KW_WORKERS);
+    else if (word == "worker_affinity")
+        return (KW_WORKER_AFFINITY);
+    else if (word == "worker_mode")
+        return (KW_WORKER_MODE);
+    else if (word == "edge_triggered")
+        return (KW_EDGE_TRIGGERED);
+    else if (word == "event_backend")
+        return (KW_EVENT_BACKEND);
+    else if (word == "file_cache_size")
+        return (KW_FILE_CACHE_SIZE);
+    else if (word == "file_cache_validity")
+        return (KW_FILE_CACHE_VALIDITY);
+    else if (word == "response_cache_size")
+        return (KW_RESPONSE_CACHE_SIZE);
+    else if (word == "gzip_cache_size")
+        return (KW_GZIP_CACHE_SIZE);
+    else if (word == "cgi_output_buffer_size")
+        return (KW_CGI_OUTPUT_BUFFER_SIZE);
+    else if (word == "cgi_output_max_size")
+        return (KW_CGI_OUTPUT_MAX_SIZE);
+    else if (word == "fastcgi_connections")
+        return (KW_FASTCGI_CONNECTIONS);
     else if (word == "#")
         return (SY_COMMEND);
     else
@@ -154,8 +202,56 @@ std::string ConfigTokenizer::TokenKindToString(TokenKind token)
         return "KW_BODY_SIZE";
     case KW_CGI:
         return "KW_CGI";
+    case KW_FASTCGI:
+        return "KW_FASTCGI";
     case KW_ALLOW_UPLOAD:
         return "KW_ALLOW_UPLOAD";
+    case KW_UPLOAD_STORE:
+        return "KW_UPLOAD_STORE";
+    case KW_UPLOAD_STATE:
+        return "KW_UPLOAD_STATE";
+    case KW_CGI_STREAM_BODY:
+        return "KW_CGI_STREAM_BODY";
+    case KW_PRECOMPRESSED:
+        return "KW_PRECOMPRESSED";
+    case KW_GZIP:
+        return "KW_GZIP";
+    case KW_GZIP_MIN_LENGTH:
+        return "KW_GZIP_MIN_LENGTH";
+    case KW_GZIP_TYPES:
+        return "KW_GZIP_TYPES";
+    case KW_LISTEN_BACKLOG:
+        return "KW_LISTEN_BACKLOG";
+    case KW_ACCEPT_BUDGET:
+        return "KW_ACCEPT_BUDGET";
+    case KW_KEEPALIVE_TIMEOUT:
+        return "KW_KEEPALIVE_TIMEOUT";
+    case KW_KEEPALIVE_REQUESTS:
+        return "KW_KEEPALIVE_REQUESTS";
+    case KW_WORKERS:
+        return "KW_WORKERS";
+    case KW_WORKER_AFFINITY:
+        return "KW_WORKER_AFFINITY";
+    case KW_WORKER_MODE:
+        return "KW_WORKER_MODE";
+    case KW_EDGE_TRIGGERED:
+        return "KW_EDGE_TRIGGERED";
+    case KW_EVENT_BACKEND:
+        return "KW_EVENT_BACKEND";
+    case KW_FILE_CACHE_SIZE:
+        return "KW_FILE_CACHE_SIZE";
+    case KW_FILE_CACHE_VALIDITY:
+        return "KW_FILE_CACHE_VALIDITY";
+    case KW_RESPONSE_CACHE_SIZE:
+        return "KW_RESPONSE_CACHE_SIZE";
+    case KW_GZIP_CACHE_SIZE:
+        return "KW_GZIP_CACHE_SIZE";
+    case KW_CGI_OUTPUT_BUFFER_SIZE:
+        return "KW_CGI_OUTPUT_BUFFER_SIZE";
+    case KW_CGI_OUTPUT_MAX_SIZE:
+        return "KW_CGI_OUTPUT_MAX_SIZE";
+    case KW_FASTCGI_CONNECTIONS:
+        return "KW_FASTCGI_CONNECTIONS";
     case SY_BRACE_OPEN:
         return "SY_BRACE_OPEN";
     case SY_BRACE_CLOSE:
@@ -22,7 +22,31 @@ enum TokenKind
     KW_ALLOW_METHODS,
     KW_MAX_BODY_SIZE,
     KW_CGI,
+    KW_FASTCGI,
     KW_ALLOW_UPLOAD,
+    KW_UPLOAD_STORE,
+    KW_UPLOAD_STATE,
+    KW_CGI_STREAM_BODY,
+    KW_PRECOMPRESSED,
+    KW_GZIP,
+    KW_GZIP_MIN_LENGTH,
+    KW_GZIP_TYPES,
+    KW_LISTEN_BACKLOG,
+    KW_ACCEPT_BUDGET,
+    KW_KEEPALIVE_TIMEOUT,
+    KW_KEEPALIVE_REQUESTS,
+    KW_WORKERS,
+    KW_WORKER_AFFINITY,
+    KW_WORKER_MODE,
+    KW_EDGE_TRIGGERED,
+    KW_EVENT_BACKEND,
+    KW_FILE_CACHE_SIZE,
+    KW_FILE_CACHE_VALIDITY,
+    KW_RESPONSE_CACHE_SIZE,
+    KW_GZIP_CACHE_SIZE,
+    KW_CGI_OUTPUT_BUFFER_SIZE,
+    KW_CGI_OUTPUT_MAX_SIZE,
+    KW_FASTCGI_CONNECTIONS,
     SY_BRACE_OPEN,
     SY_BRACE_CLOSE,
     SY_SEMICOLON,
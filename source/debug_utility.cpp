@@ -108,6 +108,19 @@ static void printAllowedMethods(const std::set<HttpMethod> &methods)
 /* Prints the given configuration to standard output */
 void Debug::printConfig(const ApplicationConfig &config)
 {
+    std::cout << "Workers: " << config.workerCount << std::endl;
+    printBoolField("Workers pinned to CPUs?: ", config.workerAffinity);
+    printBoolField("Workers are processes?: ", config.workerMode == WORKER_MODE_PROCESSES);
+    printBoolField("Edge-triggered events?: ", config.edgeTriggered);
+    printBoolField("Events from io_uring?: ", config.eventBackend == EVENT_BACKEND_IO_URING);
+    std::cout << "Open file cache entries: " << config.fileCacheSize << std::endl;
+    std::cout << "Open file cache validity (ms): " << config.fileCacheValidity << std::endl;
+    std::cout << "Response cache size (bytes): " << config.responseCacheSize << std::endl;
+    std::cout << "Gzip cache size (bytes): " << config.gzipCacheSize << std::endl;
+    std::cout << "CGI output buffer size (bytes): " << config.cgiOutputBufferSize << std::endl;
+    std::cout << "CGI output max size (bytes): " << config.cgiOutputMaxSize << std::endl;
+    std::cout << "FastCGI connections per application: " << config.fastCgiConnections << std::endl;
+
     for (size_t index = 0; index < config.servers.size(); index++)
     {
         const ServerConfig &serverConfig = config.servers[index];
@@ -116,6 +129,10 @@ void Debug::printConfig(const ApplicationConfig &config)
         printStringVector("+ Server names: ", serverConfig.name);
         printAddressField("  Bind address: ", serverConfig.host, serverConfig.port);
         std::cout << "  Maximum allowed body size: " << serverConfig.maxBodySize << std::endl;
+        std::cout << "  Listen backlog: " << serverConfig.listenBacklog << std::endl;
+        std::cout << "  Connections accepted per event: " << serverConfig.acceptBudget << std::endl;
+        std::cout << "  Keep-alive timeout (ms): " << serverConfig.keepAliveTimeout << std::endl;
+        std::cout << "  Requests per connection: " << serverConfig.keepAliveRequests << std::endl;
 
         // Print error pages
         std::map<int, std::string>::const_iterator errorPage = serverConfig.errorPages.begin();
@@ -136,7 +153,21 @@ void Debug::printConfig(const ApplicationConfig &config)
             printStringField("    Root directory: ", routeConfig.rootDirectory);
             printStringField("    Upload directory: ", routeConfig.uploadDirectory);
             printBoolField("    Uploads allowed?: ", routeConfig.allowUpload);
+            printStringField("    Upload store: ", routeConfig.uploadStore);
+            printStringField("    Upload state: ", routeConfig.uploadStateDirectory);
             printBoolField("    Listing allowed?: ", routeConfig.allowListing);
+            printBoolField("    Precompressed files?: ", routeConfig.servePrecompressed);
+            printBoolField("    Streamed CGI bodies?: ", routeConfig.streamCgiBody);
+            printBoolField("    Gzip compression?: ", routeConfig.compression.enabled);
+            if (routeConfig.compression.enabled)
+            {
+                std::cout << "    Gzip minimum length: " << routeConfig.compression.minLength << std::endl;
+                std::cout << "    Gzip types:";
+                std::set<std::string>::const_iterator type = routeConfig.compression.mimeTypes.begin();
+                for (; type != routeConfig.compression.mimeTypes.end(); type++)
+                    std::cout << " " << *type;
+                std::cout << std::endl;
+            }
 
             // Print CGI types
             std::map<std::string, std::string>::const_iterator cgiType = routeConfig.cgiTypes.begin();
@@ -145,6 +176,14 @@ void Debug::printConfig(const ApplicationConfig &config)
                 std::cout << "    Execute *." << cgiType->first
                           << " using " << cgiType->second << std::endl;
             }
+
+            // Print FastCGI types
+            std::map<std::string, FastCgiAddress>::const_iterator fastCgiType = routeConfig.fastCgiTypes.begin();
+            for (; fastCgiType != routeConfig.fastCgiTypes.end(); fastCgiType++)
+            {
+                std::cout << "    Pass *." << fastCgiType->first
+                          << " to FastCGI at " << fastCgiType->second.name << std::endl;
+            }
         }
 
         // Print redirect routes
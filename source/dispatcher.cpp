@@ -1,9 +1,14 @@
 #include "dispatcher.hpp"
 #include "signal_manager.hpp"
 
+#include <errno.h>
 #include <unistd.h>
+#include <iostream>
 #include <stdexcept>
 
+/* Marks the user data of multishot accepts on the io_uring backend, generations wrap below it */
+#define DISPATCHER_ACCEPT_USER_DATA_FLAG 0x80000000u
+
 #ifdef __42_LIKES_WASTING_CPU_CYCLES__
 /* Initializes the `needsToWrite` flag to false */
 Sink::Sink()
@@ -18,17 +23,51 @@ Sink::~Sink()
 {
 }
 
-/* Constructs an event dispatcher using the given buffer size */
-Dispatcher::Dispatcher(size_t bufferSize)
+#ifndef __42_LIKES_WASTING_CPU_CYCLES__
+/* Takes over a connection that the dispatcher accepted on the sink's listening socket;
+   sinks that don't listen close it */
+void Sink::handleAccepted(int fileno)
+{
+    close(fileno);
+}
+#endif // __42_LIKES_WASTING_CPU_CYCLES__
+
+/* Constructs an event dispatcher using the given buffer size and backend, falling back to
+   epoll if io_uring is unavailable; in edge-triggered mode, events are only reported on
+   readiness changes, so sinks must drain their file descriptors */
+Dispatcher::Dispatcher(size_t bufferSize, bool edgeTriggered, EventBackend backend)
     : _bufferSize(bufferSize)
+    , _epollFileno(-1)
+    , _edgeTriggered(edgeTriggered)
+    , _uring(NULL)
 {
     _buffer.resize(_bufferSize);
 
 #ifdef __42_LIKES_WASTING_CPU_CYCLES__
+    if (edgeTriggered)
+        throw std::runtime_error("Edge-triggered events are not supported in this build");
+    if (backend != EVENT_BACKEND_EPOLL)
+        throw std::runtime_error("The io_uring event backend is not supported in this build");
     if ((_epollFileno = epoll_create(128)) < 0)
         throw std::runtime_error("Unable to create epoll file descriptor");
 #else
-    if ((_epollFileno = epoll_create1(EPOLL_CLOEXEC)) < 0)
+    if (backend == EVENT_BACKEND_IO_URING)
+    {
+        try
+        {
+            _uring = new UringPoller(static_cast<unsigned int>(bufferSize));
+        }
+        catch (const std::exception &exception)
+        {
+            std::cerr << "warning: " << exception.what() << "; falling back to epoll" << std::endl;
+        }
+    }
+
+    // One-shot polls are requested again after every completion, so readiness is reported like
+    // level-triggered events which the draining sinks handle just as well
+    if (_uring != NULL)
+        _edgeTriggered = false;
+    else if ((_epollFileno = epoll_create1(EPOLL_CLOEXEC)) < 0)
         throw std::runtime_error("Unable to create epoll file descriptor");
 #endif // __42_LIKES_WASTING_CPU_CYCLES__
 }
@@ -36,54 +75,62 @@ Dispatcher::Dispatcher(size_t bufferSize)
 /* Releases the dispatcher's resources */
 Dispatcher::~Dispatcher()
 {
-    close(_epollFileno);
+#ifndef __42_LIKES_WASTING_CPU_CYCLES__
+    for (size_t index = 0; index < _acceptedConnections.size(); index++)
+        close(_acceptedConnections[index].fileno);
+    delete _uring;
+#endif // __42_LIKES_WASTING_CPU_CYCLES__
+    if (_epollFileno >= 0)
+        close(_epollFileno);
 }
 
 /* Subscribes the an event sink to receive the given events on a file descriptor */
 void Dispatcher::subscribe(int fileno, uint32_t eventMask, Sink *sink)
 {
-    epoll_event event;
-
-    event.data.ptr = sink;
-    event.events   = eventMask;
-
-#ifdef __42_LIKES_WASTING_CPU_CYCLES__
-    event.events |= EPOLLIN | EPOLLOUT;
-#endif // __42_LIKES_WASTING_CPU_CYCLES__
-
-    if (epoll_ctl(_epollFileno, EPOLL_CTL_ADD, fileno, &event) != 0)
+    if (!control(EPOLL_CTL_ADD, fileno, eventMask, sink))
         throw std::runtime_error("Unable to add file descriptor to poll");
+}
 
-#ifdef __42_LIKES_WASTING_CPU_CYCLES__
-    sink->needsToRead = (eventMask & EPOLLIN) == EPOLLIN;
-    sink->needsToWrite = (eventMask & EPOLLOUT) == EPOLLOUT;
+/* Subscribes an event sink to a listening socket; the io_uring backend accepts its connections
+   itself and hands them to `Sink::handleAccepted()`, otherwise the sink receives the given
+   events and accepts them */
+void Dispatcher::subscribeListener(int fileno, uint32_t eventMask, Sink *sink)
+{
+#ifndef __42_LIKES_WASTING_CPU_CYCLES__
+    // A multishot accept replaces the poll and the accept system call of every connection
+    if (_uring != NULL)
+    {
+        getInterest(fileno).isAccepting = true;
+        controlUring(EPOLL_CTL_ADD, fileno, eventMask, sink);
+        return;
+    }
 #endif // __42_LIKES_WASTING_CPU_CYCLES__
+    subscribe(fileno, eventMask, sink);
 }
 
 /* Changes the given file descriptor's received events and event sink */
 void Dispatcher::modify(int fileno, uint32_t eventMask, Sink *sink)
 {
-    epoll_event event;
-
-    event.data.ptr = sink;
-    event.events   = eventMask;
-
-#ifdef __42_LIKES_WASTING_CPU_CYCLES__
-    event.events |= EPOLLIN | EPOLLOUT;
-#endif // __42_LIKES_WASTING_CPU_CYCLES__
+    // Skip the system call when nothing changed
+    const Interest &interest = getInterest(fileno);
+    if (interest.isSubscribed && interest.eventMask == eventMask && interest.sink == sink)
+        return;
 
-    if (epoll_ctl(_epollFileno, EPOLL_CTL_MOD, fileno, &event) != 0)
+    if (!control(EPOLL_CTL_MOD, fileno, eventMask, sink))
         throw std::runtime_error("Unable to modify file descriptor on poll");
-
-#ifdef __42_LIKES_WASTING_CPU_CYCLES__
-    sink->needsToRead = (eventMask & EPOLLIN) == EPOLLIN;
-    sink->needsToWrite = (eventMask & EPOLLOUT) == EPOLLOUT;
-#endif // __42_LIKES_WASTING_CPU_CYCLES__
 }
 
 /* Unsubscribes the given file descriptor's event sink from receiving events */
 void Dispatcher::unsubscribe(int fileno)
 {
+#ifndef __42_LIKES_WASTING_CPU_CYCLES__
+    if (_uring != NULL)
+    {
+        controlUring(EPOLL_CTL_DEL, fileno, 0, NULL);
+        return;
+    }
+#endif // __42_LIKES_WASTING_CPU_CYCLES__
+
     epoll_event event;
 
     event.data.ptr = NULL;
@@ -91,21 +138,63 @@ void Dispatcher::unsubscribe(int fileno)
 
     if (epoll_ctl(_epollFileno, EPOLL_CTL_DEL, fileno, &event) != 0)
         throw std::runtime_error("Unable to remove file descriptor from poll");
+
+    getInterest(fileno).isSubscribed = false;
 }
 
-/* Waits (in the given timeout) for events to occur and dispatches them */
-void Dispatcher::dispatch(int timeout)
+/* Has the current readiness of the given file descriptor reported again; for sinks that stop
+   draining a file descriptor before it would block in edge-triggered mode */
+void Dispatcher::rearm(int fileno)
 {
+    Interest interest = getInterest(fileno);
+    if (!interest.isSubscribed)
+        throw std::logic_error("Invalid usage; .rearm() called for an unsubscribed file descriptor");
+
+    // Polls on the io_uring backend are requested again after every completion anyway
+    if (_uring != NULL)
+        return;
+
+    // Exclusive wake-ups can't be modified, so add the file descriptor again instead
+    if (interest.eventMask & EPOLLEXCLUSIVE)
+    {
+        unsubscribe(fileno);
+        subscribe(fileno, interest.eventMask, interest.sink);
+    }
+    else if (!control(EPOLL_CTL_MOD, fileno, interest.eventMask, interest.sink))
+        throw std::runtime_error("Unable to modify file descriptor on poll");
+}
+
+/* Waits (in the given timeout) for events to occur and buffers them */
+void Dispatcher::waitForEvents(int timeout)
+{
+#ifndef __42_LIKES_WASTING_CPU_CYCLES__
+    if (_uring != NULL)
+    {
+        waitForUringEvents(timeout);
+        return;
+    }
+#endif // __42_LIKES_WASTING_CPU_CYCLES__
+
     _buffer.resize(_bufferSize);
 
     int count = epoll_wait(_epollFileno, _buffer.data(), _bufferSize, timeout);
     if (SignalManager::shouldQuit())
+    {
+        _buffer.clear();
         return;
+    }
     if (count < 0)
+    {
+        _buffer.clear();
         throw std::runtime_error("Unable to wait for events to occur");
+    }
 
     _buffer.resize(static_cast<size_t>(static_cast<unsigned int>(count)));
+}
 
+/* Dispatches the events buffered by the last wait to their sinks */
+void Dispatcher::dispatchEvents()
+{
     for (EventBuffer::iterator event = _buffer.begin(); event != _buffer.end(); event++)
     {
         Sink *sink = static_cast<Sink *>(event->data.ptr);
@@ -130,4 +219,211 @@ void Dispatcher::dispatch(int timeout)
             sink->handleException("Thrown type is not derived from std::exception");
         }
     }
+
+#ifndef __42_LIKES_WASTING_CPU_CYCLES__
+    // Connections accepted by the io_uring backend belong to their sinks from here on
+    std::vector<AcceptedConnection> connections;
+    connections.swap(_acceptedConnections);
+    for (size_t index = 0; index < connections.size(); index++)
+    {
+        Sink *sink = connections[index].sink;
+        try
+        {
+            sink->handleAccepted(connections[index].fileno);
+        } catch (const std::exception &exception)
+        {
+            sink->handleException(exception.what());
+        } catch (...)
+        {
+            sink->handleException("Thrown type is not derived from std::exception");
+        }
+    }
+#endif // __42_LIKES_WASTING_CPU_CYCLES__
+}
+
+/* Gets the cached interest of the given file descriptor */
+Dispatcher::Interest &Dispatcher::getInterest(int fileno)
+{
+    if (fileno < 0)
+        throw std::logic_error("Invalid usage; negative file descriptor");
+
+    size_t index = static_cast<size_t>(fileno);
+    if (index >= _interests.size())
+    {
+        Interest interest;
+        interest.eventMask    = 0;
+        interest.sink         = NULL;
+        interest.isSubscribed = false;
+        interest.isArmed      = false;
+        interest.isAccepting  = false;
+        interest.generation   = 0;
+        _interests.resize(index + 1, interest);
+    }
+    return _interests[index];
+}
+
+/* Issues an `epoll_ctl()` operation and caches the resulting interest, returns whether the
+   operation succeeded */
+bool Dispatcher::control(int operation, int fileno, uint32_t eventMask, Sink *sink)
+{
+#ifndef __42_LIKES_WASTING_CPU_CYCLES__
+    if (_uring != NULL)
+    {
+        controlUring(operation, fileno, eventMask, sink);
+        return true;
+    }
+#endif // __42_LIKES_WASTING_CPU_CYCLES__
+
+    epoll_event event;
+
+    event.data.ptr = sink;
+    event.events   = eventMask;
+
+#ifdef __42_LIKES_WASTING_CPU_CYCLES__
+    event.events |= EPOLLIN | EPOLLOUT;
+#else
+    if (_edgeTriggered)
+        event.events |= EPOLLET;
+#endif // __42_LIKES_WASTING_CPU_CYCLES__
+
+    if (epoll_ctl(_epollFileno, operation, fileno, &event) != 0)
+        return false;
+
+#ifdef __42_LIKES_WASTING_CPU_CYCLES__
+    sink->needsToRead = (eventMask & EPOLLIN) == EPOLLIN;
+    sink->needsToWrite = (eventMask & EPOLLOUT) == EPOLLOUT;
+#endif // __42_LIKES_WASTING_CPU_CYCLES__
+
+    Interest &interest = getInterest(fileno);
+    interest.eventMask    = eventMask;
+    interest.sink         = sink;
+    interest.isSubscribed = true;
+    return true;
 }
+
+#ifndef __42_LIKES_WASTING_CPU_CYCLES__
+/* Queues the poll requests equivalent to an `epoll_ctl()` operation on the io_uring backend */
+void Dispatcher::controlUring(int operation, int fileno, uint32_t eventMask, Sink *sink)
+{
+    Interest &interest = getInterest(fileno);
+
+    // Cancel the pending request, its completion is recognized as stale by the outdated generation
+    if (interest.isArmed)
+        _uring->queueCancellation(getUringUserData(fileno, interest));
+    interest.generation = (interest.generation + 1) & ~DISPATCHER_ACCEPT_USER_DATA_FLAG;
+    interest.isArmed = false;
+
+    if (operation == EPOLL_CTL_DEL)
+    {
+        interest.isSubscribed = false;
+        interest.isAccepting  = false;
+        return;
+    }
+
+    interest.eventMask    = eventMask;
+    interest.sink         = sink;
+    interest.isSubscribed = true;
+    armUring(fileno, interest);
+}
+
+/* Gets the user data of the request that the given interest has queued on the io_uring backend */
+uint64_t Dispatcher::getUringUserData(int fileno, const Interest &interest)
+{
+    uint64_t userData = (static_cast<uint64_t>(fileno) << 32) | interest.generation;
+    if (interest.isAccepting)
+        userData |= DISPATCHER_ACCEPT_USER_DATA_FLAG;
+    return userData;
+}
+
+/* Queues the poll or multishot accept of the given interest on the io_uring backend */
+void Dispatcher::armUring(int fileno, Interest &interest)
+{
+    if (interest.isAccepting)
+        _uring->queueMultishotAccept(fileno, getUringUserData(fileno, interest));
+    else
+        _uring->queuePoll(fileno, interest.eventMask, getUringUserData(fileno, interest));
+    interest.isArmed = true;
+}
+
+/* Waits (in the given timeout) for poll completions on the io_uring backend and buffers them */
+void Dispatcher::waitForUringEvents(int timeout)
+{
+    // Request the polls and accepts that completed during the last wait again unless their file
+    // descriptors were unsubscribed or modified since
+    for (size_t index = 0; index < _completedPolls.size(); index++)
+    {
+        int fileno = _completedPolls[index];
+        Interest &interest = getInterest(fileno);
+        if (interest.isSubscribed && !interest.isArmed)
+            armUring(fileno, interest);
+    }
+    _completedPolls.clear();
+
+    _buffer.clear();
+    bool wasInterrupted = !_uring->submitAndWait(timeout);
+    if (SignalManager::shouldQuit())
+        return;
+    if (wasInterrupted)
+        throw std::runtime_error("Unable to wait for events to occur");
+
+    uint64_t userData;
+    int32_t  result;
+    bool     hasMore;
+    while (_uring->popCompletion(userData, result, hasMore))
+    {
+        if (userData == URING_POLLER_IGNORED_USER_DATA)
+            continue;
+
+        // Skip completions of requests that were cancelled or replaced, closing the connections
+        // their accepts still delivered
+        int fileno = static_cast<int>(userData >> 32);
+        bool isAccept = (userData & DISPATCHER_ACCEPT_USER_DATA_FLAG) != 0;
+        Interest &interest = getInterest(fileno);
+        uint32_t generation = static_cast<uint32_t>(userData) & ~DISPATCHER_ACCEPT_USER_DATA_FLAG;
+        if (!interest.isArmed || interest.generation != generation || interest.isAccepting != isAccept)
+        {
+            if (isAccept && result >= 0)
+                close(result);
+            continue;
+        }
+
+        if (isAccept)
+        {
+            if (result >= 0)
+            {
+                AcceptedConnection connection;
+                connection.sink   = interest.sink;
+                connection.fileno = result;
+                try
+                {
+                    _acceptedConnections.push_back(connection);
+                }
+                catch (...)
+                {
+                    close(result);
+                    throw;
+                }
+            }
+
+            // Kernels without multishot accepts reject them, the sink accepts on readiness instead
+            else if (result == -EINVAL)
+                interest.isAccepting = false;
+
+            // A failed accept is requested again before the next wait
+            if (!hasMore)
+            {
+                interest.isArmed = false;
+                _completedPolls.push_back(fileno);
+            }
+            continue;
+        }
+        interest.isArmed = false;
+        _completedPolls.push_back(fileno);
+
+        epoll_event event;
+        event.data.ptr = interest.sink;
+        event.events   = result < 0 ? (EPOLLERR | EPOLLHUP) : static_cast<uint32_t>(result);
+        _buffer.push_back(event);
+    }
+}
+#endif // __42_LIKES_WASTING_CPU_CYCLES__
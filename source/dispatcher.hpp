@@ -1,11 +1,18 @@
 #ifndef EVENT_DISPATCHER_hpp
 #define EVENT_DISPATCHER_hpp
 
+#include "config.hpp"
+#include "uring_poller.hpp"
+
 #include <vector>
 #include <stdint.h>
 #include <stdexcept>
 #include <sys/epoll.h>
 
+/* The most reads or writes a sink performs on a file descriptor for a single edge-triggered
+   event, so that a fast peer doesn't starve the others */
+#define DISPATCHER_DRAIN_BUDGET 16
+
 /* Alias for a vector of epoll events */
 typedef std::vector<epoll_event> EventBuffer;
 
@@ -25,6 +32,12 @@ struct Sink
     /* Handles an exception that occurred in `handleEvent()` */
     virtual void handleException(const char *message) = 0;
 
+#ifndef __42_LIKES_WASTING_CPU_CYCLES__
+    /* Takes over a connection that the dispatcher accepted on the sink's listening socket;
+       sinks that don't listen close it */
+    virtual void handleAccepted(int fileno);
+#endif // __42_LIKES_WASTING_CPU_CYCLES__
+
     /* Destructor for deriving classes */
     virtual ~Sink();
 };
@@ -32,8 +45,10 @@ struct Sink
 class Dispatcher
 {
 public:
-    /* Constructs an event dispatcher using the given buffer size */
-    Dispatcher(size_t bufferSize);
+    /* Constructs an event dispatcher using the given buffer size and backend, falling back to
+       epoll if io_uring is unavailable; in edge-triggered mode, events are only reported on
+       readiness changes, so sinks must drain their file descriptors */
+    Dispatcher(size_t bufferSize, bool edgeTriggered = false, EventBackend backend = EVENT_BACKEND_EPOLL);
 
     /* Releases the dispatcher's resources */
     ~Dispatcher();
@@ -41,18 +56,86 @@ public:
     /* Subscribes the an event sink to receive the given events on a file descriptor */
     void subscribe(int fileno, uint32_t eventMask, Sink *sink);
 
+    /* Subscribes an event sink to a listening socket; the io_uring backend accepts its connections
+       itself and hands them to `Sink::handleAccepted()`, otherwise the sink receives the given
+       events and accepts them */
+    void subscribeListener(int fileno, uint32_t eventMask, Sink *sink);
+
     /* Changes the given file descriptor's received events and event sink */
     void modify(int fileno, uint32_t eventMask, Sink *sink);
 
     /* Unsubscribes the given file descriptor's event sink from receiving events */
     void unsubscribe(int fileno);
 
-    /* Waits (in the given timeout) for events to occur and dispatches them */
-    void dispatch(int timeout = -1);
+    /* Has the current readiness of the given file descriptor reported again; for sinks that stop
+       draining a file descriptor before it would block in edge-triggered mode */
+    void rearm(int fileno);
+
+    /* Gets whether events are edge-triggered or not */
+    inline bool isEdgeTriggered() const
+    {
+        return _edgeTriggered;
+    }
+
+    /* Gets the number of reads or writes a sink performs for a single event; a sink that used
+       all of them re-arms its file descriptor in edge-triggered mode, level-triggered readiness
+       is reported again anyway */
+    inline size_t getDrainBudget() const
+    {
+        return _edgeTriggered ? DISPATCHER_DRAIN_BUDGET : 1;
+    }
+
+    /* Waits (in the given timeout) for events to occur and buffers them */
+    void waitForEvents(int timeout = -1);
+
+    /* Dispatches the events buffered by the last wait to their sinks */
+    void dispatchEvents();
 private:
-    EventBuffer _buffer;
-    size_t      _bufferSize;
-    int         _epollFileno;
+    /* The registered interest of a file descriptor */
+    struct Interest
+    {
+        uint32_t eventMask;
+        Sink    *sink;
+        bool     isSubscribed;
+        bool     isArmed;
+        bool     isAccepting;
+        uint32_t generation;
+    };
+
+    /* A connection accepted by the io_uring backend that waits to be dispatched */
+    struct AcceptedConnection
+    {
+        Sink *sink;
+        int   fileno;
+    };
+
+    EventBuffer                     _buffer;
+    size_t                          _bufferSize;
+    int                             _epollFileno;
+    bool                            _edgeTriggered;
+    std::vector<Interest>           _interests;
+    UringPoller                    *_uring;
+    std::vector<int>                _completedPolls;
+    std::vector<AcceptedConnection> _acceptedConnections;
+
+    /* Gets the cached interest of the given file descriptor */
+    Interest &getInterest(int fileno);
+
+    /* Issues an `epoll_ctl()` operation and caches the resulting interest, returns whether the
+       operation succeeded */
+    bool control(int operation, int fileno, uint32_t eventMask, Sink *sink);
+
+    /* Queues the poll requests equivalent to an `epoll_ctl()` operation on the io_uring backend */
+    void controlUring(int operation, int fileno, uint32_t eventMask, Sink *sink);
+
+    /* Gets the user data of the request that the given interest has queued on the io_uring backend */
+    static uint64_t getUringUserData(int fileno, const Interest &interest);
+
+    /* Queues the poll or multishot accept of the given interest on the io_uring backend */
+    void armUring(int fileno, Interest &interest);
+
+    /* Waits (in the given timeout) for poll completions on the io_uring backend and buffers them */
+    void waitForUringEvents(int timeout);
 
     /* Disable copy-construction and copy-assignment */
     Dispatcher(const Dispatcher &other);
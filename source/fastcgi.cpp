@@ -0,0 +1,872 @@
+#include "fastcgi.hpp"
+#include "cgi_process.hpp"
+#include "http_client.hpp"
+#include "application.hpp"
+#include "signal_manager.hpp"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <limits.h>
+#include <unistd.h>
+#include <cstring>
+#include <algorithm>
+#include <sys/un.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+/* The role of the server in every request; the application produces the response */
+#define FASTCGI_ROLE_RESPONDER 1
+
+/* Keeps the connection open once a request ended */
+#define FASTCGI_FLAG_KEEP_CONN 1
+
+/* Appends the length of a name or value, which takes four bytes from 128 bytes on */
+static void appendLength(std::string &output, size_t length)
+{
+    if (length < 128)
+    {
+        output.push_back(static_cast<char>(length));
+        return;
+    }
+    output.push_back(static_cast<char>(((length >> 24) & 0x7F) | 0x80));
+    output.push_back(static_cast<char>((length >> 16) & 0xFF));
+    output.push_back(static_cast<char>((length >> 8) & 0xFF));
+    output.push_back(static_cast<char>(length & 0xFF));
+}
+
+/* Appends a name-value pair */
+static void appendPair(std::string &output, Slice name, Slice value)
+{
+    appendLength(output, name.getLength());
+    appendLength(output, value.getLength());
+    output.append(name.isEmpty() ? "" : &name[0], name.getLength());
+    output.append(value.isEmpty() ? "" : &value[0], value.getLength());
+}
+
+/* Reads the length of a name or value at `offset`, returns false if the content ends first */
+static bool readLength(Slice content, size_t &offset, size_t &length)
+{
+    if (offset >= content.getLength())
+        return false;
+    const unsigned char *bytes = reinterpret_cast<const unsigned char *>(&content[0]);
+    if (bytes[offset] < 128)
+    {
+        length = bytes[offset++];
+        return true;
+    }
+    if (content.getLength() - offset < 4)
+        return false;
+    length = (static_cast<size_t>(bytes[offset] & 0x7F) << 24) | (static_cast<size_t>(bytes[offset + 1]) << 16)
+        | (static_cast<size_t>(bytes[offset + 2]) << 8) | static_cast<size_t>(bytes[offset + 3]);
+    offset += 4;
+    return true;
+}
+
+/* Constructs a request for the given client, request and route result; the body is read
+   from `spool` if given, otherwise from the request */
+FastCgiRequest::FastCgiRequest(HttpClient *client, const HttpRequest &request, const RoutingInfo &routingInfo,
+    const BodySpool *spool, FastCgiPool &pool)
+    : CgiBackend(client)
+    , _request(request)
+    , _bodyFileno(-1)
+    , _bodyLength(spool != NULL ? spool->getLength() : request.body.size())
+    , _bodyOffset(0)
+    , _params(encodeParams(request, routingInfo, spool))
+    , _pool(pool)
+    , _connection(NULL)
+    , _timeout(client->_application._timers, this)
+    , _isOutputPaused(false)
+{
+    // The client releases its spool once the request was started, so hold another reference
+    if (spool != NULL)
+    {
+        _bodyFileno = fcntl(spool->getFileno(), F_DUPFD_CLOEXEC, 0);
+        if (_bodyFileno < 0)
+            throw std::runtime_error("Unable to open spooled body");
+    }
+    _timeout.start(TIMEOUT_CGI_MS);
+}
+
+/* Withdraws the request from its connection or pool and closes its body */
+FastCgiRequest::~FastCgiRequest()
+{
+    unsubscribe();
+    if (_bodyFileno >= 0)
+        close(_bodyFileno);
+}
+
+/* Reads the output of a request that was paused for the client again */
+void FastCgiRequest::resumeOutput()
+{
+    if (!_isOutputPaused)
+        return;
+    _isOutputPaused = false;
+    _timeout.start(TIMEOUT_CGI_MS);
+    if (_connection != NULL)
+        _connection->resumeInput();
+}
+
+/* Withdraws the request from its connection, which aborts it while it runs, or its pool */
+void FastCgiRequest::unsubscribe()
+{
+    _timeout.stop();
+    if (_connection != NULL)
+        _connection->detach(this);
+    else
+        _pool.withdraw(this);
+}
+
+/* Transitions the request into timeout state */
+void FastCgiRequest::handleTimeout()
+{
+    if (_state != CGI_PROCESS_RUNNING)
+        return;
+    _state = CGI_PROCESS_TIMEOUT;
+
+    // The client destroys this request while handling the state, so keep a reference to it
+    HttpClient *client = _client;
+    try
+    {
+        client->handleCgiState();
+    }
+    // In case of catastrophic failure, drop the client
+    catch (const std::exception &exception)
+    {
+        client->handleException(exception.what());
+    }
+    catch (...)
+    {
+        client->handleException("Thrown type is not derived from std::exception");
+    }
+}
+
+/* Reads up to `length` bytes of the body that weren't sent yet, returns 0 at its end */
+size_t FastCgiRequest::readBody(char *buffer, size_t length)
+{
+    length = std::min(length, _bodyLength - _bodyOffset);
+    if (length == 0)
+        return 0;
+
+    // A short body is buffered in the request, a long one is read from its spool
+    if (_bodyFileno < 0)
+        std::memcpy(buffer, &_request.body[_bodyOffset], length);
+    else
+    {
+        ssize_t result = pread(_bodyFileno, buffer, length, static_cast<off_t>(_bodyOffset));
+        if (result <= 0)
+            throw std::runtime_error("Unable to read spooled body");
+        length = static_cast<size_t>(result);
+    }
+    _bodyOffset += length;
+    return length;
+}
+
+/* Encodes the CGI environment of the request as name-value pairs */
+std::string FastCgiRequest::encodeParams(const HttpRequest &request, const RoutingInfo &routingInfo,
+    const BodySpool *spool)
+{
+    std::vector<std::string> environment = CgiProcess::setupEnvironment(request, routingInfo,
+        CgiProcess::getContentLength(request, spool, false));
+
+    // The application doesn't share the working directory of a CGI process, so it's given
+    // the script's absolute path
+    char resolvedPath[PATH_MAX];
+    std::string scriptPath = routingInfo.nodePath;
+    if (realpath(scriptPath.c_str(), resolvedPath) != NULL)
+        scriptPath = resolvedPath;
+
+    std::string params;
+    for (size_t index = 0; index < environment.size(); index++)
+    {
+        Slice value(environment[index]);
+        Slice name;
+        if (!value.splitStart('=', name))
+            continue;
+        if (name == C_SLICE("SCRIPT_FILENAME"))
+            value = Slice(scriptPath);
+        appendPair(params, name, value);
+    }
+    return params;
+}
+
+/* Constructs a disconnected connection to the pool's application */
+FastCgiConnection::FastCgiConnection(Application &application, FastCgiPool &pool, const FastCgiAddress &address)
+    : _application(application)
+    , _pool(pool)
+    , _address(address)
+    , _fileno(-1)
+    , _state(FASTCGI_CONNECTION_DISCONNECTED)
+    , _isMultiplexed(false)
+    , _isInputPaused(false)
+    , _hasDeferredWork(false)
+    , _eventMask(0)
+    , _outputOffset(0)
+    , _inputOffset(0)
+    , _timeout(application._timers, this)
+{
+}
+
+/* Closes the connection */
+FastCgiConnection::~FastCgiConnection()
+{
+    if (_fileno < 0)
+        return;
+    if (_eventMask != 0)
+        _application._dispatcher.unsubscribe(_fileno);
+    close(_fileno);
+}
+
+/* Gets whether the connection can carry another request right away */
+bool FastCgiConnection::canAccept() const
+{
+    // Requests of a connection that failed to open are yet to be failed
+    if (_requests.empty())
+        return _state != FASTCGI_CONNECTION_DISCONNECTED || !_hasDeferredWork;
+
+    // Whether requests are multiplexed is only known once the application answered; a
+    // connection paused for a slow client holds up every request it carries
+    return _state == FASTCGI_CONNECTION_CONNECTED && _isMultiplexed && !_isInputPaused
+        && _requests.size() < FASTCGI_MAX_REQUESTS_PER_CONNECTION;
+}
+
+/* Starts the given request on the connection, connecting first if necessary */
+void FastCgiConnection::attach(FastCgiRequest *request)
+{
+    if (_state == FASTCGI_CONNECTION_DISCONNECTED)
+        connect();
+
+    // Take the lowest free ID, aborted requests keep theirs until they ended
+    uint16_t id = 1;
+    while (_requests.count(id) != 0)
+        id++;
+    _requests[id] = request;
+    request->_connection = this;
+
+    // The body follows the parameters as the output buffer drains
+    const char begin[8] = { 0, FASTCGI_ROLE_RESPONDER, FASTCGI_FLAG_KEEP_CONN, 0, 0, 0, 0, 0 };
+    queueRecord(FASTCGI_BEGIN_REQUEST, id, Slice(begin, sizeof(begin)));
+    queueStream(FASTCGI_PARAMS, id, Slice(request->_params), true);
+    std::string().swap(request->_params);
+    _pendingBodies.push_back(id);
+    updateEvents();
+}
+
+/* Withdraws the given request from the connection, a running request is aborted */
+void FastCgiConnection::detach(FastCgiRequest *request)
+{
+    request->_connection = NULL;
+    std::map<uint16_t, FastCgiRequest *>::iterator slot = _requests.begin();
+    while (slot != _requests.end() && slot->second != request)
+        slot++;
+    if (slot == _requests.end())
+        return;
+    uint16_t id = slot->first;
+    _pendingBodies.erase(std::remove(_pendingBodies.begin(), _pendingBodies.end(), id), _pendingBodies.end());
+
+    // Only the request that paused reading can hold it up
+    if (request->_isOutputPaused)
+    {
+        request->_isOutputPaused = false;
+        resumeInput();
+    }
+
+    // Nothing was sent over a connection that failed to open
+    if (_state == FASTCGI_CONNECTION_DISCONNECTED)
+    {
+        _requests.erase(slot);
+        return;
+    }
+
+    // The application is told to stop, the ID is reused once it confirmed that the request
+    // ended; an application that doesn't in time is disconnected
+    slot->second = NULL;
+    queueRecord(FASTCGI_ABORT_REQUEST, id, Slice());
+    if (_timeout.isStopped())
+        _timeout.start(TIMEOUT_CGI_MS);
+    updateEvents();
+}
+
+/* Reads the connection again after a request's client caught up on its piped body */
+void FastCgiConnection::resumeInput()
+{
+    if (!_isInputPaused)
+        return;
+    _isInputPaused = false;
+    updateEvents();
+
+    // Records that were received already are handled outside of the client's event
+    if (_inputOffset < _input.size())
+        deferWork();
+}
+
+/* Handles one or multiple events */
+void FastCgiConnection::handleEvents(uint32_t eventMask)
+{
+    if (_state == FASTCGI_CONNECTION_CONNECTING)
+    {
+        // The outcome of connecting is reported as the socket becoming writable; events may
+        // still be reported for a socket that was closed before
+        int error = 0;
+        socklen_t length = sizeof(error);
+        if (getsockopt(_fileno, SOL_SOCKET, SO_ERROR, &error, &length) != 0 || error != 0)
+        {
+            disconnect();
+            _pool.assignWaiting(this);
+            return;
+        }
+        sockaddr_storage peer;
+        socklen_t peerLength = sizeof(peer);
+        if (getpeername(_fileno, reinterpret_cast<sockaddr *>(&peer), &peerLength) != 0)
+            return;
+        _state = FASTCGI_CONNECTION_CONNECTED;
+    }
+    else if (_state != FASTCGI_CONNECTION_CONNECTED)
+        return;
+
+    if (transfer(eventMask))
+        updateEvents();
+    _pool.assignWaiting(this);
+}
+
+/* Handles an exception that occurred in `handleEvent()` */
+void FastCgiConnection::handleException(const char *message)
+{
+    (void)message;
+
+    // The requests fail with the connection, waiting requests get another try
+    disconnect();
+    try
+    {
+        _pool.assignWaiting(this);
+    }
+    catch (...)
+    {
+    }
+}
+
+/* Handles the deferred work of the connection or the expiry of aborted requests */
+void FastCgiConnection::handleTimeout()
+{
+    try
+    {
+        if (!_hasDeferredWork)
+        {
+            // The application didn't end the aborted requests in time
+            if (hasAbortedRequests())
+                disconnect();
+        }
+        else
+        {
+            _hasDeferredWork = false;
+
+            // A connection that failed to open fails its requests, otherwise the records that
+            // were received while reading was paused are handled
+            if (_state == FASTCGI_CONNECTION_DISCONNECTED)
+                disconnect();
+            else if (_state == FASTCGI_CONNECTION_CONNECTED)
+            {
+                handleRecords();
+                updateEvents();
+            }
+            if (hasAbortedRequests() && _timeout.isStopped())
+                _timeout.start(TIMEOUT_CGI_MS);
+        }
+        _pool.assignWaiting(this);
+    }
+    catch (const std::exception &exception)
+    {
+        handleException(exception.what());
+    }
+    catch (...)
+    {
+        handleException("Thrown type is not derived from std::exception");
+    }
+}
+
+/* Opens a non-blocking connection to the application */
+void FastCgiConnection::connect()
+{
+    _isMultiplexed = false;
+    _isInputPaused = false;
+    _output.clear();
+    _outputOffset = 0;
+    _input.clear();
+    _inputOffset = 0;
+
+    // Ask whether requests may share the connection before the first one is sent
+    std::string values;
+    appendPair(values, C_SLICE("FCGI_MPXS_CONNS"), Slice());
+    queueRecord(FASTCGI_GET_VALUES, 0, Slice(values));
+
+    // Failures are reported from the connection's own context rather than the client's
+    int domain = _address.socketPath.empty() ? AF_INET : AF_UNIX;
+    _fileno = socket(domain, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (_fileno < 0)
+    {
+        deferWork();
+        return;
+    }
+    int result;
+    if (domain == AF_UNIX)
+    {
+        sockaddr_un address = {};
+        address.sun_family = AF_UNIX;
+        std::strncpy(address.sun_path, _address.socketPath.c_str(), sizeof(address.sun_path) - 1);
+        result = ::connect(_fileno, reinterpret_cast<const sockaddr *>(&address), sizeof(address));
+    }
+    else
+    {
+        sockaddr_in address = {};
+        address.sin_family      = AF_INET;
+        address.sin_addr.s_addr = htonl(_address.host);
+        address.sin_port        = htons(_address.port);
+        result = ::connect(_fileno, reinterpret_cast<const sockaddr *>(&address), sizeof(address));
+    }
+    if (result != 0 && errno != EINPROGRESS)
+    {
+        close(_fileno);
+        _fileno = -1;
+        deferWork();
+        return;
+    }
+    _state = FASTCGI_CONNECTION_CONNECTING;
+}
+
+/* Closes the connection and fails the requests it carried */
+void FastCgiConnection::disconnect()
+{
+    if (_fileno >= 0)
+    {
+        if (_eventMask != 0)
+            _application._dispatcher.unsubscribe(_fileno);
+        close(_fileno);
+    }
+    _fileno = -1;
+    _eventMask = 0;
+    _state = FASTCGI_CONNECTION_DISCONNECTED;
+    _isInputPaused = false;
+    _pendingBodies.clear();
+    _output.clear();
+    _outputOffset = 0;
+    _input.clear();
+    _inputOffset = 0;
+    if (!_hasDeferredWork)
+        _timeout.stop();
+
+    // Clients may destroy their requests while the failure is reported, so the connection
+    // lets go of all of them first
+    std::map<uint16_t, FastCgiRequest *> requests;
+    requests.swap(_requests);
+    std::map<uint16_t, FastCgiRequest *>::iterator slot;
+    for (slot = requests.begin(); slot != requests.end(); slot++)
+    {
+        if (slot->second != NULL)
+        {
+            slot->second->_connection = NULL;
+            slot->second->_isOutputPaused = false;
+        }
+    }
+    for (slot = requests.begin(); slot != requests.end(); slot++)
+    {
+        if (slot->second != NULL && slot->second->_state == CGI_PROCESS_RUNNING)
+            reportState(slot->second, CGI_PROCESS_FAILURE);
+    }
+}
+
+/* Subscribes the events the connection currently waits for */
+void FastCgiConnection::updateEvents()
+{
+    if (_fileno < 0)
+        return;
+
+    // A paused connection waits for nothing, otherwise a hang-up would be reported over and over
+    if (_isInputPaused)
+    {
+        if (_eventMask != 0)
+            _application._dispatcher.unsubscribe(_fileno);
+        _eventMask = 0;
+        return;
+    }
+
+    uint32_t eventMask = EPOLLHUP;
+    if (_state == FASTCGI_CONNECTION_CONNECTING || _outputOffset < _output.size() || !_pendingBodies.empty())
+        eventMask |= EPOLLOUT;
+    if (_state == FASTCGI_CONNECTION_CONNECTED)
+        eventMask |= EPOLLIN;
+
+    if (_eventMask == 0)
+        _application._dispatcher.subscribe(_fileno, eventMask, this);
+    else if (eventMask != _eventMask)
+        _application._dispatcher.modify(_fileno, eventMask, this);
+    _eventMask = eventMask;
+}
+
+/* Handles the connection's events once it's established, returns whether it still is */
+bool FastCgiConnection::transfer(uint32_t eventMask)
+{
+    Dispatcher &dispatcher = _application._dispatcher;
+    size_t budget = dispatcher.getDrainBudget();
+    bool isBudgetSpent = false;
+
+    // Records that arrived before the application closed the connection are handled first
+    if (eventMask & (EPOLLIN | EPOLLHUP))
+    {
+        // Read until the socket would block since edge-triggered readiness is only reported
+        // once, until a request's client is too far behind on its piped body, or up to the budget
+        size_t count = 0;
+        while (count < budget && _state == FASTCGI_CONNECTION_CONNECTED && !_isInputPaused && readInput())
+        {
+            handleRecords();
+            count++;
+        }
+        isBudgetSpent = count == budget;
+    }
+    if (_state != FASTCGI_CONNECTION_CONNECTED)
+        return false;
+
+    if (eventMask & EPOLLOUT)
+    {
+        size_t count = 0;
+        while (count < budget && writeOutput())
+            count++;
+        isBudgetSpent = isBudgetSpent || count == budget;
+    }
+
+    // The socket may still be ready, which edge-triggered readiness won't report again
+    if (isBudgetSpent && dispatcher.isEdgeTriggered() && _eventMask != 0)
+        dispatcher.rearm(_fileno);
+    return true;
+}
+
+/* Writes queued records to the application, returns whether writing should continue */
+bool FastCgiConnection::writeOutput()
+{
+    fillOutput();
+    if (_outputOffset >= _output.size())
+        return false;
+
+    ssize_t result = send(_fileno, _output.data() + _outputOffset, _output.size() - _outputOffset, MSG_NOSIGNAL);
+    if (result < 0)
+    {
+        if (SignalManager::shouldQuit())
+            return false;
+#ifndef __42_LIKES_WASTING_CPU_CYCLES__
+        if (errno == EAGAIN || errno == EWOULDBLOCK)
+            return false;
+#endif // __42_LIKES_WASTING_CPU_CYCLES__
+        throw std::runtime_error("Unable to write to FastCGI application");
+    }
+    _outputOffset += static_cast<size_t>(result);
+    return true;
+}
+
+/* Queues the next chunks of request bodies until the output buffer is full */
+void FastCgiConnection::fillOutput()
+{
+    if (_outputOffset > 0)
+    {
+        _output.erase(0, _outputOffset);
+        _outputOffset = 0;
+    }
+
+    // Bodies are interleaved so that a long one doesn't hold up the others
+    char buffer[FASTCGI_MAX_CONTENT_LENGTH];
+    while (_output.size() < FASTCGI_OUTPUT_BUFFER_SIZE && !_pendingBodies.empty())
+    {
+        uint16_t id = _pendingBodies.front();
+        _pendingBodies.pop_front();
+        size_t length = _requests[id]->readBody(buffer, sizeof(buffer));
+        queueRecord(FASTCGI_STDIN, id, Slice(buffer, length));
+        if (length > 0)
+            _pendingBodies.push_back(id);
+    }
+}
+
+/* Reads a chunk from the application, returns whether reading should continue */
+bool FastCgiConnection::readInput()
+{
+    char buffer[65536];
+
+    ssize_t result = recv(_fileno, buffer, sizeof(buffer), 0);
+    if (result < 0)
+    {
+        if (SignalManager::shouldQuit())
+            return false;
+#ifndef __42_LIKES_WASTING_CPU_CYCLES__
+        if (errno == EAGAIN || errno == EWOULDBLOCK)
+            return false;
+#endif // __42_LIKES_WASTING_CPU_CYCLES__
+        throw std::runtime_error("Unable to read from FastCGI application");
+    }
+
+    // The application closed the connection, which fails the requests it didn't end
+    if (result == 0)
+    {
+        disconnect();
+        return false;
+    }
+    _input.insert(_input.end(), buffer, buffer + result);
+    return true;
+}
+
+/* Handles the received records until the input is exhausted or paused */
+void FastCgiConnection::handleRecords()
+{
+    while (_state == FASTCGI_CONNECTION_CONNECTED && !_isInputPaused)
+    {
+        size_t available = _input.size() - _inputOffset;
+        if (available < FASTCGI_HEADER_LENGTH)
+            break;
+        const uint8_t *header = &_input[_inputOffset];
+        if (header[0] != FASTCGI_VERSION)
+            throw std::runtime_error("Unsupported FastCGI record version");
+        size_t contentLength = (static_cast<size_t>(header[4]) << 8) | header[5];
+        size_t recordLength = FASTCGI_HEADER_LENGTH + contentLength + header[6];
+        if (available < recordLength)
+            break;
+
+        // The record stays in the buffer while it's handled, nothing is read in the meantime
+        _inputOffset += recordLength;
+        uint16_t id = static_cast<uint16_t>((header[2] << 8) | header[3]);
+        handleRecord(header[1], id, Slice(reinterpret_cast<const char *>(header) + FASTCGI_HEADER_LENGTH, contentLength));
+    }
+
+    // A disconnect discarded the buffer
+    if (_inputOffset > 0 && _inputOffset <= _input.size())
+    {
+        _input.erase(_input.begin(), _input.begin() + _inputOffset);
+        _inputOffset = 0;
+    }
+}
+
+/* Handles a single record */
+void FastCgiConnection::handleRecord(uint8_t type, uint16_t id, Slice content)
+{
+    // Management records only answer whether requests may be multiplexed
+    if (id == 0)
+    {
+        if (type != FASTCGI_GET_VALUES_RESULT)
+            return;
+        size_t offset = 0, nameLength, valueLength;
+        while (readLength(content, offset, nameLength) && readLength(content, offset, valueLength)
+         && content.getLength() - offset >= nameLength + valueLength)
+        {
+            Slice name(&content[offset], nameLength);
+            Slice value(&content[offset + nameLength], valueLength);
+            offset += nameLength + valueLength;
+            if (name == C_SLICE("FCGI_MPXS_CONNS"))
+                _isMultiplexed = value == C_SLICE("1");
+        }
+        return;
+    }
+
+    std::map<uint16_t, FastCgiRequest *>::iterator slot = _requests.find(id);
+    if (slot == _requests.end())
+        return;
+    FastCgiRequest *request = slot->second;
+
+    if (type == FASTCGI_STDOUT)
+    {
+        // Output of aborted requests and of ones that already failed is discarded
+        if (request == NULL || request->_state != CGI_PROCESS_RUNNING || content.isEmpty())
+            return;
+        if (request->_outputMode == CGI_OUTPUT_PIPED)
+            request->_timeout.start(TIMEOUT_CGI_MS);
+        if (request->handleOutput(content))
+            pauseCongestedInput(request);
+        else
+            reportState(request, request->_state);
+    }
+    else if (type == FASTCGI_END_REQUEST)
+    {
+        _requests.erase(slot);
+        if (request == NULL)
+        {
+            if (!hasAbortedRequests() && !_hasDeferredWork)
+                _timeout.stop();
+            return;
+        }
+
+        // A script that exited with a failure status fails like a CGI process
+        request->_connection = NULL;
+        _pendingBodies.erase(std::remove(_pendingBodies.begin(), _pendingBodies.end(), id), _pendingBodies.end());
+        bool succeeded = content.getLength() >= 5
+            && content[0] == 0 && content[1] == 0 && content[2] == 0 && content[3] == 0 && content[4] == 0;
+        if (request->_state == CGI_PROCESS_RUNNING)
+            reportState(request, succeeded ? CGI_PROCESS_SUCCESS : CGI_PROCESS_FAILURE);
+    }
+}
+
+/* Gets whether requests were aborted that the application didn't end yet */
+bool FastCgiConnection::hasAbortedRequests() const
+{
+    std::map<uint16_t, FastCgiRequest *>::const_iterator slot = _requests.begin();
+    for (; slot != _requests.end(); slot++)
+    {
+        if (slot->second == NULL)
+            return true;
+    }
+    return false;
+}
+
+/* Stops reading the connection once the given request's client is too far behind on its
+   piped body, returns whether reading was paused */
+bool FastCgiConnection::pauseCongestedInput(FastCgiRequest *request)
+{
+    if (!request->isOutputCongested())
+        return false;
+    request->_isOutputPaused = true;
+    _isInputPaused = true;
+
+    // The client's timeout covers the wait; other requests on the connection wait along
+    request->_timeout.stop();
+    updateEvents();
+    return true;
+}
+
+/* Queues the handling of buffered records or a failed connection for the next timer tick */
+void FastCgiConnection::deferWork()
+{
+    _hasDeferredWork = true;
+    _timeout.start(0);
+}
+
+/* Queues a record of the given type and request */
+void FastCgiConnection::queueRecord(uint8_t type, uint16_t id, Slice content)
+{
+    size_t length = content.getLength();
+    const char header[FASTCGI_HEADER_LENGTH] = {
+        FASTCGI_VERSION,
+        static_cast<char>(type),
+        static_cast<char>(id >> 8),
+        static_cast<char>(id & 0xFF),
+        static_cast<char>(length >> 8),
+        static_cast<char>(length & 0xFF),
+        0,
+        0
+    };
+    _output.append(header, sizeof(header));
+    if (length > 0)
+        _output.append(&content[0], length);
+}
+
+/* Queues the given stream's content as records, followed by an empty one if `finish` is set */
+void FastCgiConnection::queueStream(uint8_t type, uint16_t id, Slice content, bool finish)
+{
+    while (!content.isEmpty())
+    {
+        size_t length = std::min(content.getLength(), static_cast<size_t>(FASTCGI_MAX_CONTENT_LENGTH));
+        queueRecord(type, id, Slice(&content[0], length));
+        content = content.cut(length);
+    }
+    if (finish)
+        queueRecord(type, id, Slice());
+}
+
+/* Reports the given state to the client of a request */
+void FastCgiConnection::reportState(FastCgiRequest *request, CgiProcessState state)
+{
+    request->_state = state;
+
+    // The client may destroy the request while handling the state
+    HttpClient *client = request->_client;
+    try
+    {
+        client->handleCgiState();
+    }
+    // In case of catastrophic failure, drop the client
+    catch (const std::exception &exception)
+    {
+        client->handleException(exception.what());
+    }
+    catch (...)
+    {
+        client->handleException("Thrown type is not derived from std::exception");
+    }
+}
+
+/* Constructs an empty pool for the application at the given address */
+FastCgiPool::FastCgiPool(Application &application, const FastCgiAddress &address)
+    : _application(application)
+    , _address(address)
+{
+}
+
+/* Closes all connections */
+FastCgiPool::~FastCgiPool()
+{
+    for (size_t index = 0; index < _connections.size(); index++)
+        delete _connections[index];
+}
+
+/* Starts the given request on an available connection or queues it until one is */
+void FastCgiPool::submit(FastCgiRequest *request)
+{
+    // Prefer connections that are open over ones that are still opening or closed
+    FastCgiConnection *connection = NULL;
+    int bestRank = 3;
+    for (size_t index = 0; index < _connections.size(); index++)
+    {
+        if (!_connections[index]->canAccept())
+            continue;
+        int rank;
+        switch (_connections[index]->getState())
+        {
+            case FASTCGI_CONNECTION_CONNECTED:
+                rank = 0;
+                break;
+            case FASTCGI_CONNECTION_CONNECTING:
+                rank = 1;
+                break;
+            default:
+                rank = 2;
+                break;
+        }
+        if (rank < bestRank)
+        {
+            bestRank = rank;
+            connection = _connections[index];
+        }
+    }
+
+    // Open another connection as long as the worker's share allows it
+    if (connection == NULL && _connections.size() < _application._config.fastCgiConnections)
+    {
+        connection = new FastCgiConnection(_application, *this, _address);
+        try
+        {
+            _connections.push_back(connection);
+        }
+        catch (...)
+        {
+            delete connection;
+            throw;
+        }
+    }
+
+    if (connection != NULL)
+        connection->attach(request);
+    else
+        _waiting.push_back(request);
+}
+
+/* Removes the given request from the queue */
+void FastCgiPool::withdraw(FastCgiRequest *request)
+{
+    std::deque<FastCgiRequest *>::iterator waiting = std::find(_waiting.begin(), _waiting.end(), request);
+    if (waiting != _waiting.end())
+        _waiting.erase(waiting);
+}
+
+/* Starts the queued requests that the given connection is able to carry */
+void FastCgiPool::assignWaiting(FastCgiConnection *connection)
+{
+    while (!_waiting.empty() && connection->canAccept())
+    {
+        FastCgiRequest *request = _waiting.front();
+        _waiting.pop_front();
+        connection->attach(request);
+    }
+}
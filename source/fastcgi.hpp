@@ -0,0 +1,240 @@
+#ifndef FASTCGI_hpp
+#define FASTCGI_hpp
+
+#include "cgi_backend.hpp"
+#include "dispatcher.hpp"
+#include "timeout.hpp"
+#include "http_request.hpp"
+#include "routing.hpp"
+#include "upload_handler.hpp"
+
+#include <map>
+#include <deque>
+#include <string>
+#include <vector>
+#include <stdint.h>
+#include <stddef.h>
+
+/* The protocol version of every record */
+#define FASTCGI_VERSION 1
+
+/* The length of a record's header */
+#define FASTCGI_HEADER_LENGTH 8
+
+/* The longest content a single record can carry */
+#define FASTCGI_MAX_CONTENT_LENGTH 65535
+
+/* The number of bytes that are queued for a connection before more request bodies are read */
+#define FASTCGI_OUTPUT_BUFFER_SIZE 65536
+
+/* The number of requests a connection carries at once if the application multiplexes them */
+#define FASTCGI_MAX_REQUESTS_PER_CONNECTION 16
+
+class Application;
+class FastCgiPool;
+class FastCgiConnection;
+
+/* The kinds of records exchanged with an application */
+enum FastCgiRecordType
+{
+    FASTCGI_BEGIN_REQUEST     = 1,
+    FASTCGI_ABORT_REQUEST     = 2,
+    FASTCGI_END_REQUEST       = 3,
+    FASTCGI_PARAMS            = 4,
+    FASTCGI_STDIN             = 5,
+    FASTCGI_STDOUT            = 6,
+    FASTCGI_STDERR            = 7,
+    FASTCGI_DATA              = 8,
+    FASTCGI_GET_VALUES        = 9,
+    FASTCGI_GET_VALUES_RESULT = 10,
+    FASTCGI_UNKNOWN_TYPE      = 11
+};
+
+enum FastCgiConnectionState
+{
+    FASTCGI_CONNECTION_DISCONNECTED,
+    FASTCGI_CONNECTION_CONNECTING,
+    FASTCGI_CONNECTION_CONNECTED
+};
+
+/* A script run by a FastCGI application on behalf of a client; it waits in its application's
+   pool until a connection carries it */
+class FastCgiRequest: public CgiBackend, public TimeoutSink
+{
+public:
+    friend class FastCgiConnection;
+
+    /* Constructs a request for the given client, request and route result; the body is read
+       from `spool` if given, otherwise from the request */
+    FastCgiRequest(HttpClient *client, const HttpRequest &request, const RoutingInfo &routingInfo,
+        const BodySpool *spool, FastCgiPool &pool);
+
+    /* Withdraws the request from its connection or pool and closes its body */
+    ~FastCgiRequest();
+
+    /* Reads the output of a request that was paused for the client again */
+    void resumeOutput();
+
+    /* Withdraws the request from its connection, which aborts it while it runs, or its pool */
+    void unsubscribe();
+
+    /* Transitions the request into timeout state */
+    void handleTimeout();
+private:
+    const HttpRequest &_request;
+    int                _bodyFileno;
+    size_t             _bodyLength;
+    size_t             _bodyOffset;
+    std::string        _params;
+    FastCgiPool       &_pool;
+    FastCgiConnection *_connection;
+    Timeout            _timeout;
+    bool               _isOutputPaused;
+
+    /* Reads up to `length` bytes of the body that weren't sent yet, returns 0 at its end */
+    size_t readBody(char *buffer, size_t length);
+
+    /* Encodes the CGI environment of the request as name-value pairs */
+    static std::string encodeParams(const HttpRequest &request, const RoutingInfo &routingInfo,
+        const BodySpool *spool);
+};
+
+/* A connection to a FastCGI application, which carries one request at a time or several at
+   once if the application multiplexes them; it's connected again once it was closed */
+class FastCgiConnection: public Sink, public TimeoutSink
+{
+public:
+    /* Constructs a disconnected connection to the pool's application */
+    FastCgiConnection(Application &application, FastCgiPool &pool, const FastCgiAddress &address);
+
+    /* Closes the connection */
+    ~FastCgiConnection();
+
+    /* Gets the connection state */
+    inline FastCgiConnectionState getState() const
+    {
+        return _state;
+    }
+
+    /* Gets whether the connection can carry another request right away */
+    bool canAccept() const;
+
+    /* Starts the given request on the connection, connecting first if necessary */
+    void attach(FastCgiRequest *request);
+
+    /* Withdraws the given request from the connection, a running request is aborted */
+    void detach(FastCgiRequest *request);
+
+    /* Reads the connection again after a request's client caught up on its piped body */
+    void resumeInput();
+
+    /* Handles one or multiple events */
+    void handleEvents(uint32_t eventMask);
+
+    /* Handles an exception that occurred in `handleEvent()` */
+    void handleException(const char *message);
+
+    /* Handles the deferred work of the connection or the expiry of aborted requests */
+    void handleTimeout();
+private:
+    Application                           &_application;
+    FastCgiPool                           &_pool;
+    const FastCgiAddress                  &_address;
+    int                                    _fileno;
+    FastCgiConnectionState                 _state;
+    bool                                   _isMultiplexed;
+    bool                                   _isInputPaused;
+    bool                                   _hasDeferredWork;
+    uint32_t                               _eventMask;
+    std::map<uint16_t, FastCgiRequest *>   _requests; // Aborted requests are kept as NULL until they end
+    std::deque<uint16_t>                   _pendingBodies;
+    std::string                            _output;
+    size_t                                 _outputOffset;
+    std::vector<uint8_t>                   _input;
+    size_t                                 _inputOffset;
+    Timeout                                _timeout;
+
+    /* Opens a non-blocking connection to the application */
+    void connect();
+
+    /* Closes the connection and fails the requests it carried */
+    void disconnect();
+
+    /* Subscribes the events the connection currently waits for */
+    void updateEvents();
+
+    /* Handles the connection's events once it's established, returns whether it still is */
+    bool transfer(uint32_t eventMask);
+
+    /* Writes queued records to the application, returns whether writing should continue */
+    bool writeOutput();
+
+    /* Queues the next chunks of request bodies until the output buffer is full */
+    void fillOutput();
+
+    /* Reads a chunk from the application, returns whether reading should continue */
+    bool readInput();
+
+    /* Handles the received records until the input is exhausted or paused */
+    void handleRecords();
+
+    /* Handles a single record */
+    void handleRecord(uint8_t type, uint16_t id, Slice content);
+
+    /* Gets whether requests were aborted that the application didn't end yet */
+    bool hasAbortedRequests() const;
+
+    /* Stops reading the connection once the given request's client is too far behind on its
+       piped body, returns whether reading was paused */
+    bool pauseCongestedInput(FastCgiRequest *request);
+
+    /* Queues the handling of buffered records or a failed connection for the next timer tick */
+    void deferWork();
+
+    /* Queues a record of the given type and request */
+    void queueRecord(uint8_t type, uint16_t id, Slice content);
+
+    /* Queues the given stream's content as records, followed by an empty one if `finish` is set */
+    void queueStream(uint8_t type, uint16_t id, Slice content, bool finish);
+
+    /* Reports the given state to the client of a request */
+    static void reportState(FastCgiRequest *request, CgiProcessState state);
+
+    /* Disable copy-construction and copy-assignment */
+    FastCgiConnection(const FastCgiConnection &other);
+    FastCgiConnection &operator=(const FastCgiConnection &other);
+};
+
+/* The connections of a worker to a single FastCGI application and the requests that wait
+   for one of them */
+class FastCgiPool
+{
+public:
+    friend class FastCgiConnection;
+
+    /* Constructs an empty pool for the application at the given address */
+    FastCgiPool(Application &application, const FastCgiAddress &address);
+
+    /* Closes all connections */
+    ~FastCgiPool();
+
+    /* Starts the given request on an available connection or queues it until one is */
+    void submit(FastCgiRequest *request);
+
+    /* Removes the given request from the queue */
+    void withdraw(FastCgiRequest *request);
+private:
+    Application                      &_application;
+    const FastCgiAddress             &_address;
+    std::vector<FastCgiConnection *>  _connections;
+    std::deque<FastCgiRequest *>      _waiting;
+
+    /* Starts the queued requests that the given connection is able to carry */
+    void assignWaiting(FastCgiConnection *connection);
+
+    /* Disable copy-construction and copy-assignment */
+    FastCgiPool(const FastCgiPool &other);
+    FastCgiPool &operator=(const FastCgiPool &other);
+};
+
+#endif // FASTCGI_hpp
@@ -0,0 +1,229 @@
+#include "file_cache.hpp"
+#include "timer_wheel.hpp"
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <stdexcept>
+
+/* Destructor for deriving classes */
+NodeTypeSource::~NodeTypeSource()
+{
+}
+
+/* Takes ownership of an opened file descriptor described by `status` */
+CachedFile::CachedFile(const std::string &path, int fileno, const struct stat &status, uint64_t time)
+    : _path(path)
+    , _fileno(fileno)
+    , _size(status.st_size)
+    , _modificationTime(status.st_mtime)
+    , _changeTime(status.st_ctime)
+    , _device(status.st_dev)
+    , _inode(status.st_ino)
+    , _validatedAt(time)
+    , _references(1)
+    , _newer(NULL)
+    , _older(NULL)
+{
+}
+
+/* Closes the file descriptor */
+CachedFile::~CachedFile()
+{
+    close(_fileno);
+}
+
+/* Drops a reference, the file is closed and destroyed when the last one is gone */
+void CachedFile::release()
+{
+    if (--_references == 0)
+        delete this;
+}
+
+/* Wraps an opened file that is not part of any cache, taking ownership of its descriptor;
+   returns NULL and closes the descriptor if the file can't be inspected */
+CachedFile *CachedFile::adopt(int fileno)
+{
+    struct stat status;
+    if (fstat(fileno, &status) != 0)
+    {
+        close(fileno);
+        return NULL;
+    }
+    try
+    {
+        return new CachedFile(std::string(), fileno, status, 0);
+    }
+    catch (...)
+    {
+        close(fileno);
+        throw;
+    }
+}
+
+/* Checks whether `status` still describes the opened file */
+bool CachedFile::matches(const struct stat &status) const
+{
+    // Replacing, rewriting, truncating or changing the permissions of the file changes one of these
+    return status.st_dev == _device
+        && status.st_ino == _inode
+        && static_cast<size_t>(status.st_size) == _size
+        && status.st_mtime == _modificationTime
+        && status.st_ctime == _changeTime;
+}
+
+/* Constructs a cache that keeps up to `capacity` files open and trusts their metadata for
+   `validity` milliseconds; a capacity of zero disables caching */
+FileCache::FileCache(const TimerWheel &clock, size_t capacity, uint64_t validity)
+    : _clock(clock)
+    , _capacity(capacity)
+    , _validity(validity)
+    , _newest(NULL)
+    , _oldest(NULL)
+{
+#ifdef __42_LIKES_WASTING_CPU_CYCLES__
+    if (capacity > 0)
+        throw std::runtime_error("The open file cache is not supported in this build");
+#endif // __42_LIKES_WASTING_CPU_CYCLES__
+}
+
+/* Drops the cache's references to all files */
+FileCache::~FileCache()
+{
+    while (_newest != NULL)
+        remove(_newest);
+}
+
+/* Queries the type of node at the given FS path, cached files are known to be regular */
+NodeType FileCache::queryNodeType(const std::string &path)
+{
+    if (find(path) != NULL)
+        return NODE_TYPE_REGULAR;
+    return Utility::queryNodeType(path);
+}
+
+/* Gets a reference to the regular file at the given path, which the caller must release,
+   returns NULL if the file can't be opened */
+CachedFile *FileCache::open(const std::string &path)
+{
+    CachedFile *file = find(path);
+    if (file != NULL)
+        return file->acquire();
+
+    // Open the file and make sure it is a regular one
+    struct stat status;
+    int fileno = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fileno < 0)
+        return NULL;
+    if (fstat(fileno, &status) != 0 || !S_ISREG(status.st_mode))
+    {
+        close(fileno);
+        return NULL;
+    }
+
+    try
+    {
+        file = new CachedFile(path, fileno, status, _clock.getTime());
+    }
+    catch (...)
+    {
+        close(fileno);
+        throw;
+    }
+
+    // Without caching, the caller holds the only reference
+    if (_capacity == 0)
+        return file;
+
+    // The cache takes its own reference next to the caller's
+    try
+    {
+        insert(file);
+    }
+    catch (...)
+    {
+        file->release();
+        throw;
+    }
+    return file;
+}
+
+/* Drops the file at the given path from the cache, if present */
+void FileCache::invalidate(const std::string &path)
+{
+    FileMap::iterator iterator = _files.find(path);
+    if (iterator != _files.end())
+        remove(iterator->second);
+}
+
+/* Finds a cached file whose metadata is still valid and marks it as recently used,
+   files that changed since they were opened are dropped */
+CachedFile *FileCache::find(const std::string &path)
+{
+    FileMap::iterator iterator = _files.find(path);
+    if (iterator == _files.end())
+        return NULL;
+    CachedFile *file = iterator->second;
+
+    // Check the path again once the metadata is too old to be trusted
+    uint64_t time = _clock.getTime();
+    if (time - file->_validatedAt >= _validity)
+    {
+        struct stat status;
+        if (stat(path.c_str(), &status) != 0 || !file->matches(status))
+        {
+            remove(file);
+            return NULL;
+        }
+        file->_validatedAt = time;
+    }
+
+    unlink(file);
+    link(file);
+    return file;
+}
+
+/* Adds a file as the most recently used one, closing the least recently used file if full */
+void FileCache::insert(CachedFile *file)
+{
+    if (_files.size() >= _capacity)
+        remove(_oldest);
+
+    _files.insert(std::make_pair(file->_path, file));
+    link(file);
+    file->acquire();
+}
+
+/* Removes a file from the cache and drops the cache's reference */
+void FileCache::remove(CachedFile *file)
+{
+    _files.erase(file->_path);
+    unlink(file);
+    file->release();
+}
+
+/* Links a file in front of the recently used list */
+void FileCache::link(CachedFile *file)
+{
+    file->_older = _newest;
+    file->_newer = NULL;
+    if (_newest != NULL)
+        _newest->_newer = file;
+    else
+        _oldest = file;
+    _newest = file;
+}
+
+/* Unlinks a file from the recently used list */
+void FileCache::unlink(CachedFile *file)
+{
+    if (file->_newer != NULL)
+        file->_newer->_older = file->_older;
+    else
+        _newest = file->_older;
+    if (file->_older != NULL)
+        file->_older->_newer = file->_newer;
+    else
+        _oldest = file->_newer;
+    file->_newer = NULL;
+    file->_older = NULL;
+}
@@ -0,0 +1,151 @@
+#ifndef FILE_CACHE_hpp
+#define FILE_CACHE_hpp
+
+#include "utility.hpp"
+
+#include <map>
+#include <string>
+#include <stdint.h>
+#include <sys/stat.h>
+
+class TimerWheel;
+
+/* Answers queries for the type of node at a path, possibly from a cache */
+struct NodeTypeSource
+{
+    /* Queries the type of node at the given FS path */
+    virtual NodeType queryNodeType(const std::string &path) = 0;
+
+    /* Destructor for deriving classes */
+    virtual ~NodeTypeSource();
+};
+
+/* An open regular file that is shared by the cache and the responses sending it */
+class CachedFile
+{
+public:
+    friend class FileCache;
+
+    /* Takes another reference to the file */
+    inline CachedFile *acquire()
+    {
+        _references++;
+        return this;
+    }
+
+    /* Drops a reference, the file is closed and destroyed when the last one is gone */
+    void release();
+
+    /* Wraps an opened file that is not part of any cache, taking ownership of its descriptor;
+       returns NULL and closes the descriptor if the file can't be inspected */
+    static CachedFile *adopt(int fileno);
+
+    /* Gets the file's descriptor */
+    inline int getFileno() const
+    {
+        return _fileno;
+    }
+
+    /* Gets the file's size in bytes */
+    inline size_t getSize() const
+    {
+        return _size;
+    }
+
+    /* Gets the file's last modification time */
+    inline time_t getModificationTime() const
+    {
+        return _modificationTime;
+    }
+
+    /* Gets the ID of the device holding the file */
+    inline dev_t getDevice() const
+    {
+        return _device;
+    }
+
+    /* Gets the file's inode number */
+    inline ino_t getInode() const
+    {
+        return _inode;
+    }
+private:
+    std::string  _path;
+    int          _fileno;
+    size_t       _size;
+    time_t       _modificationTime;
+    time_t       _changeTime;
+    dev_t        _device;
+    ino_t        _inode;
+    uint64_t     _validatedAt;
+    size_t       _references;
+    CachedFile  *_newer;
+    CachedFile  *_older;
+
+    /* Takes ownership of an opened file descriptor described by `status` */
+    CachedFile(const std::string &path, int fileno, const struct stat &status, uint64_t time);
+
+    /* Closes the file descriptor */
+    ~CachedFile();
+
+    /* Checks whether `status` still describes the opened file */
+    bool matches(const struct stat &status) const;
+
+    /* Disable copy-construction and copy-assignment */
+    CachedFile(const CachedFile &other);
+    CachedFile &operator=(const CachedFile &other);
+};
+
+/* Keeps recently served files open so they can be sent without resolving their path again,
+   the least recently used file is closed when the capacity is reached */
+class FileCache: public NodeTypeSource
+{
+public:
+    /* Constructs a cache that keeps up to `capacity` files open and trusts their metadata for
+       `validity` milliseconds; a capacity of zero disables caching */
+    FileCache(const TimerWheel &clock, size_t capacity, uint64_t validity);
+
+    /* Drops the cache's references to all files */
+    ~FileCache();
+
+    /* Queries the type of node at the given FS path, cached files are known to be regular */
+    NodeType queryNodeType(const std::string &path);
+
+    /* Gets a reference to the regular file at the given path, which the caller must release,
+       returns NULL if the file can't be opened */
+    CachedFile *open(const std::string &path);
+
+    /* Drops the file at the given path from the cache, if present */
+    void invalidate(const std::string &path);
+private:
+    typedef std::map<std::string, CachedFile *> FileMap;
+
+    const TimerWheel &_clock;
+    size_t            _capacity;
+    uint64_t          _validity;
+    FileMap           _files;
+    CachedFile       *_newest;
+    CachedFile       *_oldest;
+
+    /* Finds a cached file whose metadata is still valid and marks it as recently used,
+       files that changed since they were opened are dropped */
+    CachedFile *find(const std::string &path);
+
+    /* Adds a file as the most recently used one, closing the least recently used file if full */
+    void insert(CachedFile *file);
+
+    /* Removes a file from the cache and drops the cache's reference */
+    void remove(CachedFile *file);
+
+    /* Links a file in front of the recently used list */
+    void link(CachedFile *file);
+
+    /* Unlinks a file from the recently used list */
+    void unlink(CachedFile *file);
+
+    /* Disable copy-construction and copy-assignment */
+    FileCache(const FileCache &other);
+    FileCache &operator=(const FileCache &other);
+};
+
+#endif // FILE_CACHE_hpp
@@ -0,0 +1,153 @@
+#include "gzip_cache.hpp"
+#include "gzip_encoder.hpp"
+
+#include <unistd.h>
+#include <stdexcept>
+
+/* Constructs an empty copy of the given version of a file */
+CompressedFile::CompressedFile(const std::string &path, const CachedFile &file)
+    : _path(path)
+    , _device(file.getDevice())
+    , _inode(file.getInode())
+    , _size(file.getSize())
+    , _modificationTime(file.getModificationTime())
+    , _references(1)
+    , _newer(NULL)
+    , _older(NULL)
+{
+}
+
+/* Drops a reference, the copy is destroyed when the last one is gone */
+void CompressedFile::release()
+{
+    if (--_references == 0)
+        delete this;
+}
+
+/* Checks whether the copy was made from the given version of the file */
+bool CompressedFile::matches(const CachedFile &file) const
+{
+    return file.getDevice() == _device
+        && file.getInode() == _inode
+        && file.getSize() == _size
+        && file.getModificationTime() == _modificationTime;
+}
+
+/* Constructs a cache holding up to `budget` bytes of compressed content, a budget of zero
+   compresses files for every response */
+GzipCache::GzipCache(size_t budget)
+    : _budget(budget)
+    , _size(0)
+    , _newest(NULL)
+    , _oldest(NULL)
+{
+#ifdef __42_LIKES_WASTING_CPU_CYCLES__
+    if (budget > 0)
+        throw std::runtime_error("The gzip cache is not supported in this build");
+#endif // __42_LIKES_WASTING_CPU_CYCLES__
+}
+
+/* Drops the cache's references to all copies */
+GzipCache::~GzipCache()
+{
+    while (_newest != NULL)
+        remove(_newest);
+}
+
+/* Gets a reference to the compressed content of the opened file at the given path, which the
+   caller must release; the file is compressed unless a copy of its version is cached */
+CompressedFile *GzipCache::compress(const std::string &path, const CachedFile &file)
+{
+    CopyMap::iterator iterator = _copies.find(path);
+    if (iterator != _copies.end())
+    {
+        CompressedFile *copy = iterator->second;
+        if (copy->matches(file))
+        {
+            unlink(copy);
+            link(copy);
+            return copy->acquire();
+        }
+        remove(copy);
+    }
+
+#ifdef __42_LIKES_WASTING_CPU_CYCLES__
+    throw std::logic_error("pread() is not supported in this build");
+#else
+    // Read the whole file and compress it at once
+    std::string content(file.getSize(), '\0');
+    if (file.getSize() > 0)
+    {
+        ssize_t result = pread(file.getFileno(), &content[0], file.getSize(), 0);
+        if (result < 0 || static_cast<size_t>(result) != file.getSize())
+            throw std::runtime_error("Unable to read file");
+    }
+    CompressedFile *copy = new CompressedFile(path, file);
+    try
+    {
+        copy->_data = GzipEncoder::encode(content);
+    }
+    catch (...)
+    {
+        delete copy;
+        throw;
+    }
+
+    // Without room for the copy, the caller holds the only reference
+    size_t size = copy->_data.size();
+    if (size > _budget)
+        return copy;
+
+    // Make room for the copy by dropping the least recently used ones
+    while (_size + size > _budget)
+        remove(_oldest);
+    try
+    {
+        _copies.insert(std::make_pair(path, copy));
+    }
+    catch (...)
+    {
+        copy->release();
+        throw;
+    }
+    link(copy);
+    _size += size;
+    return copy->acquire();
+#endif // __42_LIKES_WASTING_CPU_CYCLES__
+}
+
+/* Removes a copy from the cache and drops the cache's reference */
+void GzipCache::remove(CompressedFile *copy)
+{
+    _copies.erase(copy->_path);
+    unlink(copy);
+    _size -= copy->_data.size();
+    copy->release();
+}
+
+/* Links a copy in front of the recently used list */
+void GzipCache::link(CompressedFile *copy)
+{
+    copy->_older = _newest;
+    copy->_newer = NULL;
+    if (_newest != NULL)
+        _newest->_newer = copy;
+    else
+        _oldest = copy;
+    _newest = copy;
+}
+
+/* Unlinks a copy from the recently used list */
+void GzipCache::unlink(CompressedFile *copy)
+{
+    if (copy->_newer != NULL)
+        copy->_newer->_older = copy->_older;
+    else
+        _newest = copy->_older;
+    if (copy->_older != NULL)
+        copy->_older->_newer = copy->_newer;
+    else
+        _oldest = copy->_newer;
+    copy->_newer = NULL;
+    copy->_older = NULL;
+}
@@ -0,0 +1,96 @@
+#ifndef GZIP_CACHE_hpp
+#define GZIP_CACHE_hpp
+
+#include "slice.hpp"
+#include "file_cache.hpp"
+
+#include <map>
+#include <string>
+#include <sys/types.h>
+
+/* The largest file that is compressed on the fly, larger files are sent as they are */
+#define GZIP_CACHE_MAX_FILE_SIZE 1048576
+
+/* A gzip-compressed copy of a file's content that is shared by the cache and the responses
+   sending it */
+class CompressedFile
+{
+public:
+    friend class GzipCache;
+
+    /* Takes another reference to the copy */
+    inline CompressedFile *acquire()
+    {
+        _references++;
+        return this;
+    }
+
+    /* Drops a reference, the copy is destroyed when the last one is gone */
+    void release();
+
+    /* Gets the compressed content */
+    inline Slice getData() const
+    {
+        return Slice(_data);
+    }
+private:
+    std::string     _path;
+    dev_t           _device;
+    ino_t           _inode;
+    size_t          _size;
+    time_t          _modificationTime;
+    std::string     _data;
+    size_t          _references;
+    CompressedFile *_newer;
+    CompressedFile *_older;
+
+    /* Constructs an empty copy of the given version of a file */
+    CompressedFile(const std::string &path, const CachedFile &file);
+
+    /* Checks whether the copy was made from the given version of the file */
+    bool matches(const CachedFile &file) const;
+
+    /* Disable copy-construction and copy-assignment */
+    CompressedFile(const CompressedFile &other);
+    CompressedFile &operator=(const CompressedFile &other);
+};
+
+/* Keeps gzip-compressed copies of files within a byte budget so each version of a file is only
+   compressed once, the least recently used copies are dropped first */
+class GzipCache
+{
+public:
+    /* Constructs a cache holding up to `budget` bytes of compressed content, a budget of zero
+       compresses files for every response */
+    GzipCache(size_t budget);
+
+    /* Drops the cache's references to all copies */
+    ~GzipCache();
+
+    /* Gets a reference to the compressed content of the opened file at the given path, which the
+       caller must release; the file is compressed unless a copy of its version is cached */
+    CompressedFile *compress(const std::string &path, const CachedFile &file);
+private:
+    typedef std::map<std::string, CompressedFile *> CopyMap;
+
+    size_t          _budget;
+    size_t          _size;
+    CopyMap         _copies;
+    CompressedFile *_newest;
+    CompressedFile *_oldest;
+
+    /* Removes a copy from the cache and drops the cache's reference */
+    void remove(CompressedFile *copy);
+
+    /* Links a copy in front of the recently used list */
+    void link(CompressedFile *copy);
+
+    /* Unlinks a copy from the recently used list */
+    void unlink(CompressedFile *copy);
+
+    /* Disable copy-construction and copy-assignment */
+    GzipCache(const GzipCache &other);
+    GzipCache &operator=(const GzipCache &other);
+};
+
+#endif // GZIP_CACHE_hpp
@@ -0,0 +1,108 @@
+#include "gzip_encoder.hpp"
+
+#include <stdexcept>
+#ifndef __42_LIKES_WASTING_CPU_CYCLES__
+# include <zlib.h>
+#endif // __42_LIKES_WASTING_CPU_CYCLES__
+
+/* The window size of zlib's deflate, offset by 16 to write a gzip header and trailer */
+#define GZIP_ENCODER_WINDOW_BITS (15 + 16)
+
+/* Constructs an encoder at the start of a gzip stream */
+GzipEncoder::GzipEncoder()
+    : _stream(NULL)
+{
+#ifdef __42_LIKES_WASTING_CPU_CYCLES__
+    throw std::runtime_error("gzip compression is not supported in this build");
+#else
+    _stream = new z_stream();
+    if (deflateInit2(_stream, GZIP_ENCODER_LEVEL, Z_DEFLATED, GZIP_ENCODER_WINDOW_BITS, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+    {
+        delete _stream;
+        throw std::runtime_error("Unable to initialize gzip compression");
+    }
+#endif // __42_LIKES_WASTING_CPU_CYCLES__
+}
+
+/* Releases the compression state */
+GzipEncoder::~GzipEncoder()
+{
+#ifndef __42_LIKES_WASTING_CPU_CYCLES__
+    deflateEnd(_stream);
+    delete _stream;
+#endif // __42_LIKES_WASTING_CPU_CYCLES__
+}
+
+/* Compresses the given data and appends the available output to `output` */
+void GzipEncoder::update(Slice input, std::string &output)
+{
+#ifdef __42_LIKES_WASTING_CPU_CYCLES__
+    (void)input;
+    (void)output;
+#else
+    deflate(input, Z_NO_FLUSH, output);
+#endif // __42_LIKES_WASTING_CPU_CYCLES__
+}
+
+/* Appends all output of the data compressed so far to `output`, so that it can be
+   decompressed without waiting for more */
+void GzipEncoder::flush(std::string &output)
+{
+#ifdef __42_LIKES_WASTING_CPU_CYCLES__
+    (void)output;
+#else
+    deflate(Slice(), Z_SYNC_FLUSH, output);
+#endif // __42_LIKES_WASTING_CPU_CYCLES__
+}
+
+/* Ends the gzip stream and appends the remaining output to `output` */
+void GzipEncoder::finish(std::string &output)
+{
+#ifdef __42_LIKES_WASTING_CPU_CYCLES__
+    (void)output;
+#else
+    deflate(Slice(), Z_FINISH, output);
+#endif // __42_LIKES_WASTING_CPU_CYCLES__
+}
+
+/* Compresses the given data into a complete gzip stream */
+std::string GzipEncoder::encode(Slice input)
+{
+    GzipEncoder encoder;
+    std::string output;
+    encoder.update(input, output);
+    encoder.finish(output);
+    return output;
+}
+
+/* Feeds input to the compressor with the given flush mode until it has nothing left to add */
+void GzipEncoder::deflate(Slice input, int flush, std::string &output)
+{
+#ifdef __42_LIKES_WASTING_CPU_CYCLES__
+    (void)input;
+    (void)flush;
+    (void)output;
+#else
+    _stream->next_in  = reinterpret_cast<Bytef *>(const_cast<char *>(input.isEmpty() ? NULL : &input[0]));
+    _stream->avail_in = static_cast<uInt>(input.getLength());
+
+    // Grow the output by at least the bound of the input's compressed size each round
+    while (true)
+    {
+        size_t offset = output.size();
+        size_t space = deflateBound(_stream, _stream->avail_in) + 64;
+        output.resize(offset + space);
+        _stream->next_out  = reinterpret_cast<Bytef *>(&output[offset]);
+        _stream->avail_out = static_cast<uInt>(space);
+
+        int result = ::deflate(_stream, flush);
+        output.resize(offset + space - _stream->avail_out);
+        if (result == Z_STREAM_ERROR)
+            throw std::runtime_error("Unable to compress data");
+
+        // Done once all input was taken and the compressor didn't fill its output
+        if (flush == Z_FINISH ? result == Z_STREAM_END : _stream->avail_in == 0 && _stream->avail_out != 0)
+            return;
+    }
+#endif // __42_LIKES_WASTING_CPU_CYCLES__
+}
@@ -0,0 +1,46 @@
+#ifndef GZIP_ENCODER_hpp
+#define GZIP_ENCODER_hpp
+
+#include "slice.hpp"
+
+#include <string>
+
+/* The zlib compression level used for all encodings, a trade-off between CPU time and size */
+#define GZIP_ENCODER_LEVEL 6
+
+struct z_stream_s;
+
+/* Incrementally encodes data in the gzip format */
+class GzipEncoder
+{
+public:
+    /* Constructs an encoder at the start of a gzip stream */
+    GzipEncoder();
+
+    /* Releases the compression state */
+    ~GzipEncoder();
+
+    /* Compresses the given data and appends the available output to `output` */
+    void update(Slice input, std::string &output);
+
+    /* Appends all output of the data compressed so far to `output`, so that it can be
+       decompressed without waiting for more */
+    void flush(std::string &output);
+
+    /* Ends the gzip stream and appends the remaining output to `output` */
+    void finish(std::string &output);
+
+    /* Compresses the given data into a complete gzip stream */
+    static std::string encode(Slice input);
+private:
+    struct z_stream_s *_stream;
+
+    /* Feeds input to the compressor with the given flush mode until it has nothing left to add */
+    void deflate(Slice input, int flush, std::string &output);
+
+    /* Disable copy-construction and copy-assignment */
+    GzipEncoder(const GzipEncoder &other);
+    GzipEncoder &operator=(const GzipEncoder &other);
+};
+
+#endif // GZIP_ENCODER_hpp
@@ -11,31 +11,58 @@
 #include "signal_manager.hpp"
 
 #include <stdio.h>
+#include <errno.h>
 #include <unistd.h>
 #include <algorithm>
 #include <sys/stat.h>
+#include <sys/socket.h>
 #include <fcntl.h>
+#include <cstring>
+
+/* Content codings of precompressed siblings in order of preference, along with their file suffix */
+static const char *const g_precompressedCodings[][2] = {
+    { "br",   ".br" },
+    { "gzip", ".gz" }
+};
 
 /* Constructs a HTTP client using the given socket file descriptor */
 HttpClient::HttpClient(Application &application, const ServerConfig *config, int fileno, uint32_t host, uint16_t port)
     : _application(application)
+    , _endpointConfig(config)
     , _config(config)
     , _fileno(fileno)
-    , _timeout(TIMEOUT_REQUEST_MS)
+    , _timeout(application._timers, this)
     , _waitingForClose(false)
     , _markedForCleanup(false)
-    , _process(NULL)
+    , _keepAlive(false)
+    , _isIdle(false)
+    , _requestCount(0)
+    , _cgi(NULL)
+    , _isStreamingCgiBody(false)
     , _host(host)
     , _port(port)
-    , _parser(*config, host, port)
+    , _parser(*config, host, port, this)
+    , _response(new HttpResponse())
+    , _upload(NULL)
+    , _spool(NULL)
+    , _compression(NULL)
+    , _acceptsGzip(false)
 {
+    _timeout.start(TIMEOUT_REQUEST_MS);
 }
 
 /* Closes the client's file descriptor */
 HttpClient::~HttpClient()
 {
-    if (_process != NULL)
-        delete _process;
+    if (_cgi != NULL)
+        delete _cgi;
+    delete _upload;
+    delete _spool;
+    delete _response;
+    for (size_t index = 0; index < _queuedResponses.size(); index++)
+        delete _queuedResponses[index];
+    for (size_t index = 0; index < _spareResponses.size(); index++)
+        delete _spareResponses[index];
     close(_fileno);
 }
 
@@ -50,79 +77,644 @@ void HttpClient::handleEvents(uint32_t eventMask)
 
     if (eventMask & EPOLLIN)
     {
-        ssize_t length;
-        char buffer[8192];
+#ifdef __42_LIKES_WASTING_CPU_CYCLES__
+        receiveData();
+        return;
+#else
+        // Read until the socket would block since edge-triggered readiness is only reported once,
+        // but only up to the budget so that a fast client doesn't starve the others
+        size_t budget = _application._dispatcher.getDrainBudget();
+        size_t count = 0;
+        while (count < budget && receiveData())
+            count++;
+        if (count == budget && _application._dispatcher.isEdgeTriggered() && !_markedForCleanup)
+            _application._dispatcher.rearm(_fileno);
+#endif // __42_LIKES_WASTING_CPU_CYCLES__
+    }
+
+    if (eventMask & EPOLLOUT)
+    {
+#ifdef __42_LIKES_WASTING_CPU_CYCLES__
+        transferResponses();
+#else
+        // Send until the socket would block since edge-triggered readiness is only reported once,
+        // but only up to the budget so that a fast client doesn't starve the others
+        size_t budget = _application._dispatcher.getDrainBudget();
+        size_t count = 0;
+        while (count < budget && transferResponses() > 0)
+            count++;
+        if (count == budget && _application._dispatcher.isEdgeTriggered())
+            _application._dispatcher.rearm(_fileno);
+#endif // __42_LIKES_WASTING_CPU_CYCLES__
+        if (_queuedResponses.empty() && !_response->hasData())
+            finishResponses();
+    }
+}
+
+/* Sends the next part of the queued and current responses, returns the number of bytes
+   sent which is zero if the socket would block or there is nothing to send */
+size_t HttpClient::transferResponses()
+{
+    HttpResponse *front = _queuedResponses.empty() ? _response : _queuedResponses.front();
+    if (!front->hasData())
+        return 0;
+
+#ifdef __42_LIKES_WASTING_CPU_CYCLES__
+    size_t bytesSent = front->transferToSocket(_fileno);
+#else
+    size_t bytesSent = gatherResponsesToSocket();
+#endif // __42_LIKES_WASTING_CPU_CYCLES__
+
+    // Recycle the queued responses that were sent completely
+    bool isFrontSent = false;
+    while (!_queuedResponses.empty() && !_queuedResponses.front()->hasData())
+    {
+        _queuedResponses.front()->reset();
+        _spareResponses.push_back(_queuedResponses.front());
+        _queuedResponses.pop_front();
+        isFrontSent = true;
+    }
+
+    // Give the next response its own time to be sent
+    if (isFrontSent)
+    {
+        front = _queuedResponses.empty() ? _response : _queuedResponses.front();
+        if (front->getState() == HTTP_RESPONSE_FINALIZED)
+            _timeout.start(front->getTransferTimeout());
+    }
+    return bytesSent;
+}
 
-        if ((length = read(_fileno, buffer, sizeof(buffer))) < 0)
+#ifndef __42_LIKES_WASTING_CPU_CYCLES__
+/* Sends the in-memory data of consecutive responses with a single system call,
+   returns the number of bytes sent which is zero if the socket would block */
+size_t HttpClient::gatherResponsesToSocket()
+{
+    struct iovec vectors[HTTP_CLIENT_MAX_GATHERED_BUFFERS];
+    size_t count = 0;
+    size_t responseCount = _queuedResponses.size() + 1;
+    bool hasMore = false;
+
+    // Collect buffers in order until a response streams its body from a file
+    for (size_t index = 0; index < responseCount && count < HTTP_CLIENT_MAX_GATHERED_BUFFERS; index++)
+    {
+        HttpResponse *response = index < _queuedResponses.size() ? _queuedResponses[index] : _response;
+        if (response->getState() != HTTP_RESPONSE_FINALIZED)
+            break;
+        count += response->gatherBuffers(&vectors[count], HTTP_CLIENT_MAX_GATHERED_BUFFERS - count);
+        if (!response->isBuffered())
         {
-            if (SignalManager::shouldQuit())
-                return;
-            throw std::runtime_error("Unable to read from client");
+            // The file's bytes directly follow the gathered data
+            hasMore = response->hasStreamedBody();
+            break;
         }
+    }
 
-        if (_waitingForClose)
-        {
+    // Nothing is buffered in front of a streamed body, send it on its own
+    if (count == 0)
+    {
+        HttpResponse *front = _queuedResponses.empty() ? _response : _queuedResponses.front();
+        return front->transferToSocket(_fileno);
+    }
+
+    size_t bytesSent = HttpResponse::sendVectorsToSocket(_fileno, vectors, count, hasMore);
+
+    // Spread the sent bytes over the responses in the order they were gathered
+    size_t remainder = bytesSent;
+    for (size_t index = 0; index < responseCount && remainder > 0; index++)
+    {
+        HttpResponse *response = index < _queuedResponses.size() ? _queuedResponses[index] : _response;
+        remainder = response->consumeBuffers(remainder);
+    }
+    return bytesSent;
+}
+#endif // __42_LIKES_WASTING_CPU_CYCLES__
+
+/* Continues with the connection once every finalized response was sent */
+void HttpClient::finishResponses()
+{
+    // The current request's CGI process hasn't produced (all of) its response yet, a paused
+    // process continues now that the client caught up
+    if (_cgi != NULL && (_response->getState() != HTTP_RESPONSE_FINALIZED || _response->isAwaitingBody()))
+    {
+        _timeout.stop();
+        _application._dispatcher.modify(_fileno, EPOLLHUP, this);
+        _cgi->resumeOutput();
+        return;
+    }
+
+    // The current request is still being received
+    if (_response->getState() == HTTP_RESPONSE_UNINITIALIZED)
+    {
+        _timeout.start(TIMEOUT_REQUEST_MS);
+        _application._dispatcher.modify(_fileno, EPOLLIN | EPOLLHUP, this);
+        return;
+    }
+
+    if (_keepAlive)
+        prepareNextRequest();
+    else
+        closeGracefully();
+}
+
+/* Prepares the connection for the client's next request after a response was sent */
+void HttpClient::prepareNextRequest()
+{
+    uint64_t idleTimeout = _config->keepAliveTimeout;
+
+    // The response may refer to the CGI process' output and the process to the request, so
+    // release them in this order before the parser is reset
+    _response->reset();
+    if (_cgi != NULL)
+        _application.closeCgiProcess(this);
+    _parser.reset();
+    _config = _endpointConfig;
+    _keepAlive = false;
+    _application._dispatcher.modify(_fileno, EPOLLIN | EPOLLHUP, this);
+
+    // Wait for the next request, but only for as long as an idle connection may linger
+    if (!_parser.hasPendingData())
+    {
+        _isIdle = true;
+        _timeout.start(idleTimeout);
+        return;
+    }
+
+    // The next request was pipelined behind the previous one
+    _timeout.start(TIMEOUT_REQUEST_MS);
+    if (_parser.commitPending())
+        serveRequests();
+}
+
+/* Stops sending and waits for the client to close the connection after a response was sent */
+void HttpClient::closeGracefully()
+{
+#ifndef __42_LIKES_WASTING_CPU_CYCLES__
+    // Send the end of stream first so the client doesn't get its pending data reset by the close
+    shutdown(_fileno, SHUT_WR);
+#endif // __42_LIKES_WASTING_CPU_CYCLES__
+
+    // Do not directly close the connection after sending the response
+    // Switch back to read events and wait for the client to close the connection in
+    // and set a timeout so it doesn't linger
+    _timeout.start(TIMEOUT_CLOSING_MS);
+    _application._dispatcher.modify(_fileno, EPOLLIN | EPOLLHUP, this);
+    _waitingForClose = true;
+}
+
+/* Reads and parses a chunk of request data, returns whether reading should continue */
+bool HttpClient::receiveData()
+{
+    ssize_t length;
+    char buffer[8192];
+
+#ifndef __42_LIKES_WASTING_CPU_CYCLES__
+    UploadSink *sink = _upload != NULL ? _upload : _spool;
+    if (sink != NULL && sink->canSplice() && _parser.getSinkBodyRemainder() > 0)
+        return receiveSplicedBody(sink);
+#endif // __42_LIKES_WASTING_CPU_CYCLES__
+
+    if ((length = read(_fileno, buffer, sizeof(buffer))) < 0)
+    {
+        if (SignalManager::shouldQuit())
+            return false;
+#ifndef __42_LIKES_WASTING_CPU_CYCLES__
+        if (errno == EAGAIN || errno == EWOULDBLOCK)
+            return false;
+#endif // __42_LIKES_WASTING_CPU_CYCLES__
+        throw std::runtime_error("Unable to read from client");
+    }
+
+    if (_waitingForClose)
+    {
+        // Discard anything the client still sends until it closes the connection as well
+        if (length == 0)
             markForCleanup();
-            return;
+        return length > 0;
+    }
+
+    if (length == 0)
+        throw std::runtime_error("End of stream");
+
+    // The client started its next request on a persistent connection
+    if (_isIdle)
+    {
+        _isIdle = false;
+        _timeout.start(TIMEOUT_REQUEST_MS);
+    }
+
+    Slice data(buffer, length);
+    if (!_parser.commit(data))
+    {
+        // Stop receiving a streamed CGI body while the script is behind on it, the script's
+        // timeout covers the wait
+        if (_isStreamingCgiBody && static_cast<CgiProcess *>(_cgi)->isInputCongested())
+        {
+            _timeout.stop();
+            _application._dispatcher.modify(_fileno, EPOLLHUP, this);
+            return false;
         }
+        return true;
+    }
 
-        if (length == 0)
-            throw std::runtime_error("End of stream");
+    // The request is complete, stop reading until its response was sent
+    serveRequests();
+    return false;
+}
+
+/* Moves a chunk of a raw body from the socket into the file of the given sink,
+   returns whether receiving should continue */
+bool HttpClient::receiveSplicedBody(UploadSink *sink)
+{
+    size_t length = sink->spliceBody(_fileno, _parser.getSinkBodyRemainder());
+    if (length == 0)
+        return false;
+    if (!_parser.commitSunkBody(length))
+        return true;
+
+    // The request is complete, stop reading until its response was sent
+    serveRequests();
+    return false;
+}
+
+/* Serves the request the parser has finished, followed by any pipelined requests that were
+   already received, as long as their responses can be queued */
+void HttpClient::serveRequests()
+{
+    do
+        serveRequest();
+    while (queueResponse() && _parser.commitPending());
+
+    // Leave further pipelined bytes in the socket until the queued responses were sent,
+    // a running CGI process notifies the client itself
+    if (_queuedResponses.empty() && _cgi != NULL && _response->getState() != HTTP_RESPONSE_FINALIZED)
+        _application._dispatcher.modify(_fileno, EPOLLHUP, this);
+    else
+        _application._dispatcher.modify(_fileno, EPOLLOUT | EPOLLHUP, this);
+
+    // The oldest response is sent first, so it dictates the timeout
+    if (!_queuedResponses.empty())
+        _timeout.start(_queuedResponses.front()->getTransferTimeout());
+}
+
+/* Stores the body of a PUT request with a `Content-Range` in the partial upload of the file it
+   routes to, returns whether that completed the file; otherwise the client was told how much
+   of the file was received */
+bool HttpClient::storeFileRange(const HttpRequest &request, const RoutingInfo &info, const ContentRange &range)
+{
+    if (!range.hasBody)
+    {
+        setupUploadOffsetResponse(202, C_SLICE("Accepted"), ResumableUpload::queryOffset(info.nodePath,
+            info.getLocalRoute()->uploadStateDirectory));
+        return false;
+    }
+
+    // The range must match the body exactly, so it's known to be complete once received
+    const HttpRequest::Header *contentLength = request.findHeader(C_SLICE("Content-Length"));
+    size_t length;
+    if (contentLength == NULL)
+        throw HttpException(411);
+    if (!Utility::parseSize(contentLength->getValue(), length) || length != range.length)
+        throw HttpException(400);
 
-        Slice data(buffer, length);
+    // Streamed ranges were appended while they arrived
+    if (_upload != NULL)
+        _upload->finish();
+    else
+    {
+        size_t offset = ResumableUpload::queryOffset(info.nodePath, info.getLocalRoute()->uploadStateDirectory);
+        if (offset != range.offset)
+        {
+            setupUploadOffsetResponse(409, C_SLICE("Conflict"), offset);
+            return false;
+        }
+        ResumableUpload upload(info.nodePath, range, info.getLocalRoute()->uploadStore,
+            info.getLocalRoute()->uploadStateDirectory);
+        upload.writeBody(Slice(request.body));
+        upload.finish();
+    }
+
+    if (range.hasTotal && range.offset + range.length == range.total)
+        return true;
+    setupUploadOffsetResponse(202, C_SLICE("Accepted"), range.offset + range.length);
+    return false;
+}
+
+/* Initializes the response object to tell the client how many bytes of its partial upload
+   were received, as the range of bytes it holds */
+void HttpClient::setupUploadOffsetResponse(size_t statusCode, Slice statusMessage, size_t offset)
+{
+    _response->initializeEmpty(statusCode, statusMessage);
+    if (offset > 0)
+        _response->addHeader(C_SLICE("Range"), "bytes=0-" + Utility::numberToString(offset - 1));
+    _timeout.start(_response->finalizeHeader());
+}
+
+/* Queues the finalized response so the next pipelined request can be served,
+   returns false if the connection can't continue with another request right now */
+bool HttpClient::queueResponse()
+{
+    if (!_keepAlive || _cgi != NULL || !_parser.hasPendingData())
+        return false;
+    if (_response->getState() != HTTP_RESPONSE_FINALIZED)
+        return false;
+    if (_queuedResponses.size() >= HTTP_CLIENT_MAX_QUEUED_RESPONSES)
+        return false;
+
+    _queuedResponses.push_back(_response);
+    if (_spareResponses.empty())
+        _response = new HttpResponse();
+    else
+    {
+        _response = _spareResponses.back();
+        _spareResponses.pop_back();
+    }
+
+    _parser.reset();
+    _config = _endpointConfig;
+    _keepAlive = false;
+    return true;
+}
+
+/* Serves the request the parser has finished, or responds with the parser's error */
+void HttpClient::serveRequest()
+{
+    _compression = NULL;
+    _acceptsGzip = false;
+    try
+    {
+        switch (_parser.getPhase())
+        {
+        case HTTP_REQUEST_HEADER_EXCEED:
+            throw HttpException(413);
+        case HTTP_REQUEST_BODY_EXCEED:
+            throw HttpException(413);
+        case HTTP_REQUEST_MALFORMED:
+            throw HttpException(400);
+        case HTTP_REQUEST_COMPLETED:
+        {
+            // Adjust the server configuration to match the requested server by its host
+            _config = findServerConfig(_parser.getRequest());
+
+            // Keep the connection open if the client wants to, unless it used up its requests
+            _requestCount++;
+            _keepAlive = _parser.getRequest().wantsKeepAlive()
+                && _config->keepAliveTimeout > 0
+                && _requestCount < _config->keepAliveRequests;
+            _response->setKeepAlive(_keepAlive);
+            _acceptsGzip = _parser.getRequest().acceptsEncoding(C_SLICE("gzip"));
+
+            handleRequest(_parser.getRequest());
+        }
+        default:
+            break;
+        }
+    } catch (HttpException &exception)
+    {
+        // A script that was fed the streamed body doesn't answer a failed request
+        if (_isStreamingCgiBody)
+            _application.closeCgiProcess(this);
+        createErrorResponse(exception.getStatusCode());
+    }
+
+    // The body of the request is done with, an incomplete upload removes its partial file and
+    // a started script holds its own reference to the spool
+    _isStreamingCgiBody = false;
+    delete _upload;
+    _upload = NULL;
+    delete _spool;
+    _spool = NULL;
+}
+
+/* Finds the virtual server the request is meant for by its host, the endpoint's first
+   server if there is no match */
+const ServerConfig *HttpClient::findServerConfig(const HttpRequest &request) const
+{
+    const HttpRequest::Header *host = request.findHeader(C_SLICE("Host"));
+    if (host == NULL)
+        return _endpointConfig;
+
+    Slice serverName = host->getValue();
+    Slice port;
+    serverName.splitEnd(':', port);
+    (void)port;
+    return _endpointConfig->findServer(serverName);
+}
+
+/* Streams the bodies of uploads into their files and spools long bodies of scripts as they
+   arrive, or feeds them to scripts started right away where the route asks for it; other
+   bodies are buffered */
+BodySink *HttpClient::selectBodySink(const HttpRequest &request)
+{
+    bool isPut = request.method == HTTP_METHOD_PUT;
+    if (!Utility::checkPathLevel(request.queryPath))
+        return NULL;
+
+    // Only bodies that are certain to be accepted are written as they arrive, the rest is
+    // decided once the request is complete
+    RoutingInfo info = RoutingInfo::findRoute(*findServerConfig(request), request.queryPath,
+        _application._responseCache, isPut);
+    if (info.status != ROUTING_STATUS_FOUND_LOCAL)
+        return NULL;
+    const LocalRouteConfig *route = info.getLocalRoute();
+    if (route->allowedMethods.count(request.method) == 0)
+        return NULL;
+    if (info.hasCgiInterpreter)
+    {
+        if (info.getLocalNodeType() != NODE_TYPE_REGULAR)
+            return NULL;
+
+        // Responses of pipelined requests are sent before a script may answer; FastCGI
+        // applications are sent the spooled body
+        if (route->streamCgiBody && info.fastCgiAddress == NULL && _queuedResponses.empty())
+            return startStreamingCgiProcess(request, info);
+        return selectBodySpool(request);
+    }
+    if (!route->allowUpload || (!isPut && request.method != HTTP_METHOD_POST))
+        return NULL;
+
+    delete _upload;
+    _upload = NULL;
+    if (isPut)
+    {
+        if (info.getLocalNodeType() == NODE_TYPE_DIRECTORY || Slice(request.queryPath).endsWith(C_SLICE("/")))
+            return NULL;
+
+        // Space for bodies of a known length is reserved up front
+        size_t length = 0;
+        const HttpRequest::Header *contentLength = request.findHeader(C_SLICE("Content-Length"));
+        if (contentLength != NULL && !Utility::parseSize(contentLength->getValue(), length))
+            length = 0;
+
+        // Errors are reported once the request is complete and the upload is tried again
+        ContentRange range;
+        RangeStatus rangeStatus = request.findContentRange(range);
         try
         {
-            if (_parser.commit(data))
-            {
-                switch (_parser.getPhase())
-                {
-                case HTTP_REQUEST_HEADER_EXCEED:
-                    throw HttpException(413);
-                case HTTP_REQUEST_BODY_EXCEED:
-                    throw HttpException(413);
-                case HTTP_REQUEST_MALFORMED:
-                    throw HttpException(400);
-                case HTTP_REQUEST_COMPLETED:
-                {
-                    // Adjust the server configuration to match the requested server by its host, taking the first one if not found
-                    const HttpRequest::Header *host = _parser.getRequest().findHeader(C_SLICE("Host"));
-                    if (host != NULL)
-                    {
-                        Slice serverName = host->getValue();
-                        Slice port;
-                        serverName.splitEnd(':', port);
-                        (void)port;
-                        _config = _config->findServer(serverName);
-                    }
-                    handleRequest(_parser.getRequest());
-                }
-                default:
-                    break;
-                }
-            }
-        } catch (HttpException &exception)
+            if (rangeStatus == RANGE_STATUS_NONE)
+                _upload = new FileUpload(info.nodePath, length, route->uploadStore);
+            else if (rangeStatus == RANGE_STATUS_SATISFIABLE && range.hasBody && contentLength != NULL
+             && length == range.length && !route->uploadStateDirectory.empty())
+                _upload = new ResumableUpload(info.nodePath, range, route->uploadStore,
+                    route->uploadStateDirectory);
+        }
+        catch (HttpException &)
         {
-            createErrorResponse(exception.getStatusCode());
+            return NULL;
         }
-#ifdef __42_LIKES_WASTING_CPU_CYCLES__
+        return _upload;
+    }
+
+    Slice boundary;
+    if (info.getLocalNodeType() != NODE_TYPE_DIRECTORY || !UploadHandler::extractBoundary(request, boundary))
+        return NULL;
+    _upload = new MultipartUpload(boundary, info.nodePath, route->uploadStore, _application._fileCache);
+    return _upload;
+}
+
+/* Spools the body of a script unless it's known to be short, returns the spool if any */
+BodySink *HttpClient::selectBodySpool(const HttpRequest &request)
+{
+    const HttpRequest::Header *contentLength = request.findHeader(C_SLICE("Content-Length"));
+    size_t length;
+    if (contentLength != NULL && Utility::parseSize(contentLength->getValue(), length)
+     && length <= BODY_SPOOL_THRESHOLD)
+        return NULL;
+
+    // Without a spool, the body is buffered and written to the script as before
+    delete _spool;
+    _spool = NULL;
+    try
+    {
+        _spool = new BodySpool(true);
+    }
+    catch (HttpException &)
+    {
+        return NULL;
+    }
+    return _spool;
+}
+
+/* Starts the script of a request whose body is fed to it while it arrives, returns the
+   script as the body's sink or NULL if it couldn't be started */
+BodySink *HttpClient::startStreamingCgiProcess(const HttpRequest &request, const RoutingInfo &info)
+{
+    // Failures are reported once the request is complete and the script is started again
+    try
+    {
+        _application.startCgiProcess(this, request, info, NULL, true);
+    }
+    catch (std::exception &)
+    {
+        return NULL;
+    }
+    _isStreamingCgiBody = true;
+    return static_cast<CgiProcess *>(_cgi);
+}
+
+/* Receives more of a streamed CGI body once the script took the bytes it was behind on */
+void HttpClient::resumeCgiBody()
+{
+    if (!_isStreamingCgiBody)
         return;
-#endif // __42_LIKES_WASTING_CPU_CYCLES__
+    _timeout.start(TIMEOUT_REQUEST_MS);
+    _application._dispatcher.modify(_fileno, EPOLLIN | EPOLLHUP, this);
+}
+
+/* Starts the response of the current request's script once its header was received, returns
+   whether the body is piped to the client as it's produced; otherwise it's buffered until
+   the script exits */
+bool HttpClient::startCgiResponse(Slice header)
+{
+    _response->initializePipedCgi(header);
+
+    // A body of unknown length can't be piped to a HTTP/1.0 client and neither can a compressed
+    // one, which is chunked; a script still reading its streamed body answers once the request
+    // is complete
+    bool acceptsChunked = !_parser.getRequest().isLegacy;
+    bool isCompressible = _compression != NULL && _response->isCompressible(*_compression);
+    if ((isCompressible && _acceptsGzip && !acceptsChunked) || _isStreamingCgiBody
+     || !_response->isPipeable(acceptsChunked))
+    {
+        _response->reset();
+        _response->setKeepAlive(_keepAlive);
+        return false;
     }
 
-    if (eventMask & EPOLLOUT)
+    // The body differs by the client's Accept-Encoding either way
+    if (isCompressible)
+    {
+        _response->addHeader(C_SLICE("Vary"), C_SLICE("Accept-Encoding"));
+        if (_acceptsGzip)
+            _response->compressPipedBody();
+    }
+    uint64_t timeout = _response->finalizeHeader();
+    if (_queuedResponses.empty())
+        _timeout.start(timeout);
+    _application._dispatcher.modify(_fileno, EPOLLOUT | EPOLLHUP, this);
+    return true;
+}
+
+/* Passes the next bytes of the script's piped body on to the client */
+void HttpClient::forwardCgiOutput(Slice data)
+{
+    _response->appendPipedBody(data);
+    if (_queuedResponses.empty())
+        _timeout.start(_response->getTransferTimeout());
+    _application._dispatcher.modify(_fileno, EPOLLOUT | EPOLLHUP, this);
+}
+
+/* Gets whether the client is too far behind on the script's piped body for more to be read */
+bool HttpClient::isCgiOutputCongested() const
+{
+    return _response->getBufferedLength() >= HTTP_CLIENT_CGI_BUFFER_SIZE;
+}
+
+/* Stores the body of a PUT request as the file it routes to */
+void HttpClient::storeFile(const HttpRequest &request, const RoutingInfo &info)
+{
+    if (!info.getLocalRoute()->allowUpload)
+        throw HttpException(403);
+    if (info.getLocalNodeType() == NODE_TYPE_DIRECTORY || Slice(request.queryPath).endsWith(C_SLICE("/")))
+        throw HttpException(409);
+    bool replaced = info.getLocalNodeType() == NODE_TYPE_REGULAR;
+
+    // Partial uploads are only kept in a state directory, a route without one refuses them
+    ContentRange range;
+    RangeStatus rangeStatus = request.findContentRange(range);
+    if (rangeStatus != RANGE_STATUS_NONE && info.getLocalRoute()->uploadStateDirectory.empty())
+        throw HttpException(400);
+    switch (rangeStatus)
     {
-        if (_response.hasData())
-            _response.transferToSocket(_fileno);
-        if (!_response.hasData())
+    case RANGE_STATUS_SATISFIABLE:
+        if (!storeFileRange(request, info, range))
+            return;
+        break;
+    case RANGE_STATUS_UNSATISFIABLE:
+        throw HttpException(400);
+    default:
+        // Streamed bodies were written while they arrived
+        if (_upload != NULL)
+            _upload->finish();
+        else
         {
-            // Do not directly close the connection after sending the response
-            // Switch back to read events and wait for the client to close the connection in
-            // and set a timeout so it doesn't linger
-            _timeout = Timeout(TIMEOUT_CLOSING_MS);
-            _application._dispatcher.modify(_fileno, EPOLLIN | EPOLLHUP, this);
-            _waitingForClose = true;
+            FileUpload upload(info.nodePath, request.body.size(), info.getLocalRoute()->uploadStore);
+            upload.writeBody(Slice(request.body));
+            upload.finish();
         }
+
+        // A complete file supersedes an earlier attempt to upload it in ranges
+        ResumableUpload::discard(info.nodePath, info.getLocalRoute()->uploadStateDirectory);
+        break;
     }
+
+    // The cache may still hold the file that was replaced
+    _application._fileCache.invalidate(info.nodePath);
+    if (replaced)
+        _response->initializeEmpty(204, C_SLICE("No Content"));
+    else
+        _response->initializeEmpty(201, C_SLICE("Created"));
+    _timeout.start(_response->finalizeHeader());
 }
 
 void HttpClient::handleRequest(const HttpRequest &request)
@@ -130,7 +722,8 @@ void HttpClient::handleRequest(const HttpRequest &request)
     if (!Utility::checkPathLevel(request.queryPath))
         throw std::runtime_error("Client tried to access above-root directory");
 
-    RoutingInfo info = info.findRoute(*_config, request.queryPath);
+    RoutingInfo info = info.findRoute(*_config, request.queryPath, _application._responseCache,
+        request.method == HTTP_METHOD_PUT);
 
     // HACK: For reusing the existing handling logic when the path must be changed
 repeat:
@@ -143,25 +736,48 @@ repeat:
         std::set<HttpMethod>::iterator it = info.getLocalRoute()->allowedMethods.find(request.method);
         if (it == info.getLocalRoute()->allowedMethods.end())
             throw HttpException(405);
+        if (info.getLocalRoute()->compression.enabled)
+            _compression = &info.getLocalRoute()->compression;
 
-        switch (info.getLocalNodeType())
+        // Scripts handle PUT requests themselves
+        if (request.method == HTTP_METHOD_PUT && !info.hasCgiInterpreter)
+            storeFile(request, info);
+        else switch (info.getLocalNodeType())
         {
         case NODE_TYPE_REGULAR:
             if (info.hasCgiInterpreter)
             {
-                _application.startCgiProcess(this, request, info);
-                _timeout.stop();
+                // A script fed the streamed body was started with the request's header
+                if (_isStreamingCgiBody)
+                {
+                    _isStreamingCgiBody = false;
+                    _timeout.stop();
+                    static_cast<CgiProcess *>(_cgi)->finishBody();
+                    handleCgiState();
+                }
+                else
+                {
+                    if (_spool != NULL)
+                        _spool->finish();
+                    if (info.fastCgiAddress != NULL)
+                        _application.startFastCgiRequest(this, request, info, _spool);
+                    else
+                        _application.startCgiProcess(this, request, info, _spool);
+                    _timeout.stop();
+                }
             }
             else if (request.method == HTTP_METHOD_DELETE)
             {
                  if (unlink(info.nodePath.c_str()) == -1)
                     throw HttpException(403);
-                _response.initializeEmpty(204, C_SLICE("No Content"));
-                _timeout = Timeout(_response.finalizeHeader());
+                _application._fileCache.invalidate(info.nodePath);
+                _response->initializeEmpty(204, C_SLICE("No Content"));
+                _timeout.start(_response->finalizeHeader());
             }
             else
             {
-                setupFileResponse(200, C_SLICE("OK"), info.nodePath);
+                setupFileResponse(200, C_SLICE("OK"), info.nodePath, &request,
+                    info.getLocalRoute()->servePrecompressed);
             }
             break;
         case NODE_TYPE_DIRECTORY:
@@ -169,28 +785,32 @@ repeat:
             {
                 if (info.getLocalRoute()->allowUpload)
                 {
-                    UploadHandler::handleUpload(request, info);
+                    // Streamed uploads were written while the body arrived
+                    if (_upload != NULL)
+                        _upload->finish();
+                    else
+                        UploadHandler::handleUpload(request, info, _application._fileCache);
 
                     // Redirect the client to the upload directory
-                    _response.initializeEmpty(303, C_SLICE("See Other"));
-                    _response.addHeader(C_SLICE("Location"), request.queryPath);
-                    _response.finalizeHeader();
+                    _response->initializeEmpty(303, C_SLICE("See Other"));
+                    _response->addHeader(C_SLICE("Location"), request.queryPath);
+                    _timeout.start(_response->finalizeHeader());
                 }
                 else
                     throw HttpException(403);
             }
             else if (!Slice(request.queryPath).endsWith(C_SLICE("/")))
             {
-                _response.initializeEmpty(301, C_SLICE("Moved Permanently"));
-                _response.addHeader(C_SLICE("Location"), Slice(request.queryPath + "/"));
-                _timeout = Timeout(_response.finalizeHeader());
+                _response->initializeEmpty(301, C_SLICE("Moved Permanently"));
+                _response->addHeader(C_SLICE("Location"), Slice(request.queryPath + "/"));
+                _timeout.start(_response->finalizeHeader());
             }
             else if (!info.getLocalRoute()->indexFile.empty())
             {
                 // HACK: Temporary solution for directory index access, refactor after the
                 //       whole handling logic is done
                 std::string newPath = request.queryPath + '/' + info.getLocalRoute()->indexFile;
-                info = RoutingInfo::findRoute(*_config, newPath);
+                info = RoutingInfo::findRoute(*_config, newPath, _application._responseCache);
                 // HACK: Prevent infinite loop on misconfigured server
                 if (info.status != ROUTING_STATUS_FOUND_LOCAL || info.getLocalNodeType() != NODE_TYPE_DIRECTORY)
                     goto repeat;
@@ -198,13 +818,17 @@ repeat:
             }
             else if (info.getLocalRoute()->allowListing)
             {
-                _response.initializeOwned(200, C_SLICE("OK"), HtmlGenerator::directoryList(info.nodePath.c_str()));
-                _response.addHeader(C_SLICE("Content-Type"), C_SLICE("text/html"));
-                _timeout = Timeout(_response.finalizeHeader());
+                _response->initializeOwned(200, C_SLICE("OK"), HtmlGenerator::directoryList(info.nodePath.c_str()));
+                _response->addHeader(C_SLICE("Content-Type"), C_SLICE("text/html"));
+                compressResponse();
+                _timeout.start(_response->finalizeHeader());
             }
             else
                 throw HttpException(403);
             break;
+        case NODE_TYPE_NOT_FOUND:
+            // Only reached by a PUT request for a script that doesn't exist
+            throw HttpException(404);
         default:
             break;
         }
@@ -222,25 +846,257 @@ repeat:
         Slice rewritePrefix = Slice(info.getRedirectRoute()->redirectLocation)
             .stripEnd('/');
 
-        _response.initializeEmpty(307, C_SLICE("Temporary Redirect"));
-        _response.addHeader(C_SLICE("Location"),  rewritePrefix.toString() + '/' + routeRelativeQuery.toString());
-        _timeout = Timeout(_response.finalizeHeader());
+        _response->initializeEmpty(307, C_SLICE("Temporary Redirect"));
+        _response->addHeader(C_SLICE("Location"),  rewritePrefix.toString() + '/' + routeRelativeQuery.toString());
+        _timeout.start(_response->finalizeHeader());
     }
 
-    if (_response.getState() != HTTP_RESPONSE_FINALIZED && _process == NULL)
+    if (_response->getState() != HTTP_RESPONSE_FINALIZED && _cgi == NULL)
         throw HttpException(500);
-    if (_process == NULL)
+    if (_cgi == NULL)
         _application._dispatcher.modify(_fileno, EPOLLOUT | EPOLLHUP, this);
 }
 
-void HttpClient::setupFileResponse(size_t statusCode, Slice statusMessage, const std::string &path)
+/* Initializes the response object to use a static file, the file's validators are added and
+   evaluated against the preconditions and ranges of `request` if one is given; precompressed
+   siblings of the file are served to accepting clients if `negotiateEncoding` is set */
+void HttpClient::setupFileResponse(size_t statusCode, Slice statusMessage, const std::string &path,
+    const HttpRequest *request, bool negotiateEncoding)
 {
-    std::string mimeType = g_mimeDB.getMimeType(path);
+    FileRepresentation representation;
+    representation.path = path;
+    representation.filePath = path;
+    if (request != NULL && negotiateEncoding)
+        selectPrecompressed(*request, representation);
+
+    // Files of the route's compressed types vary by the client's encodings unless a precompressed
+    // sibling was chosen already
+    bool compressible = request != NULL && _compression != NULL
+        && (representation.contentCoding.empty() || representation.contentCoding == "identity")
+        && _compression->allowsType(g_mimeDB.getMimeType(path));
+    if (compressible)
+        representation.contentCoding = "identity";
+
+    std::vector<ByteRange> ranges;
+#ifdef __42_LIKES_WASTING_CPU_CYCLES__
+    // The file stream doesn't expose the file's metadata
+    struct stat status;
+    if (request == NULL || stat(representation.filePath.c_str(), &status) != 0)
+    {
+        _response->initializeFileStream(statusCode, statusMessage, path.c_str());
+        _response->addHeader(C_SLICE("Content-Type"), g_mimeDB.getMimeType(path));
+        _timeout.start(_response->finalizeHeader());
+        return;
+    }
+
+    representation.size = status.st_size;
+    representation.modificationTime = status.st_mtime;
+    representation.entityTag = HttpResponse::formatEntityTag(status.st_ino, status.st_size, status.st_mtime);
+    if (!selectFileRanges(*request, representation, ranges))
+        return;
 
     // Setup a file stream response
-    _response.initializeFileStream(statusCode, statusMessage, path.c_str());
-    _response.addHeader(C_SLICE("Content-Type"), mimeType);
-    _timeout = Timeout(_response.finalizeHeader());
+    const char *filePath = representation.filePath.c_str();
+    if (ranges.size() > 1)
+        _response->initializeFileStreamRanges(filePath, representation.size, g_mimeDB.getMimeType(path), ranges);
+    else if (ranges.size() == 1)
+        _response->initializeFileStream(206, C_SLICE("Partial Content"), filePath, &ranges[0]);
+    else
+        _response->initializeFileStream(statusCode, statusMessage, filePath);
+    addFileHeaders(representation, ranges);
+    _timeout.start(_response->finalizeHeader());
+#else
+    // Whole files are compressed for clients accepting gzip, ranges are taken from the file itself
+    bool compress = compressible && _acceptsGzip && request->findHeader(C_SLICE("Range")) == NULL;
+
+    // Serve small files from an already rendered response unless the client's copy may be current
+    // or only parts of the file are wanted
+    if (request == NULL || (!compress && !request->isConditional() && request->findHeader(C_SLICE("Range")) == NULL))
+    {
+        CachedResponse *cached = _application._responseCache.find(representation.filePath, statusCode,
+            _keepAlive, representation.contentCoding);
+        if (cached != NULL)
+        {
+            _response->initializeCached(cached);
+            _timeout.start(_response->getTransferTimeout());
+            return;
+        }
+    }
+
+    CachedFile *file = _application._fileCache.open(representation.filePath);
+    if (file == NULL)
+        throw HttpException(500);
+    representation.size = file->getSize();
+    representation.modificationTime = file->getModificationTime();
+    if (compress && file->getSize() >= _compression->minLength && file->getSize() <= GZIP_CACHE_MAX_FILE_SIZE)
+    {
+        setupCompressedFileResponse(statusCode, statusMessage, *request, representation, file);
+        return;
+    }
+    if (request != NULL)
+    {
+        representation.entityTag = HttpResponse::formatEntityTag(file->getInode(), file->getSize(),
+            file->getModificationTime());
+        if (!selectFileRanges(*request, representation, ranges))
+        {
+            file->release();
+            return;
+        }
+    }
+
+    // Multiple ranges are copied out of the file, otherwise it is sent from its descriptor
+    if (ranges.size() > 1)
+    {
+        _response->initializeFileRanges(*file, g_mimeDB.getMimeType(path), ranges);
+        file->release();
+    }
+    else if (ranges.size() == 1)
+        _response->initializeFile(206, C_SLICE("Partial Content"), file, &ranges[0]);
+    else
+        _response->initializeFile(statusCode, statusMessage, file);
+    if (request != NULL)
+        addFileHeaders(representation, ranges);
+    else
+        _response->addHeader(C_SLICE("Content-Type"), g_mimeDB.getMimeType(path));
+    _timeout.start(_response->finalizeHeader());
+
+    // Render the whole file's response for the following requests of it
+    if (ranges.empty() && _application._responseCache.accepts(representation.size))
+    {
+        _application._responseCache.insert(representation.filePath, statusCode, _keepAlive,
+            representation.contentCoding, _response->getHeader(), *file);
+    }
+#endif // __42_LIKES_WASTING_CPU_CYCLES__
+}
+
+/* Initializes the response object to use the gzip-compressed copy of an opened static file,
+   whose reference is taken over; the copy is a variant with its own entity tag */
+void HttpClient::setupCompressedFileResponse(size_t statusCode, Slice statusMessage, const HttpRequest &request,
+    FileRepresentation &representation, CachedFile *file)
+{
+    // The copy's tag is told apart from the file's by a suffix within the quotes
+    CompressedFile *compressed;
+    try
+    {
+        representation.entityTag = HttpResponse::formatEntityTag(file->getInode(), file->getSize(),
+            file->getModificationTime());
+        representation.entityTag.insert(representation.entityTag.size() - 1, "-gzip");
+        compressed = _application._gzipCache.compress(representation.filePath, *file);
+    }
+    catch (...)
+    {
+        file->release();
+        throw;
+    }
+    file->release();
+
+    representation.contentCoding = "gzip";
+    representation.size = compressed->getData().getLength();
+
+    std::vector<ByteRange> ranges;
+    if (!selectFileRanges(request, representation, ranges))
+    {
+        compressed->release();
+        return;
+    }
+    _response->initializeCompressed(statusCode, statusMessage, compressed);
+    addFileHeaders(representation, ranges);
+    _timeout.start(_response->finalizeHeader());
+}
+
+/* Picks the most preferred precompressed sibling of the file that the client accepts, the
+   content coding is "identity" if there is none */
+void HttpClient::selectPrecompressed(const HttpRequest &request, FileRepresentation &representation)
+{
+    size_t count = sizeof(g_precompressedCodings) / sizeof(g_precompressedCodings[0]);
+    for (size_t index = 0; index < count; index++)
+    {
+        const char *coding = g_precompressedCodings[index][0];
+        std::string siblingPath = representation.path + g_precompressedCodings[index][1];
+        if (request.acceptsEncoding(Slice(coding, std::strlen(coding)))
+         && _application._responseCache.queryNodeType(siblingPath) == NODE_TYPE_REGULAR)
+        {
+            representation.filePath = siblingPath;
+            representation.contentCoding = coding;
+            return;
+        }
+    }
+    representation.contentCoding = "identity";
+}
+
+/* Evaluates the request's preconditions and ranges against a file's version, either sets up a
+   complete 304 or 416 response and returns false, or stores the ranges to send (none for the
+   whole file) and returns true */
+bool HttpClient::selectFileRanges(const HttpRequest &request, const FileRepresentation &representation,
+    std::vector<ByteRange> &outRanges)
+{
+    if (request.isNotModified(representation.entityTag, representation.modificationTime))
+    {
+        _response->initializeEmpty(304, C_SLICE("Not Modified"));
+        _response->addHeader(C_SLICE("ETag"), representation.entityTag);
+        _response->addHeader(C_SLICE("Last-Modified"), Utility::formatHttpDate(representation.modificationTime));
+        if (!representation.contentCoding.empty())
+            _response->addHeader(C_SLICE("Vary"), C_SLICE("Accept-Encoding"));
+        _timeout.start(_response->finalizeHeader());
+        return false;
+    }
+
+    switch (request.findRanges(representation.size, representation.entityTag, representation.modificationTime, outRanges))
+    {
+    case RANGE_STATUS_UNSATISFIABLE:
+        _response->initializeOwned(416, g_errorDB.getErrorType(416), HtmlGenerator::errorPage(416));
+        _response->addHeader(C_SLICE("Content-Type"), C_SLICE("text/html"));
+        _response->addHeader(C_SLICE("Content-Range"), Slice("bytes */" + Utility::numberToString(representation.size)));
+        _timeout.start(_response->finalizeHeader());
+        return false;
+    case RANGE_STATUS_SATISFIABLE:
+    {
+        // Too much data for a multipart body makes the Range header be ignored, sending ranges far
+        // apart as a single one would send everything between them
+        size_t length = 0;
+        for (size_t index = 0; index < outRanges.size(); index++)
+            length += outRanges[index].length;
+        if (outRanges.size() > 1 && length > HTTP_RESPONSE_MAX_MULTIPART_LENGTH)
+            outRanges.clear();
+        return true;
+    }
+    default:
+        return true;
+    }
+}
+
+/* Adds the header fields describing a static file's type, encoding, version and the range
+   being sent */
+void HttpClient::addFileHeaders(const FileRepresentation &representation, const std::vector<ByteRange> &ranges)
+{
+    // Each part of a multipart body describes its own type and range
+    if (ranges.size() <= 1)
+        _response->addHeader(C_SLICE("Content-Type"), g_mimeDB.getMimeType(representation.path));
+    if (ranges.size() == 1)
+        _response->addHeader(C_SLICE("Content-Range"), HttpResponse::formatContentRange(ranges[0], representation.size));
+
+    // Caches must tell apart the encodings of negotiated files
+    if (!representation.contentCoding.empty() && representation.contentCoding != "identity")
+        _response->addHeader(C_SLICE("Content-Encoding"), representation.contentCoding);
+    if (!representation.contentCoding.empty())
+        _response->addHeader(C_SLICE("Vary"), C_SLICE("Accept-Encoding"));
+
+    _response->addHeader(C_SLICE("ETag"), representation.entityTag);
+    _response->addHeader(C_SLICE("Last-Modified"), Utility::formatHttpDate(representation.modificationTime));
+    _response->addHeader(C_SLICE("Accept-Ranges"), C_SLICE("bytes"));
+}
+
+/* Compresses the in-memory body of the initialized response if the route compresses bodies
+   of its type and length and the client accepts gzip */
+void HttpClient::compressResponse()
+{
+    if (_compression == NULL || !_response->isCompressible(*_compression))
+        return;
+
+    // The body differs by the client's Accept-Encoding either way
+    _response->addHeader(C_SLICE("Vary"), C_SLICE("Accept-Encoding"));
+    if (_acceptsGzip)
+        _response->compressBody();
 }
 
 /* Handles an exception that occurred in `handleEvent()` */
@@ -251,28 +1107,78 @@ void HttpClient::handleException(const char *message)
     markForCleanup();
 }
 
+/* Drops the client when it didn't make progress in time */
+void HttpClient::handleTimeout()
+{
+    markForCleanup();
+}
+
 void HttpClient::handleCgiState()
 {
-    if (_process == NULL)
+    if (_cgi == NULL)
         return;
-    switch (_process->getState())
+
+    // A script that ended before its streamed body did is answered once the rest of the body
+    // was received and discarded
+    if (_isStreamingCgiBody && _cgi->getState() != CGI_PROCESS_RUNNING)
+    {
+        _cgi->unsubscribe();
+        resumeCgiBody();
+        return;
+    }
+
+    switch (_cgi->getState())
     {
         case CGI_PROCESS_RUNNING:
             break;
         case CGI_PROCESS_SUCCESS:
         {
-            _response.initializeUnownedCgi(Slice(_process->_buffer));
-            _timeout = Timeout(_response.finalizeHeader());
-            _application._dispatcher.unsubscribe(_process->getProcess().getOutputFileno());
-            _process->_subscribeFlags &= ~SUBSCRIBE_FLAG_OUTPUT;
+            // A piped body ends with the script, one that fell short of its declared length can
+            // only be told by closing the connection
+            if (_response->isAwaitingBody())
+            {
+                _cgi->unsubscribe();
+                if (!_response->endPipedBody())
+                {
+                    markForCleanup();
+                    break;
+                }
+                if (_queuedResponses.empty())
+                    _timeout.start(_response->getTransferTimeout());
+                _application._dispatcher.modify(_fileno, EPOLLOUT | EPOLLHUP, this);
+                break;
+            }
+
+            // Queued responses are sent first and keep their own timeout
+            CachedFile *spilledBody = _cgi->takeSpilledBody();
+            if (spilledBody != NULL)
+                _response->initializeSpilledCgi(Slice(_cgi->_buffer), spilledBody);
+            else
+                _response->initializeUnownedCgi(Slice(_cgi->_buffer));
+            compressResponse();
+            uint64_t timeout = _response->finalizeHeader();
+            if (_queuedResponses.empty())
+                _timeout.start(timeout);
+            _cgi->unsubscribe();
             _application._dispatcher.modify(_fileno, EPOLLOUT | EPOLLHUP, this);
         }
         break;
         case CGI_PROCESS_FAILURE:
+            // The header of a piped body was sent already, so its response can only be cut off
+            if (_response->isAwaitingBody())
+            {
+                markForCleanup();
+                break;
+            }
             _application.closeCgiProcess(this);
             createErrorResponse(502);
             break;
         case CGI_PROCESS_TIMEOUT:
+            if (_response->isAwaitingBody())
+            {
+                markForCleanup();
+                break;
+            }
             _application.closeCgiProcess(this);
             createErrorResponse(504);
             break;
@@ -316,9 +1222,10 @@ void HttpClient::createErrorResponse(size_t statusCode)
         std::string errorPage = HtmlGenerator::errorPage(statusCode);
 
         // Build the response and set its timeout
-        _response.initializeOwned(statusCode, errorMessage, errorPage);
-        _response.addHeader(C_SLICE("Content-Type"), C_SLICE("text/html"));
-        _timeout = Timeout(_response.finalizeHeader());
+        _response->initializeOwned(statusCode, errorMessage, errorPage);
+        _response->addHeader(C_SLICE("Content-Type"), C_SLICE("text/html"));
+        compressResponse();
+        _timeout.start(_response->finalizeHeader());
     }
 
     // Switch the dispatcher to POLLOUT
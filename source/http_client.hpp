@@ -9,17 +9,35 @@
 #include "routing.hpp"
 #include "http_response.hpp"
 #include "http_request_parser.hpp"
+#include "upload_handler.hpp"
 
+#include <deque>
+#include <vector>
 #include <stdint.h>
 
+/* Maximum number of pipelined responses that are queued ahead of the current one */
+#define HTTP_CLIENT_MAX_QUEUED_RESPONSES 16
+
+/* Maximum number of buffers that are gathered into a single write */
+#define HTTP_CLIENT_MAX_GATHERED_BUFFERS 64
+
+/* Number of unsent bytes of a piped CGI body at which reading the script's output pauses */
+#define HTTP_CLIENT_CGI_BUFFER_SIZE 65536
+
 class Application;
+class CgiBackend;
 class CgiProcess;
+class FastCgiRequest;
+class FastCgiConnection;
 
-class HttpClient: public Sink
+class HttpClient: public Sink, public TimeoutSink, public BodySinkSelector
 {
 public:
     friend class Application;
+    friend class CgiBackend;
     friend class CgiProcess;
+    friend class FastCgiRequest;
+    friend class FastCgiConnection;
 
     /* Constructs a HTTP client using the given socket file descriptor */
     HttpClient(Application &application, const ServerConfig *config, int fileno, uint32_t host, uint16_t port);
@@ -39,7 +57,19 @@ public:
         return _timeout;
     }
 private:
+    /* The version of a static file that is selected for a response */
+    struct FileRepresentation
+    {
+        std::string path;          // Requested file, which determines the content type
+        std::string filePath;      // Sent file, a precompressed sibling of `path` when encoded
+        std::string contentCoding; // Negotiated content coding, empty if not negotiated
+        size_t      size;
+        std::string entityTag;
+        time_t      modificationTime;
+    };
+
     Application        &_application;
+    const ServerConfig *_endpointConfig;
     const ServerConfig *_config;
     int                 _fileno;
     Timeout             _timeout;
@@ -48,24 +78,145 @@ private:
     HttpClient         *_cleanupNext;
     bool                _waitingForClose;
     bool                _markedForCleanup;
-    CgiProcess         *_process;
+    bool                _keepAlive;
+    bool                _isIdle;
+    size_t              _requestCount;
+    CgiBackend         *_cgi;
+    bool                _isStreamingCgiBody;
     uint32_t            _host;
     uint16_t            _port;
     HttpRequestParser   _parser;
-    HttpResponse        _response;
+    HttpResponse       *_response;
+    UploadSink         *_upload;
+    BodySpool          *_spool;
+
+    // Compression settings of the current request's route (NULL if it doesn't compress) and
+    // whether the client accepts gzip
+    const CompressionConfig *_compression;
+    bool                     _acceptsGzip;
+
+    // Finished responses of pipelined requests, sent in order before `_response`
+    std::deque<HttpResponse *>  _queuedResponses;
+    std::vector<HttpResponse *> _spareResponses;
 
     /* Handles one or multiple events */
     void handleEvents(uint32_t eventMask);
 
+    /* Reads and parses a chunk of request data, returns whether reading should continue */
+    bool receiveData();
+
+    /* Moves a chunk of a raw body from the socket into the file of the given sink,
+       returns whether receiving should continue */
+    bool receiveSplicedBody(UploadSink *sink);
+
+    /* Serves the request the parser has finished, followed by any pipelined requests that were
+       already received, as long as their responses can be queued */
+    void serveRequests();
+
+    /* Serves the request the parser has finished, or responds with the parser's error */
+    void serveRequest();
+
+    /* Finds the virtual server the request is meant for by its host, the endpoint's first
+       server if there is no match */
+    const ServerConfig *findServerConfig(const HttpRequest &request) const;
+
+    /* Streams the bodies of uploads into their files and spools long bodies of scripts as they
+       arrive, or feeds them to scripts started right away where the route asks for it; other
+       bodies are buffered */
+    BodySink *selectBodySink(const HttpRequest &request);
+
+    /* Spools the body of a script unless it's known to be short, returns the spool if any */
+    BodySink *selectBodySpool(const HttpRequest &request);
+
+    /* Starts the script of a request whose body is fed to it while it arrives, returns the
+       script as the body's sink or NULL if it couldn't be started */
+    BodySink *startStreamingCgiProcess(const HttpRequest &request, const RoutingInfo &info);
+
+    /* Receives more of a streamed CGI body once the script took the bytes it was behind on */
+    void resumeCgiBody();
+
+    /* Starts the response of the current request's script once its header was received, returns
+       whether the body is piped to the client as it's produced; otherwise it's buffered until
+       the script exits */
+    bool startCgiResponse(Slice header);
+
+    /* Passes the next bytes of the script's piped body on to the client */
+    void forwardCgiOutput(Slice data);
+
+    /* Gets whether the client is too far behind on the script's piped body for more to be read */
+    bool isCgiOutputCongested() const;
+
+    /* Stores the body of a PUT request as the file it routes to */
+    void storeFile(const HttpRequest &request, const RoutingInfo &info);
+
+    /* Stores the body of a PUT request with a `Content-Range` in the partial upload of the file it
+       routes to, returns whether that completed the file; otherwise the client was told how much
+       of the file was received */
+    bool storeFileRange(const HttpRequest &request, const RoutingInfo &info, const ContentRange &range);
+
+    /* Initializes the response object to tell the client how many bytes of its partial upload
+       were received, as the range of bytes it holds */
+    void setupUploadOffsetResponse(size_t statusCode, Slice statusMessage, size_t offset);
+
+    /* Queues the finalized response so the next pipelined request can be served,
+       returns false if the connection can't continue with another request right now */
+    bool queueResponse();
+
+    /* Sends the next part of the queued and current responses, returns the number of bytes
+       sent which is zero if the socket would block or there is nothing to send */
+    size_t transferResponses();
+
+    /* Sends the in-memory data of consecutive responses with a single system call,
+       returns the number of bytes sent which is zero if the socket would block */
+    size_t gatherResponsesToSocket();
+
+    /* Continues with the connection once every finalized response was sent */
+    void finishResponses();
+
+    /* Prepares the connection for the client's next request after a response was sent */
+    void prepareNextRequest();
+
+    /* Stops sending and waits for the client to close the connection after a response was sent */
+    void closeGracefully();
+
     /* Handles the request*/
     void handleRequest(const HttpRequest &request); // take reference for all the requests
 
-    /* Initializes the response object to use a static file */
-    void setupFileResponse(size_t statusCode, Slice statusMessage, const std::string &path);
+    /* Initializes the response object to use a static file, the file's validators are added and
+       evaluated against the preconditions and ranges of `request` if one is given; precompressed
+       siblings of the file are served to accepting clients if `negotiateEncoding` is set */
+    void setupFileResponse(size_t statusCode, Slice statusMessage, const std::string &path,
+        const HttpRequest *request = NULL, bool negotiateEncoding = false);
+
+    /* Initializes the response object to use the gzip-compressed copy of an opened static file,
+       whose reference is taken over; the copy is a variant with its own entity tag */
+    void setupCompressedFileResponse(size_t statusCode, Slice statusMessage, const HttpRequest &request,
+        FileRepresentation &representation, CachedFile *file);
+
+    /* Picks the most preferred precompressed sibling of the file that the client accepts, the
+       content coding is "identity" if there is none */
+    void selectPrecompressed(const HttpRequest &request, FileRepresentation &representation);
+
+    /* Evaluates the request's preconditions and ranges against a file's version, either sets up a
+       complete 304 or 416 response and returns false, or stores the ranges to send (none for the
+       whole file) and returns true */
+    bool selectFileRanges(const HttpRequest &request, const FileRepresentation &representation,
+        std::vector<ByteRange> &outRanges);
+
+    /* Adds the header fields describing a static file's type, encoding, version and the range
+       being sent */
+    void addFileHeaders(const FileRepresentation &representation, const std::vector<ByteRange> &ranges);
+
+    /* Compresses the in-memory body of the initialized response if the route compresses bodies
+       of its type and length and the client accepts gzip */
+    void compressResponse();
 
     /* Handles an exception that occurred in `handleEvent()` */
     void handleException(const char *message);
 
+    /* Drops the client when it didn't make progress in time */
+    void handleTimeout();
+
     /* Handles a CGI process event */
     void handleCgiState();
 
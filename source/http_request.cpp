@@ -1,4 +1,26 @@
 #include "http_request.hpp"
+#include "utility.hpp"
+
+#include <algorithm>
+
+/* Orders byte ranges by their offset */
+static bool compareRanges(const ByteRange &first, const ByteRange &second)
+{
+    return first.offset < second.offset;
+}
+
+/* Checks whether a quality value (eg. "0.000") rules out what it is attached to */
+static bool isZeroWeight(Slice weight)
+{
+    if (weight.isEmpty() || weight[0] != '0')
+        return false;
+    for (size_t index = 1; index < weight.getLength(); index++)
+    {
+        if (weight[index] != '.' && weight[index] != '0')
+            return false;
+    }
+    return true;
+}
 
 /* Constructs a HTTP header pair using its key and value */
 HttpRequest::Header::Header(const std::string &key, const std::string &value)
@@ -14,7 +36,9 @@ bool HttpRequest::Header::matchKey(Slice key) const
         return false;
     for (size_t index = 0; index < key.getLength(); index++)
     {
-        if (std::tolower(_key[index]) != std::tolower(key[index]))
+        // Bytes from 0x80 on are negative as a `char`, which `tolower()` doesn't accept
+        if (std::tolower(static_cast<unsigned char>(_key[index]))
+         != std::tolower(static_cast<unsigned char>(key[index])))
             return false;
     }
     return true;
@@ -30,3 +54,238 @@ const HttpRequest::Header *HttpRequest::findHeaderIn(const std::vector<Header> &
     }
     return NULL;
 }
+
+/* Case-invariantly checks whether the `Connection` header lists the given option */
+bool HttpRequest::hasConnectionOption(Slice option) const
+{
+    const Header *connection = findHeader(C_SLICE("Connection"));
+    if (connection == NULL)
+        return false;
+
+    // Walk the comma-separated list of options
+    Slice options(connection->getValue());
+    while (!options.isEmpty())
+    {
+        Slice current;
+        if (!options.splitStart(',', current))
+        {
+            current = options;
+            options = Slice();
+        }
+        current.stripStart(' ').stripEnd(' ');
+        if (current.equalsIgnoreCase(option))
+            return true;
+    }
+    return false;
+}
+
+/* Evaluates `If-None-Match` and `If-Modified-Since` against the selected file's validators,
+   returns true if the client's copy is current and a 304 response should be sent */
+bool HttpRequest::isNotModified(Slice entityTag, time_t modificationTime) const
+{
+    if (method != HTTP_METHOD_GET && method != HTTP_METHOD_HEAD)
+        return false;
+
+    // Entity tags take precedence over the modification date and are compared weakly
+    const Header *noneMatch = findHeader(C_SLICE("If-None-Match"));
+    if (noneMatch != NULL)
+    {
+        Slice tags(noneMatch->getValue());
+        while (!tags.isEmpty())
+        {
+            Slice current;
+            if (!tags.splitStart(',', current))
+            {
+                current = tags;
+                tags = Slice();
+            }
+            current.stripStart(' ').stripEnd(' ');
+            current.consumeStart(C_SLICE("W/"));
+            if (current == C_SLICE("*") || current == entityTag)
+                return true;
+        }
+        return false;
+    }
+
+    // Dates that can't be parsed are ignored
+    const Header *modifiedSince = findHeader(C_SLICE("If-Modified-Since"));
+    time_t since;
+    if (modifiedSince == NULL || !Utility::parseHttpDate(modifiedSince->getValue(), since))
+        return false;
+    return modificationTime <= since;
+}
+
+/* Checks whether `Accept-Encoding` allows the given content coding */
+bool HttpRequest::acceptsEncoding(Slice coding) const
+{
+    // Without the header any coding would do, but clients that don't send it rarely decode
+    const Header *acceptEncoding = findHeader(C_SLICE("Accept-Encoding"));
+    if (acceptEncoding == NULL)
+        return false;
+
+    bool acceptsAny = false;
+    Slice codings(acceptEncoding->getValue());
+    while (!codings.isEmpty())
+    {
+        Slice current;
+        if (!codings.splitStart(',', current))
+        {
+            current = codings;
+            codings = Slice();
+        }
+
+        // The weight is the only parameter, zero rules the coding out
+        Slice name;
+        if (!current.splitStart(';', name))
+        {
+            name = current;
+            current = Slice();
+        }
+        name.stripStart(' ').stripEnd(' ');
+        current.stripStart(' ').stripEnd(' ');
+        bool isAcceptable = true;
+        if (current.consumeStart(C_SLICE("q=")) || current.consumeStart(C_SLICE("Q=")))
+            isAcceptable = !isZeroWeight(current);
+
+        if (name.equalsIgnoreCase(coding))
+            return isAcceptable;
+        if (name == C_SLICE("*"))
+            acceptsAny = isAcceptable;
+    }
+    return acceptsAny;
+}
+
+/* Evaluates `Range` and `If-Range` for a file of the given size and validators, the satisfiable
+   ranges are stored sorted and with overlapping or adjacent ones merged */
+RangeStatus HttpRequest::findRanges(size_t size, Slice entityTag, time_t modificationTime,
+    std::vector<ByteRange> &outRanges) const
+{
+    outRanges.clear();
+    const Header *range = findHeader(C_SLICE("Range"));
+    if (method != HTTP_METHOD_GET || range == NULL)
+        return RANGE_STATUS_NONE;
+
+    // Ranges of another version of the file are useless, the whole file is sent instead
+    const Header *ifRange = findHeader(C_SLICE("If-Range"));
+    if (ifRange != NULL)
+    {
+        Slice validator(ifRange->getValue());
+        time_t date;
+        if (validator.startsWith(C_SLICE("\"")))
+        {
+            if (validator != entityTag)
+                return RANGE_STATUS_NONE;
+        }
+        else if (!Utility::parseHttpDate(validator, date) || date != modificationTime)
+            return RANGE_STATUS_NONE;
+    }
+
+    // Headers that can't be parsed are ignored as a whole
+    Slice specifiers(range->getValue());
+    if (!specifiers.consumeStart(C_SLICE("bytes=")))
+        return RANGE_STATUS_NONE;
+    size_t count = 0;
+    while (!specifiers.isEmpty())
+    {
+        Slice current;
+        if (!specifiers.splitStart(',', current))
+        {
+            current = specifiers;
+            specifiers = Slice();
+        }
+        current.stripStart(' ').stripEnd(' ');
+        if (current.isEmpty())
+            continue;
+        if (++count > HTTP_REQUEST_MAX_RANGES)
+            return RANGE_STATUS_NONE;
+
+        Slice first;
+        size_t start, end;
+        if (!current.splitStart('-', first))
+            return RANGE_STATUS_NONE;
+        if (first.isEmpty())
+        {
+            // A suffix range selects the file's last bytes
+            size_t suffix;
+            if (!Utility::parseSize(current, suffix))
+                return RANGE_STATUS_NONE;
+            if (suffix == 0 || size == 0)
+                continue;
+            start = suffix < size ? size - suffix : 0;
+            end = size - 1;
+        }
+        else
+        {
+            // The end is optional and clamped to the file's last byte
+            if (!Utility::parseSize(first, start))
+                return RANGE_STATUS_NONE;
+            end = SIZE_MAX;
+            if (!current.isEmpty() && (!Utility::parseSize(current, end) || end < start))
+                return RANGE_STATUS_NONE;
+            if (start >= size)
+                continue;
+            if (end >= size)
+                end = size - 1;
+        }
+
+        ByteRange byteRange;
+        byteRange.offset = start;
+        byteRange.length = end - start + 1;
+        outRanges.push_back(byteRange);
+    }
+    if (count == 0)
+        return RANGE_STATUS_NONE;
+    if (outRanges.empty())
+        return RANGE_STATUS_UNSATISFIABLE;
+
+    // Merge ranges that overlap or are barely apart, sending the gap is cheaper than another part
+    std::sort(outRanges.begin(), outRanges.end(), compareRanges);
+    size_t last = 0;
+    for (size_t index = 1; index < outRanges.size(); index++)
+    {
+        ByteRange &previous = outRanges[last];
+        const ByteRange &current = outRanges[index];
+        if (current.offset <= previous.offset + previous.length + HTTP_REQUEST_RANGE_MERGE_GAP)
+            previous.length = std::max(previous.length, current.offset + current.length - previous.offset);
+        else
+            outRanges[++last] = current;
+    }
+    outRanges.resize(last + 1);
+    return RANGE_STATUS_SATISFIABLE;
+}
+
+/* Evaluates `Content-Range` of a PUT request, a header that can't be parsed or that
+   contradicts itself is unsatisfiable */
+RangeStatus HttpRequest::findContentRange(ContentRange &outRange) const
+{
+    const Header *range = findHeader(C_SLICE("Content-Range"));
+    if (method != HTTP_METHOD_PUT || range == NULL)
+        return RANGE_STATUS_NONE;
+
+    // Either "bytes <first>-<last>/<total>" or "bytes */<total>", the total may be unknown
+    Slice value(range->getValue());
+    Slice bytes;
+    if (!value.consumeStart(C_SLICE("bytes ")) || !value.splitStart('/', bytes))
+        return RANGE_STATUS_UNSATISFIABLE;
+    outRange.hasTotal = value != C_SLICE("*");
+    if (outRange.hasTotal && !Utility::parseSize(value, outRange.total))
+        return RANGE_STATUS_UNSATISFIABLE;
+
+    outRange.hasBody = bytes != C_SLICE("*");
+    outRange.offset = 0;
+    outRange.length = 0;
+    if (!outRange.hasBody)
+        return outRange.hasTotal ? RANGE_STATUS_SATISFIABLE : RANGE_STATUS_UNSATISFIABLE;
+
+    Slice first;
+    size_t end;
+    if (!bytes.splitStart('-', first)
+     || !Utility::parseSize(first, outRange.offset)
+     || !Utility::parseSize(bytes, end)
+     || end < outRange.offset || end == SIZE_MAX)
+        return RANGE_STATUS_UNSATISFIABLE;
+    if (outRange.hasTotal && end >= outRange.total)
+        return RANGE_STATUS_UNSATISFIABLE;
+    outRange.length = end - outRange.offset + 1;
+    return RANGE_STATUS_SATISFIABLE;
+}
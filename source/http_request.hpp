@@ -8,6 +8,39 @@
 #include <vector>
 #include <stddef.h>
 #include <stdint.h>
+#include <time.h>
+
+/* The most ranges a request may ask for before its `Range` header is ignored */
+#define HTTP_REQUEST_MAX_RANGES 64
+
+/* The largest gap between two ranges that are merged, about the overhead of a multipart part */
+#define HTTP_REQUEST_RANGE_MERGE_GAP 80
+
+/* A range of bytes within a file */
+struct ByteRange
+{
+    size_t offset;
+    size_t length;
+};
+
+/* The place of a request body within a file, as given by its `Content-Range` header */
+struct ContentRange
+{
+    bool   hasBody;  // False if the client only asks how much of the file was received
+    size_t offset;
+    size_t length;
+    bool   hasTotal; // False if the file's size is not known yet
+    size_t total;
+};
+
+/* Outcome of evaluating a request's `Range` header */
+enum RangeStatus
+{
+    /* The whole file is sent */
+    RANGE_STATUS_NONE,
+    RANGE_STATUS_SATISFIABLE,
+    RANGE_STATUS_UNSATISFIABLE
+};
 
 struct HttpRequest
 {
@@ -54,6 +87,40 @@ struct HttpRequest
 
     /* Case-invariantly finds a header in the given vector of headers */
     static const Header *findHeaderIn(const std::vector<Header> &headers, Slice key);
+
+    /* Case-invariantly checks whether the `Connection` header lists the given option */
+    bool hasConnectionOption(Slice option) const;
+
+    /* Gets whether the client wants to keep the connection open after the response */
+    inline bool wantsKeepAlive() const
+    {
+        // HTTP/1.0 connections are only persistent on request, HTTP/1.1 ones unless declined
+        if (isLegacy)
+            return hasConnectionOption(C_SLICE("keep-alive"));
+        return !hasConnectionOption(C_SLICE("close"));
+    }
+
+    /* Gets whether the request carries preconditions on the version the client already has */
+    inline bool isConditional() const
+    {
+        return findHeader(C_SLICE("If-None-Match")) != NULL || findHeader(C_SLICE("If-Modified-Since")) != NULL;
+    }
+
+    /* Evaluates `If-None-Match` and `If-Modified-Since` against the selected file's validators,
+       returns true if the client's copy is current and a 304 response should be sent */
+    bool isNotModified(Slice entityTag, time_t modificationTime) const;
+
+    /* Checks whether `Accept-Encoding` allows the given content coding */
+    bool acceptsEncoding(Slice coding) const;
+
+    /* Evaluates `Range` and `If-Range` for a file of the given size and validators, the satisfiable
+       ranges are stored sorted and with overlapping or adjacent ones merged */
+    RangeStatus findRanges(size_t size, Slice entityTag, time_t modificationTime,
+        std::vector<ByteRange> &outRanges) const;
+
+    /* Evaluates `Content-Range` of a PUT request, a header that can't be parsed or that
+       contradicts itself is unsatisfiable */
+    RangeStatus findContentRange(ContentRange &outRange) const;
 };
 
 #endif // HTTP_REQUEST_hpp
@@ -4,22 +4,38 @@
 
 #include <cstring>
 
-/* Constructs a HTTP request parser using the given rules */
-HttpRequestParser::HttpRequestParser(const ServerConfig &config, uint32_t host, uint16_t port)
+/* Destructor for deriving classes */
+BodySink::~BodySink()
+{
+}
+
+/* Destructor for deriving classes */
+BodySinkSelector::~BodySinkSelector()
+{
+}
+
+/* Constructs a HTTP request parser using the given rules, request bodies are passed to the
+   sink `selector` picks for them if one is given */
+HttpRequestParser::HttpRequestParser(const ServerConfig &config, uint32_t host, uint16_t port,
+    BodySinkSelector *selector)
     : _config(config)
     , _host(host)
     , _port(port)
+    , _selector(selector)
 {
     reset();
 }
 
-/* Prepares the parser to consume the next request */
+/* Prepares the parser to consume the next request, bytes that were received past the
+   previous request are kept as the start of the next one */
 void HttpRequestParser::reset()
 {
     _request            = HttpRequest();
     _request.clientHost = _host;
     _request.clientPort = _port;
     _phase              = HTTP_REQUEST_HEADER;
+    _bodySink           = NULL;
+    _bodyLength         = 0;
     _headerLength       = 0;
     _chunkHeaderLength  = 0;
     _isEndChunk         = false;
@@ -56,19 +72,42 @@ bool HttpRequestParser::commit(Slice &data)
             case HTTP_REQUEST_HEADER_EXCEED:
             case HTTP_REQUEST_BODY_EXCEED:
             case HTTP_REQUEST_MALFORMED:
+                return false;
+
+            // Bytes following a completed request belong to the next (pipelined) one
             case HTTP_REQUEST_COMPLETED:
+                _pendingData.append(&data[0], data.getLength());
+                data.consumeStart(data.getLength());
                 return false;
         }
         // If the state was transitioned into a final state, immediately return true
         if (_phase == HTTP_REQUEST_HEADER_EXCEED
          || _phase == HTTP_REQUEST_BODY_EXCEED
-         || _phase == HTTP_REQUEST_MALFORMED
-         || _phase == HTTP_REQUEST_COMPLETED)
+         || _phase == HTTP_REQUEST_MALFORMED)
             return true;
+        if (_phase == HTTP_REQUEST_COMPLETED)
+        {
+            // Keep the remainder as the start of the next request
+            _pendingData.append(&data[0], data.getLength());
+            data.consumeStart(data.getLength());
+            return true;
+        }
     }
     return false;
 }
 
+/* Commits the bytes that were received past the previous request,
+   returns whether the parser has transitioned into a final phase */
+bool HttpRequestParser::commitPending()
+{
+    // Take the bytes out first since a completed request stores its remainder again
+    std::string pendingData;
+    pendingData.swap(_pendingData);
+
+    Slice data(pendingData);
+    return commit(data);
+}
+
 /* Handles a data commit in the `HTTP_REQUEST_HEADER` phase */
 HttpRequestPhase HttpRequestParser::handleHeader(Slice &data)
 {
@@ -131,7 +170,7 @@ HttpRequestPhase HttpRequestParser::handleHeader(Slice &data)
         if (contentLength != NULL)
             return HTTP_REQUEST_MALFORMED;
 
-        return HTTP_REQUEST_BODY_CHUNKED_HEADER;
+        return startBody(HTTP_REQUEST_BODY_CHUNKED_HEADER);
     }
     else if (contentLength != NULL)
     {
@@ -147,13 +186,54 @@ HttpRequestPhase HttpRequestParser::handleHeader(Slice &data)
         if (_bodyRemainder == 0)
             return HTTP_REQUEST_COMPLETED;
 
-        return HTTP_REQUEST_BODY_RAW;
+        return startBody(HTTP_REQUEST_BODY_RAW);
     }
 
     // Missing transfer encoding and content length is treated like a zero-length body
     return HTTP_REQUEST_COMPLETED;
 }
 
+/* Accounts for raw body bytes that the body sink took from the connection by itself,
+   returns whether the parser has transitioned into a final phase */
+bool HttpRequestParser::commitSunkBody(size_t length)
+{
+    if (length > getSinkBodyRemainder())
+        throw std::logic_error("Attempt to commit more body bytes than expected");
+    _bodyLength += length;
+    _bodyRemainder -= length;
+    if (_bodyRemainder == 0)
+        _phase = HTTP_REQUEST_COMPLETED;
+    return _phase == HTTP_REQUEST_COMPLETED;
+}
+
+/* Picks the destination of the body and passes the request's header along */
+HttpRequestPhase HttpRequestParser::startBody(HttpRequestPhase phase)
+{
+    if (_selector != NULL)
+        _bodySink = _selector->selectBodySink(_request);
+    return phase;
+}
+
+/* Passes body bytes to the body sink or appends them to the request,
+   returns false if the body grew too large */
+bool HttpRequestParser::storeBody(Slice data)
+{
+    if (SIZE_MAX - _bodyLength < data.getLength())
+        return false;
+    _bodyLength += data.getLength();
+
+    // Bodies that go to a sink are never held in memory as a whole
+    if (_bodySink != NULL)
+    {
+        _bodySink->writeBody(data);
+        return true;
+    }
+    size_t oldLength = _request.body.size();
+    _request.body.resize(oldLength + data.getLength());
+    std::memcpy(&_request.body[oldLength], &data[0], data.getLength());
+    return true;
+}
+
 /* Handles a data commit in the `HTTP_REQUEST_BODY_RAW` phase */
 HttpRequestPhase HttpRequestParser::handleBodyRaw(Slice &data)
 {
@@ -162,12 +242,9 @@ HttpRequestPhase HttpRequestParser::handleBodyRaw(Slice &data)
     if (copyLength > _bodyRemainder)
         copyLength = _bodyRemainder;
 
-    // Copy the bytes into the body buffer
-    size_t oldLength = _request.body.size();
-    if (SIZE_MAX - oldLength < copyLength)
+    // Store the bytes as part of the body
+    if (!storeBody(Slice(&data[0], copyLength)))
         return HTTP_REQUEST_BODY_EXCEED;
-    _request.body.resize(oldLength + copyLength);
-    std::memcpy(&_request.body[oldLength], &data[0], copyLength);
 
     // Consume the copied bytes and decrement the remaining body size
     data.consumeStart(copyLength);
@@ -251,14 +328,11 @@ HttpRequestPhase HttpRequestParser::handleBodyChunkedBody(Slice &data)
     if (copyLength > _bodyRemainder)
         copyLength = _bodyRemainder;
 
-    // Copy the bytes into the body buffer
-    size_t oldLength = _request.body.size();
-    if (SIZE_MAX - oldLength < copyLength)
+    // Store the bytes as part of the body
+    if (_bodyLength > _config.maxBodySize || copyLength > _config.maxBodySize - _bodyLength)
         return HTTP_REQUEST_BODY_EXCEED;
-    if (oldLength + copyLength > _config.maxBodySize)
+    if (!storeBody(Slice(&data[0], copyLength)))
         return HTTP_REQUEST_BODY_EXCEED;
-    _request.body.resize(oldLength + copyLength);
-    std::memcpy(&_request.body[oldLength], &data[0], copyLength);
 
     // Consume the copied bytes and decrement the remaining body size
     data.consumeStart(copyLength);
@@ -4,6 +4,7 @@
 #include "config.hpp"
 #include "http_request.hpp"
 
+#include <string>
 #include <stdexcept>
 
 #define HTTP_REQUEST_HEADER_MAX_LENGTH 8192
@@ -26,18 +27,64 @@ enum HttpRequestPhase
     HTTP_REQUEST_COMPLETED
 };
 
+/* Receives the body of a request as it arrives instead of having it buffered in the request */
+struct BodySink
+{
+    /* Consumes the next bytes of the body */
+    virtual void writeBody(Slice data) = 0;
+
+    /* Destructor for deriving classes */
+    virtual ~BodySink();
+};
+
+/* Picks where the body of a request goes once its header was parsed */
+struct BodySinkSelector
+{
+    /* Gets the sink that receives the request's body, NULL to buffer it in the request */
+    virtual BodySink *selectBodySink(const HttpRequest &request) = 0;
+
+    /* Destructor for deriving classes */
+    virtual ~BodySinkSelector();
+};
+
 class HttpRequestParser
 {
 public:
-    /* Constructs a HTTP request parser using the given rules */
-    HttpRequestParser(const ServerConfig &config, uint32_t host, uint16_t port);
+    /* Constructs a HTTP request parser using the given rules, request bodies are passed to the
+       sink `selector` picks for them if one is given */
+    HttpRequestParser(const ServerConfig &config, uint32_t host, uint16_t port,
+        BodySinkSelector *selector = NULL);
 
-    /* Prepares the parser to consume the next request */
+    /* Prepares the parser to consume the next request, bytes that were received past the
+       previous request are kept as the start of the next one */
     void reset();
 
     /* Commits data to the parser, returns whether the parser has transitioned into a final phase */
     bool commit(Slice &data);
 
+    /* Commits the bytes that were received past the previous request,
+       returns whether the parser has transitioned into a final phase */
+    bool commitPending();
+
+    /* Accounts for raw body bytes that the body sink took from the connection by itself,
+       returns whether the parser has transitioned into a final phase */
+    bool commitSunkBody(size_t length);
+
+    /* Gets the number of raw body bytes that may still be passed to the body sink directly,
+       zero unless a raw body is being passed to a sink */
+    inline size_t getSinkBodyRemainder() const
+    {
+        if (_phase != HTTP_REQUEST_BODY_RAW || _bodySink == NULL)
+            return 0;
+        return _bodyRemainder;
+    }
+
+    /* Gets whether bytes were received past the completed request */
+    inline bool hasPendingData() const
+    {
+        return !_pendingData.empty();
+    }
+
     /* Gets the parser's current phase */
     inline HttpRequestPhase getPhase() const
     {
@@ -55,18 +102,29 @@ private:
     const ServerConfig &_config;
     uint32_t            _host;
     uint16_t            _port;
+    BodySinkSelector   *_selector;
+    BodySink           *_bodySink;
     HttpRequest         _request;
     HttpRequestPhase    _phase;
     char                _headerBuffer[HTTP_REQUEST_HEADER_MAX_LENGTH];
     size_t              _headerLength;
     size_t              _bodyRemainder;
+    size_t              _bodyLength;
     char                _chunkHeaderBuffer[HTTP_REQUEST_BODY_CHUNKED_HEADER_MAX_LENGTH];
     size_t              _chunkHeaderLength;
     bool                _isEndChunk;
+    std::string         _pendingData;
 
     /* Handles a data commit in the `HTTP_REQUEST_HEADER` phase */
     HttpRequestPhase handleHeader(Slice &data);
 
+    /* Picks the destination of the body and passes the request's header along */
+    HttpRequestPhase startBody(HttpRequestPhase phase);
+
+    /* Passes body bytes to the body sink or appends them to the request,
+       returns false if the body grew too large */
+    bool storeBody(Slice data);
+
     /* Handles a data commit in the `HTTP_REQUEST_BODY_RAW` phase */
     HttpRequestPhase handleBodyRaw(Slice &data);
 
@@ -1,21 +1,94 @@
 #include "utility.hpp"
 #include "http_response.hpp"
 #include "http_exception.hpp"
+#include "gzip_encoder.hpp"
+#include "config.hpp"
 
+#include <errno.h>
+#include <cstring>
+#include <iomanip>
+#include <algorithm>
+#include <fcntl.h>
 #include <unistd.h>
 #include <stdexcept>
+#include <sys/uio.h>
 #include <sys/socket.h>
+#include <sys/sendfile.h>
+#include <sys/random.h>
 
 /* Constructs an uninitialized HTTP response */
 HttpResponse::HttpResponse()
     : _state(HTTP_RESPONSE_UNINITIALIZED)
+    , _bodyFile(NULL)
+    , _compressedFile(NULL)
+    , _cachedResponse(NULL)
+    , _bodyOffset(0)
+    , _bodyRemainder(0)
+    , _transferTimeout(0)
+    , _keepAlive(false)
+    , _statusCode(0)
+    , _isEncoded(false)
+    , _isPiped(false)
+    , _isPipeOpen(false)
+    , _isChunked(false)
+    , _pipeRemainder(0)
+    , _pipeEncoder(NULL)
 {
 }
 
+/* Releases the body's file, compressed copy and rendered response */
+HttpResponse::~HttpResponse()
+{
+    if (_bodyFile != NULL)
+        _bodyFile->release();
+    if (_compressedFile != NULL)
+        _compressedFile->release();
+    if (_cachedResponse != NULL)
+        _cachedResponse->release();
+    delete _pipeEncoder;
+}
+
+/* Returns the response into its uninitialized state so it can be reused for another request */
+void HttpResponse::reset()
+{
+    _state = HTTP_RESPONSE_UNINITIALIZED;
+    _headerStream.str("");
+    _headerStream.clear();
+    _headerString.clear();
+    _bodyBuffer.clear();
+    _headerSlice = Slice();
+    _bodySlice = Slice();
+    if (_bodyStream.is_open())
+        _bodyStream.close();
+    _bodyStream.clear();
+    if (_bodyFile != NULL)
+        _bodyFile->release();
+    _bodyFile = NULL;
+    if (_compressedFile != NULL)
+        _compressedFile->release();
+    _compressedFile = NULL;
+    if (_cachedResponse != NULL)
+        _cachedResponse->release();
+    _cachedResponse = NULL;
+    _bodyOffset = 0;
+    _bodyRemainder = 0;
+    _transferTimeout = 0;
+    _keepAlive = false;
+    _statusCode = 0;
+    _contentType.clear();
+    _isEncoded = false;
+    _isPiped = false;
+    _isPipeOpen = false;
+    _isChunked = false;
+    _pipeRemainder = 0;
+    delete _pipeEncoder;
+    _pipeEncoder = NULL;
+}
+
 /* Initializes the response object with an owned string */
 void HttpResponse::initializeOwned(int statusCode, Slice statusMessage, const std::string &body)
 {
-    initializeHeader(statusCode, statusMessage, body.size());
+    initializeHeader(statusCode, statusMessage);
     _bodyBuffer    = body;
     _bodySlice     = Slice(_bodyBuffer);
     _bodyRemainder = body.size();
@@ -26,14 +99,16 @@ void HttpResponse::initializeOwned(int statusCode, Slice statusMessage, const st
    NOTE: The lifetime of this slice MUST match the response's */
 void HttpResponse::initializeUnowned(int statusCode, Slice statusMessage, Slice body)
 {
-    initializeHeader(statusCode, statusMessage, body.getLength());
+    initializeHeader(statusCode, statusMessage);
     _bodySlice     = body;
     _bodyRemainder = body.getLength();
     _state = HTTP_RESPONSE_INITIALIZED;
 }
 
-/* Initializes the response object with a file stream of the given path */
-void HttpResponse::initializeFileStream(int statusCode, Slice statusMessage, const char *path)
+/* Initializes the response object with a file stream of the given path, sending only `range`
+   of the file if one is given */
+void HttpResponse::initializeFileStream(int statusCode, Slice statusMessage, const char *path,
+    const ByteRange *range)
 {
     // Open the file stream at the file's end to obtain its length
     _bodyStream.open(path, std::ios::binary | std::ios::ate);
@@ -41,27 +116,237 @@ void HttpResponse::initializeFileStream(int statusCode, Slice statusMessage, con
         throw HttpException(500);
     size_t length = _bodyStream.tellg();
 
-    // Seek back to the start
-    _bodyStream.seekg(0);
+    // Seek back to the start of the sent bytes
+    size_t offset = 0;
+    if (range != NULL)
+    {
+        if (range->offset + range->length > length)
+            throw HttpException(500);
+        offset = range->offset;
+        length = range->length;
+    }
+    _bodyStream.seekg(offset);
     if (!_bodyStream.good())
         throw HttpException(500);
 
-    initializeHeader(statusCode, statusMessage, length);
+    initializeHeader(statusCode, statusMessage);
     _bodySlice     = Slice();
     _bodyRemainder = length;
     _state         = HTTP_RESPONSE_INITIALIZED;
 }
 
+/* Initializes the response object with an opened file that is sent from its descriptor,
+   taking over the caller's reference to it; only `range` of the file is sent if one is given */
+void HttpResponse::initializeFile(int statusCode, Slice statusMessage, CachedFile *file,
+    const ByteRange *range)
+{
+    _bodyFile = file;
+    size_t offset = range != NULL ? range->offset : 0;
+    size_t length = range != NULL ? range->length : file->getSize();
+    initializeHeader(statusCode, statusMessage);
+    _bodySlice     = Slice();
+    _bodyOffset    = offset;
+    _bodyRemainder = length;
+    _state         = HTTP_RESPONSE_INITIALIZED;
+}
+
+/* Initializes a 206 response with a `multipart/byteranges` body holding the given ranges of
+   the file at `path` of `size` bytes, which are read into memory */
+void HttpResponse::initializeFileStreamRanges(const char *path, size_t size, Slice contentType,
+    const std::vector<ByteRange> &ranges)
+{
+    std::ifstream stream(path, std::ios::binary);
+    if (!stream.is_open())
+        throw HttpException(500);
+
+    std::string boundary = createBoundary();
+    std::string body;
+    for (size_t index = 0; index < ranges.size(); index++)
+    {
+        appendRangePart(body, boundary, contentType, ranges[index], size);
+        size_t offset = body.size();
+        body.resize(offset + ranges[index].length);
+        stream.seekg(ranges[index].offset);
+        stream.read(&body[offset], ranges[index].length);
+        if (static_cast<size_t>(stream.gcount()) != ranges[index].length)
+            throw HttpException(500);
+    }
+    initializeMultipart(body, boundary);
+}
+
+/* Initializes a 206 response with a `multipart/byteranges` body holding the given ranges of
+   an opened file, which are read into memory */
+void HttpResponse::initializeFileRanges(const CachedFile &file, Slice contentType,
+    const std::vector<ByteRange> &ranges)
+{
+#ifdef __42_LIKES_WASTING_CPU_CYCLES__
+    (void)file;
+    (void)contentType;
+    (void)ranges;
+    throw std::logic_error("pread() is not supported in this build");
+#else
+    std::string boundary = createBoundary();
+    std::string body;
+    for (size_t index = 0; index < ranges.size(); index++)
+    {
+        appendRangePart(body, boundary, contentType, ranges[index], file.getSize());
+        size_t offset = body.size();
+        body.resize(offset + ranges[index].length);
+        ssize_t result = pread(file.getFileno(), &body[offset], ranges[index].length, ranges[index].offset);
+        if (result < 0 || static_cast<size_t>(result) != ranges[index].length)
+            throw HttpException(500);
+    }
+    initializeMultipart(body, boundary);
+#endif // __42_LIKES_WASTING_CPU_CYCLES__
+}
+
+/* Initializes the response object with a compressed copy of a file, taking over the caller's
+   reference to it */
+void HttpResponse::initializeCompressed(int statusCode, Slice statusMessage, CompressedFile *file)
+{
+    _compressedFile = file;
+    initializeHeader(statusCode, statusMessage);
+    _bodySlice     = file->getData();
+    _bodyRemainder = _bodySlice.getLength();
+    _state         = HTTP_RESPONSE_INITIALIZED;
+}
+
+/* Initializes the response object with a rendered response, taking over the caller's
+   reference to it; the response is finalized immediately */
+void HttpResponse::initializeCached(CachedResponse *response)
+{
+    _cachedResponse  = response;
+    _headerSlice     = response->getData();
+    _bodySlice       = Slice();
+    _bodyRemainder   = 0;
+    _transferTimeout = estimateTransferTimeout(_headerSlice.getLength());
+    _state           = HTTP_RESPONSE_FINALIZED;
+}
+
 /* Initializes the response object with CGI output data
    NOTE: The lifetime of this slice MUST match the response's */
 void HttpResponse::initializeUnownedCgi(Slice response)
 {
-    Slice temporary;
-
     // Split header and body
     Slice header;
     if (!response.splitStart(C_SLICE("\r\n\r\n"), header))
         throw std::runtime_error("Invalid CGI response");
+    initializeCgi(header, response);
+}
+
+/* Initializes the response object with the header of a CGI output whose body was spilled
+   into a file, taking over the caller's reference to it
+   NOTE: The lifetime of this slice MUST match the response's */
+void HttpResponse::initializeSpilledCgi(Slice header, CachedFile *file)
+{
+    _bodyFile = file;
+    initializeUnownedCgi(header);
+    _bodyOffset    = 0;
+    _bodyRemainder = file->getSize();
+}
+
+/* Initializes the response object with the header of a CGI output whose body is appended
+   while the script produces it; the body is chunked unless the script declared its length */
+void HttpResponse::initializePipedCgi(Slice header)
+{
+    initializeCgi(header, Slice());
+    _isPiped = true;
+    _isPipeOpen = true;
+}
+
+/* Gets whether the body of the initialized CGI response may be piped, which a response
+   without content can't be and neither can a body of unknown length if the client doesn't
+   understand chunked encoding */
+bool HttpResponse::isPipeable(bool acceptsChunked) const
+{
+    if (_statusCode < 200 || _statusCode == 204 || _statusCode == 304)
+        return false;
+    return acceptsChunked || !_isChunked;
+}
+
+/* Compresses the piped body of the initialized CGI response while it's appended, which
+   makes the body chunked */
+void HttpResponse::compressPipedBody()
+{
+    if (_state != HTTP_RESPONSE_INITIALIZED || !_isPipeOpen)
+        throw std::logic_error("compressPipedBody() called on response without open body");
+    _pipeEncoder = new GzipEncoder();
+    addHeader(C_SLICE("Content-Encoding"), C_SLICE("gzip"));
+}
+
+/* Appends the next bytes of a piped body, framed as a chunk if the body is chunked */
+void HttpResponse::appendPipedBody(Slice data)
+{
+    if (!_isPipeOpen)
+        throw std::logic_error("appendPipedBody() called on response without open body");
+
+    // Bytes past the declared length are dropped like the client would
+    if (!_isChunked && data.getLength() > _pipeRemainder)
+        data = Slice(&data[0], _pipeRemainder);
+    if (data.isEmpty())
+        return;
+    if (!_isChunked)
+        _pipeRemainder -= data.getLength();
+
+    // Compressed output is flushed for every piece so that the client gets it as it's produced
+    std::string encoded;
+    if (_pipeEncoder != NULL)
+    {
+        _pipeEncoder->update(data, encoded);
+        _pipeEncoder->flush(encoded);
+        data = Slice(encoded);
+    }
+
+    // Drop the bytes that were sent already, the rest moves to the front
+    _bodyBuffer.erase(0, _bodyBuffer.size() - _bodySlice.getLength());
+    bool isChunked = _isChunked || _pipeEncoder != NULL;
+    if (isChunked)
+    {
+        std::stringstream size;
+        size << std::hex << data.getLength() << "\r\n";
+        _bodyBuffer += size.str();
+    }
+    _bodyBuffer.append(&data[0], data.getLength());
+    if (isChunked)
+        _bodyBuffer += "\r\n";
+
+    _bodySlice       = Slice(_bodyBuffer);
+    _bodyRemainder   = _bodyBuffer.size();
+    _transferTimeout = estimateTransferTimeout(_bodyRemainder);
+}
+
+/* Ends a piped body, returns false if it fell short of the length the script declared */
+bool HttpResponse::endPipedBody()
+{
+    if (!_isPipeOpen)
+        throw std::logic_error("endPipedBody() called on response without open body");
+    _isPipeOpen = false;
+    bool isComplete = _isChunked || _pipeRemainder == 0;
+    if (!_isChunked && _pipeEncoder == NULL)
+        return isComplete;
+
+    // The rest of a compressed body is its last chunk
+    _bodyBuffer.erase(0, _bodyBuffer.size() - _bodySlice.getLength());
+    if (_pipeEncoder != NULL)
+    {
+        std::string encoded;
+        _pipeEncoder->finish(encoded);
+        std::stringstream size;
+        size << std::hex << encoded.size() << "\r\n";
+        _bodyBuffer += size.str() + encoded + "\r\n";
+    }
+    _bodyBuffer += "0\r\n\r\n";
+    _bodySlice       = Slice(_bodyBuffer);
+    _bodyRemainder   = _bodyBuffer.size();
+    _transferTimeout = estimateTransferTimeout(_bodyRemainder);
+    return isComplete;
+}
+
+/* Initializes the response object with the status and header fields of a CGI output's header
+   and the given body; a declared length is remembered for a piped body */
+void HttpResponse::initializeCgi(Slice header, Slice body)
+{
+    Slice temporary;
 
     // Establish default status code and message
     size_t statusCode = 200;
@@ -86,7 +371,9 @@ void HttpResponse::initializeUnownedCgi(Slice response)
     }
 
     // Initialize the response to the found status and body
-    initializeUnowned(statusCode, statusMessage, response);
+    initializeUnowned(statusCode, statusMessage, body);
+    _isChunked = true;
+    _pipeRemainder = 0;
 
     // Add CGI headers
     while (header.getLength() > 0)
@@ -104,12 +391,13 @@ void HttpResponse::initializeUnownedCgi(Slice response)
         if (!value.splitStart(':', key))
             throw std::runtime_error("Invalid CGI header");
 
-        // Add the header to the response, ignoring the "Status" header
-        if (key != C_SLICE("Status"))
-        {
-            value.consumeStart(C_SLICE(" "));
+        // Add the header to the response, ignoring the "Status" header and the length which is
+        // added for the body that is actually sent
+        value.consumeStart(C_SLICE(" "));
+        if (key.equalsIgnoreCase(C_SLICE("Content-Length")))
+            _isChunked = !Utility::parseSize(value, _pipeRemainder);
+        else if (key != C_SLICE("Status"))
             addHeader(key, value);
-        }
     }
 }
 
@@ -119,6 +407,12 @@ void HttpResponse::addHeader(Slice key, Slice value)
     if (_state != HTTP_RESPONSE_INITIALIZED)
         throw std::logic_error("addHeader() called on uninitialized response");
     _headerStream << key << ": " << value << "\r\n";
+
+    // Remember what decides whether the body may be compressed
+    if (key.equalsIgnoreCase(C_SLICE("Content-Type")))
+        _contentType = value.toString();
+    else if (key.equalsIgnoreCase(C_SLICE("Content-Encoding")))
+        _isEncoded = true;
 }
 
 /* Finalize Header */
@@ -126,16 +420,59 @@ uint64_t HttpResponse::finalizeHeader()
 {
     if (_state != HTTP_RESPONSE_INITIALIZED)
         throw std::logic_error("finalizeHeader() called on uninitialized response");
+
+    // A 304 response never has a body, a length would describe the file the client already has;
+    // a piped body is chunked unless the script declared its length
+    if (_isPiped && (_isChunked || _pipeEncoder != NULL))
+        _headerStream << "Transfer-Encoding: chunked\r\n";
+    else if (_isPiped)
+        _headerStream << "Content-Length: " << _pipeRemainder << "\r\n";
+    else if (_statusCode != 304)
+        _headerStream << "Content-Length: " << _bodyRemainder << "\r\n";
     _headerStream << "\r\n";
     _headerString = _headerStream.str();
     _headerSlice = _headerString;
     _state = HTTP_RESPONSE_FINALIZED;
 
+    _transferTimeout = estimateTransferTimeout(_bodyRemainder);
+    return _transferTimeout;
+}
+
+/* Gets whether the initialized body may be compressed according to the given settings,
+   which requires an unencoded in-memory body of an allowed type and length */
+bool HttpResponse::isCompressible(const CompressionConfig &config) const
+{
+    if (_state != HTTP_RESPONSE_INITIALIZED || !isBuffered() || _isEncoded)
+        return false;
+    if (_statusCode == 204 || _statusCode == 206 || _statusCode == 304)
+        return false;
+    if (_isPiped && !_isChunked && (_pipeRemainder == 0 || _pipeRemainder < config.minLength))
+        return false;
+    if (!_isPiped && (_bodyRemainder == 0 || _bodyRemainder < config.minLength))
+        return false;
+    return !_contentType.empty() && config.allowsType(_contentType);
+}
+
+/* Replaces the initialized in-memory body with its gzip encoding */
+void HttpResponse::compressBody()
+{
+    if (_state != HTTP_RESPONSE_INITIALIZED || !isBuffered())
+        throw std::logic_error("compressBody() called on unbuffered response");
+    std::string encoded = GzipEncoder::encode(_bodySlice);
+    _bodyBuffer.swap(encoded);
+    _bodySlice     = Slice(_bodyBuffer);
+    _bodyRemainder = _bodyBuffer.size();
+    addHeader(C_SLICE("Content-Encoding"), C_SLICE("gzip"));
+}
+
+/* Estimates the time sending the given number of bytes may take at a very slow speed */
+uint64_t HttpResponse::estimateTransferTimeout(size_t length)
+{
     // This is an approximation based on very slow network speed
     // A GiB of data can take up to ~14 hours before the client is dropped
     // A MiB of data can take up to ~50 seconds before the client is dropped
     // Anything below or equal to 20 KiB is clamped up to a second
-    double timeout = static_cast<double>(this->_bodyRemainder) * 0.05;
+    double timeout = static_cast<double>(length) * 0.05;
     if (timeout < 1000)
         return 1000;
     return static_cast<uint64_t>(timeout);
@@ -149,24 +486,36 @@ bool HttpResponse::hasData()
     return !_headerSlice.isEmpty() || _bodyRemainder > 0;
 }
 
-// Start transfer process of the response to the socket
-void HttpResponse::transferToSocket(int fileno)
+// Start transfer process of the response to the socket, returns the number of bytes sent
+// which is zero if the socket would block
+size_t HttpResponse::transferToSocket(int fileno)
 {
     if (_state != HTTP_RESPONSE_FINALIZED)
         throw std::logic_error("transferToSocket() called on non-finalized response");
 
     // Send the header first
+#ifdef __42_LIKES_WASTING_CPU_CYCLES__
+    if (!_headerSlice.isEmpty())
+        return sendSliceToSocket(fileno, _headerSlice);
+#else
+    // Send the header together with an in-memory body, a file body is appended to its packet
     if (!_headerSlice.isEmpty())
     {
-        sendSliceToSocket(fileno, _headerSlice);
-        return;
+        struct iovec vectors[2];
+        size_t count = gatherBuffers(vectors, 2);
+        size_t bytesSent = sendVectorsToSocket(fileno, vectors, count, hasStreamedBody());
+        consumeBuffers(bytesSent);
+        return bytesSent;
     }
+#endif // __42_LIKES_WASTING_CPU_CYCLES__
 
     // Send the body
+    size_t bytesSent = 0;
     if (_bodyRemainder > 0)
     {
-        size_t bytesSent;
-        if (_bodyStream.is_open())
+        if (_bodyFile != NULL)
+            bytesSent = sendFileToSocket(fileno);
+        else if (_bodyStream.is_open())
             bytesSent = streamFileToSocket(fileno);
         else
             bytesSent = sendSliceToSocket(fileno, _bodySlice);
@@ -176,24 +525,170 @@ void HttpResponse::transferToSocket(int fileno)
             bytesSent = _bodyRemainder;
         _bodyRemainder -= bytesSent;
     }
+    return bytesSent;
+}
+
+/* Fills up to `count` I/O vectors with the response's unsent in-memory data,
+   returns the number of vectors used; a streamed body is never included */
+size_t HttpResponse::gatherBuffers(struct iovec *vectors, size_t count)
+{
+    if (_state != HTTP_RESPONSE_FINALIZED)
+        throw std::logic_error("gatherBuffers() called on non-finalized response");
+
+    size_t used = 0;
+    if (used < count && !_headerSlice.isEmpty())
+    {
+        vectors[used].iov_base = const_cast<char *>(&_headerSlice[0]);
+        vectors[used].iov_len  = _headerSlice.getLength();
+        used++;
+    }
+    if (used < count && isBuffered() && _bodyRemainder > 0)
+    {
+        vectors[used].iov_base = const_cast<char *>(&_bodySlice[0]);
+        vectors[used].iov_len  = _bodyRemainder;
+        used++;
+    }
+    return used;
 }
 
-/* Initializes the header string stream with a response line */
-void HttpResponse::initializeHeader(int statusCode, Slice statusMessage, size_t bodySize)
+/* Sends the given I/O vectors to a socket with a single system call, `hasMore` tells the
+   kernel to hold back a partial packet for data that follows immediately;
+   returns the number of bytes sent which is zero if the socket would block */
+size_t HttpResponse::sendVectorsToSocket(int fileno, struct iovec *vectors, size_t count, bool hasMore)
 {
+#ifdef __42_LIKES_WASTING_CPU_CYCLES__
+    (void)fileno;
+    (void)vectors;
+    (void)count;
+    (void)hasMore;
+    throw std::logic_error("sendmsg() is not supported in this build");
+#else
+    struct msghdr message;
+    std::memset(&message, 0, sizeof(message));
+    message.msg_iov    = vectors;
+    message.msg_iovlen = count;
+
+    int flags = MSG_DONTWAIT | MSG_NOSIGNAL;
+    if (hasMore)
+        flags |= MSG_MORE;
+
+    ssize_t result = sendmsg(fileno, &message, flags);
+    if (result == -1 && (errno == EAGAIN || errno == EWOULDBLOCK))
+        return 0;
+    if (result == -1)
+        throw std::runtime_error("Unable to send data to socket");
+    return static_cast<size_t>(result);
+#endif // __42_LIKES_WASTING_CPU_CYCLES__
+}
+
+/* Formats a strong entity tag from the file metadata that changes along with its content */
+std::string HttpResponse::formatEntityTag(uint64_t inode, size_t size, time_t modificationTime)
+{
+    std::stringstream stream;
+    stream << std::hex << '"' << inode << '-' << size << '-' << static_cast<uint64_t>(modificationTime) << '"';
+    return stream.str();
+}
+
+/* Formats the `Content-Range` of a range within a file of `size` bytes */
+std::string HttpResponse::formatContentRange(const ByteRange &range, size_t size)
+{
+    std::stringstream stream;
+    stream << "bytes " << range.offset << '-' << range.offset + range.length - 1 << '/' << size;
+    return stream.str();
+}
+
+/* Marks up to `length` bytes of the gathered data as sent, returns the bytes left over */
+size_t HttpResponse::consumeBuffers(size_t length)
+{
+    size_t headerLength = std::min(length, _headerSlice.getLength());
+    _headerSlice.consumeStart(headerLength);
+    length -= headerLength;
+
+    if (isBuffered())
+    {
+        size_t bodyLength = std::min(length, _bodyRemainder);
+        _bodySlice.consumeStart(bodyLength);
+        _bodyRemainder -= bodyLength;
+        length -= bodyLength;
+    }
+    return length;
+}
+
+/* Initializes the header string stream with a response line, the body's length is added once
+   the header is finalized */
+void HttpResponse::initializeHeader(int statusCode, Slice statusMessage)
+{
+    _headerStream.str("");
     _headerStream.clear();
-    _headerStream << "HTTP/1.1 " << statusCode << ' ' << statusMessage << "\r\n"
-                  << "Content-Length: " << bodySize << "\r\n"
-                  << "Connection: close\r\n";
+    _headerStream << "HTTP/1.1 " << statusCode << ' ' << statusMessage << "\r\n";
+    _statusCode = statusCode;
+    _contentType.clear();
+    _isEncoded = false;
+    _headerStream << "Connection: " << (_keepAlive ? "keep-alive" : "close") << "\r\n";
+}
+
+/* Appends the delimiter and header of a multipart body's part for a file's range */
+void HttpResponse::appendRangePart(std::string &body, const std::string &boundary, Slice contentType,
+    const ByteRange &range, size_t size)
+{
+    body += "\r\n--";
+    body += boundary;
+    body += "\r\nContent-Type: ";
+    body += contentType.toString();
+    body += "\r\nContent-Range: ";
+    body += formatContentRange(range, size);
+    body += "\r\n\r\n";
+}
+
+/* Closes a multipart body and initializes the response with it, the body is taken over */
+void HttpResponse::initializeMultipart(std::string &body, const std::string &boundary)
+{
+    body += "\r\n--";
+    body += boundary;
+    body += "--\r\n";
+
+    initializeHeader(206, C_SLICE("Partial Content"));
+    _bodyBuffer.swap(body);
+    _bodySlice     = Slice(_bodyBuffer);
+    _bodyRemainder = _bodyBuffer.size();
+    _state         = HTTP_RESPONSE_INITIALIZED;
+    addHeader(C_SLICE("Content-Type"), Slice("multipart/byteranges; boundary=" + boundary));
+}
+
+/* Creates a delimiter for the parts of a multipart body */
+std::string HttpResponse::createBoundary()
+{
+    // The boundary is random for each response so that a file can't contain it on purpose
+    uint64_t random[2];
+#ifdef __42_LIKES_WASTING_CPU_CYCLES__
+    int fileno = open("/dev/urandom", O_RDONLY | O_CLOEXEC);
+    if (fileno < 0)
+        throw HttpException(500);
+    ssize_t result = read(fileno, random, sizeof(random));
+    close(fileno);
+#else
+    ssize_t result = getrandom(random, sizeof(random), 0);
+#endif // __42_LIKES_WASTING_CPU_CYCLES__
+    if (result != static_cast<ssize_t>(sizeof(random)))
+        throw HttpException(500);
+
+    std::stringstream stream;
+    stream << "webserv-byteranges-" << std::hex << std::setfill('0')
+           << std::setw(16) << random[0] << std::setw(16) << random[1];
+    return stream.str();
 }
 
 /* Attempts to send as many bytes as possible from a slice to a socket,
-   only consumes the bytes that were actually sent */
+   only consumes the bytes that were actually sent (none if the socket would block) */
 size_t HttpResponse::sendSliceToSocket(int fileno, Slice &slice)
 {
     ssize_t result;
 
     result = send(fileno, &slice[0], slice.getLength(), MSG_DONTWAIT);
+#ifndef __42_LIKES_WASTING_CPU_CYCLES__
+    if (result == -1 && (errno == EAGAIN || errno == EWOULDBLOCK))
+        return 0;
+#endif // __42_LIKES_WASTING_CPU_CYCLES__
     if (result == -1)
         throw std::runtime_error("Unable to send data to socket");
     if (result == 0)
@@ -205,12 +700,13 @@ size_t HttpResponse::sendSliceToSocket(int fileno, Slice &slice)
 }
 
 
-/* Buffers and streams bytes out of `_bodyFileno` to the given socket */
+/* Buffers and streams bytes out of `_bodyStream` to the given socket */
 size_t HttpResponse::streamFileToSocket(int fileno)
 {
     if (_bodySlice.isEmpty())
     {
-        _bodyStream.read(_readBuffer, sizeof(_readBuffer));
+        // Never read past the end of a range
+        _bodyStream.read(_readBuffer, std::min(sizeof(_readBuffer), _bodyRemainder));
         if (_bodyStream.bad())
             throw std::runtime_error("Unable to read file");
         size_t bytesRead = _bodyStream.gcount();
@@ -220,3 +716,27 @@ size_t HttpResponse::streamFileToSocket(int fileno)
     }
     return sendSliceToSocket(fileno, _bodySlice);
 }
+
+/* Sends bytes out of `_bodyFile` to the given socket without copying them through
+   user space, returns zero if the socket would block */
+size_t HttpResponse::sendFileToSocket(int fileno)
+{
+#ifdef __42_LIKES_WASTING_CPU_CYCLES__
+    (void)fileno;
+    throw std::logic_error("sendfile() is not supported in this build");
+#else
+    // Ask for everything at once, the kernel stops when the socket buffer is full
+    size_t count = _bodyRemainder;
+    if (count > HTTP_RESPONSE_SENDFILE_MAX_COUNT)
+        count = HTTP_RESPONSE_SENDFILE_MAX_COUNT;
+
+    ssize_t result = sendfile(fileno, _bodyFile->getFileno(), &_bodyOffset, count);
+    if (result == -1 && (errno == EAGAIN || errno == EWOULDBLOCK))
+        return 0;
+    if (result == -1)
+        throw std::runtime_error("Unable to send file to socket");
+    if (result == 0)
+        throw std::runtime_error("Unexpected end of file");
+    return static_cast<size_t>(result);
+#endif // __42_LIKES_WASTING_CPU_CYCLES__
+}
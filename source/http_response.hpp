@@ -8,6 +8,21 @@
 #include <stdint.h>
 
 #include "slice.hpp"
+#include "http_request.hpp"
+#include "file_cache.hpp"
+#include "response_cache.hpp"
+#include "gzip_cache.hpp"
+
+struct CompressionConfig;
+class GzipEncoder;
+
+struct iovec;
+
+/* Largest byte count a single `sendfile()` call transfers on Linux */
+#define HTTP_RESPONSE_SENDFILE_MAX_COUNT 0x7ffff000
+
+/* The largest total length of ranges that are read into memory for a multipart response */
+#define HTTP_RESPONSE_MAX_MULTIPART_LENGTH 1048576
 
 enum HttpResponseState
 {
@@ -22,6 +37,19 @@ public:
     /* Constructs an uninitialized HTTP response */
     HttpResponse();
 
+    /* Releases the body's file, compressed copy and rendered response */
+    ~HttpResponse();
+
+    /* Returns the response into its uninitialized state so it can be reused for another request */
+    void reset();
+
+    /* Sets whether the connection is kept open after the response; must be called before the
+       response is initialized */
+    inline void setKeepAlive(bool keepAlive)
+    {
+        _keepAlive = keepAlive;
+    }
+
     /* Initializes the response object with an empty body */
     inline void initializeEmpty(int statusCode, Slice statusMessage)
     {
@@ -35,30 +63,141 @@ public:
        NOTE: The lifetime of this slice MUST match the response's */
     void initializeUnowned(int statusCode, Slice statusMessage, Slice body);
 
-    /* Initializes the response object with a file stream of the given path */
-    void initializeFileStream(int statusCode, Slice statusMessage, const char *path);
+    /* Initializes the response object with a file stream of the given path, sending only `range`
+       of the file if one is given */
+    void initializeFileStream(int statusCode, Slice statusMessage, const char *path,
+        const ByteRange *range = NULL);
+
+    /* Initializes the response object with an opened file that is sent from its descriptor,
+       taking over the caller's reference to it; only `range` of the file is sent if one is given */
+    void initializeFile(int statusCode, Slice statusMessage, CachedFile *file,
+        const ByteRange *range = NULL);
+
+    /* Initializes a 206 response with a `multipart/byteranges` body holding the given ranges of
+       the file at `path` of `size` bytes, which are read into memory */
+    void initializeFileStreamRanges(const char *path, size_t size, Slice contentType,
+        const std::vector<ByteRange> &ranges);
+
+    /* Initializes a 206 response with a `multipart/byteranges` body holding the given ranges of
+       an opened file, which are read into memory */
+    void initializeFileRanges(const CachedFile &file, Slice contentType,
+        const std::vector<ByteRange> &ranges);
+
+    /* Initializes the response object with a compressed copy of a file, taking over the caller's
+       reference to it */
+    void initializeCompressed(int statusCode, Slice statusMessage, CompressedFile *file);
+
+    /* Initializes the response object with a rendered response, taking over the caller's
+       reference to it; the response is finalized immediately */
+    void initializeCached(CachedResponse *response);
 
     /* Initializes the response object with CGI output data
        NOTE: The lifetime of this slice MUST match the response's */
     void initializeUnownedCgi(Slice response);
 
+    /* Initializes the response object with the header of a CGI output whose body was spilled
+       into a file, taking over the caller's reference to it
+       NOTE: The lifetime of this slice MUST match the response's */
+    void initializeSpilledCgi(Slice header, CachedFile *file);
+
+    /* Initializes the response object with the header of a CGI output whose body is appended
+       while the script produces it; the body is chunked unless the script declared its length */
+    void initializePipedCgi(Slice header);
+
+    /* Gets whether the body of the initialized CGI response may be piped, which a response
+       without content can't be and neither can a body of unknown length if the client doesn't
+       understand chunked encoding */
+    bool isPipeable(bool acceptsChunked) const;
+
+    /* Compresses the piped body of the initialized CGI response while it's appended, which
+       makes the body chunked */
+    void compressPipedBody();
+
+    /* Appends the next bytes of a piped body, framed as a chunk if the body is chunked */
+    void appendPipedBody(Slice data);
+
+    /* Ends a piped body, returns false if it fell short of the length the script declared */
+    bool endPipedBody();
+
     /* Add a header field to the header response */
     void addHeader(Slice key, Slice value);
 
     /* Finalize Header */
     uint64_t finalizeHeader();
 
+    /* Gets whether the initialized body may be compressed according to the given settings,
+       which requires an unencoded in-memory body of an allowed type and length */
+    bool isCompressible(const CompressionConfig &config) const;
+
+    /* Replaces the initialized in-memory body with its gzip encoding */
+    void compressBody();
+
     /* Check if the response has data to send */
     bool hasData();
 
-    /* Start transfer process of the response to the socket */
-    void transferToSocket(int fileno);
+    /* Start transfer process of the response to the socket, returns the number of bytes sent
+       which is zero if the socket would block */
+    size_t transferToSocket(int fileno);
+
+    /* Fills up to `count` I/O vectors with the response's unsent in-memory data,
+       returns the number of vectors used; a streamed body is never included */
+    size_t gatherBuffers(struct iovec *vectors, size_t count);
+
+    /* Marks up to `length` bytes of the gathered data as sent, returns the bytes left over */
+    size_t consumeBuffers(size_t length);
+
+    /* Gets whether all of the response's data is held in memory */
+    inline bool isBuffered() const
+    {
+        return !_bodyStream.is_open() && _bodyFile == NULL;
+    }
+
+    /* Gets whether the body is piped and more of it may still be appended */
+    inline bool isAwaitingBody() const
+    {
+        return _isPipeOpen;
+    }
+
+    /* Gets the number of in-memory body bytes that weren't sent yet */
+    inline size_t getBufferedLength() const
+    {
+        return isBuffered() ? _bodyRemainder : 0;
+    }
+
+    /* Gets whether body bytes are left that are streamed from a file */
+    inline bool hasStreamedBody() const
+    {
+        return !isBuffered() && _bodyRemainder > 0;
+    }
+
+    /* Sends the given I/O vectors to a socket with a single system call, `hasMore` tells the
+       kernel to hold back a partial packet for data that follows immediately;
+       returns the number of bytes sent which is zero if the socket would block */
+    static size_t sendVectorsToSocket(int fileno, struct iovec *vectors, size_t count, bool hasMore);
+
+    /* Formats a strong entity tag from the file metadata that changes along with its content */
+    static std::string formatEntityTag(uint64_t inode, size_t size, time_t modificationTime);
+
+    /* Formats the `Content-Range` of a range within a file of `size` bytes */
+    static std::string formatContentRange(const ByteRange &range, size_t size);
 
     /* Gets the response's current state */
     inline HttpResponseState getState() const
     {
         return _state;
     }
+
+    /* Gets the finalized header; not available for rendered responses */
+    inline Slice getHeader() const
+    {
+        return Slice(_headerString);
+    }
+
+    /* Gets the time the response may take to be sent; only valid when finalized */
+    inline uint64_t getTransferTimeout() const
+    {
+        return _transferTimeout;
+    }
 private:
     HttpResponseState _state;
     std::stringstream _headerStream;
@@ -67,18 +206,58 @@ private:
     Slice             _headerSlice;
     Slice             _bodySlice;
     std::ifstream     _bodyStream;
+    CachedFile       *_bodyFile;
+    CompressedFile   *_compressedFile;
+    CachedResponse   *_cachedResponse;
+    off_t             _bodyOffset;
     size_t            _bodyRemainder;
+    uint64_t          _transferTimeout;
+    bool              _keepAlive;
+    int               _statusCode;
+    std::string       _contentType;
+    bool              _isEncoded;
+    bool              _isPiped;
+    bool              _isPipeOpen;
+    bool              _isChunked;
+    size_t            _pipeRemainder;
+    GzipEncoder      *_pipeEncoder;
     char              _readBuffer[8192];
 
-    /* Initializes the header string stream with a response line */
-    void initializeHeader(int statusCode, Slice statusMessage, size_t bodySize);
+    /* Estimates the time sending the given number of bytes may take at a very slow speed */
+    static uint64_t estimateTransferTimeout(size_t length);
+
+    /* Initializes the header string stream with a response line, the body's length is added once
+       the header is finalized */
+    void initializeHeader(int statusCode, Slice statusMessage);
+
+    /* Initializes the response object with the status and header fields of a CGI output's header
+       and the given body; a declared length is remembered for a piped body */
+    void initializeCgi(Slice header, Slice body);
+
+    /* Appends the delimiter and header of a multipart body's part for a file's range */
+    static void appendRangePart(std::string &body, const std::string &boundary, Slice contentType,
+        const ByteRange &range, size_t size);
+
+    /* Closes a multipart body and initializes the response with it, the body is taken over */
+    void initializeMultipart(std::string &body, const std::string &boundary);
+
+    /* Creates a delimiter for the parts of a multipart body */
+    static std::string createBoundary();
 
     /* Attempts to send as many bytes as possible from a slice to a socket,
-       only consumes the bytes that were actually sent */
+       only consumes the bytes that were actually sent (none if the socket would block) */
     size_t sendSliceToSocket(int fileno, Slice &slice);
 
-    /* Buffers and streams bytes out of `_bodyFileno` to the given socket */
+    /* Buffers and streams bytes out of `_bodyStream` to the given socket */
     size_t streamFileToSocket(int fileno);
+
+    /* Sends bytes out of `_bodyFile` to the given socket without copying them through
+       user space, returns zero if the socket would block */
+    size_t sendFileToSocket(int fileno);
+
+    /* Disable copy-construction and copy-assignment */
+    HttpResponse(const HttpResponse &other);
+    HttpResponse &operator=(const HttpResponse &other);
 };
 
 #endif // HTTP_RESPONSE_hpp
@@ -1,39 +1,17 @@
 #include "application.hpp"
 #include "http_server.hpp"
 
+#include <errno.h>
 #include <unistd.h>
 #include <arpa/inet.h>
 #include <sys/socket.h>
 
-/* Constructs an HTTP server according to its configuration */
-HttpServer::HttpServer(Application &application, const ServerConfig &config)
+/* Constructs an HTTP server that takes ownership of the given listening socket */
+HttpServer::HttpServer(Application &application, const ServerConfig &config, int fileno)
     : _application(application)
     , _config(config)
+    , _fileno(fileno)
 {
-    if ((_fileno = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP)) < 0)
-        throw std::runtime_error("Unable to create TCP listener socket");
-
-    // Populate the binding address
-    sockaddr_in address = {};
-    address.sin_family      = AF_INET;
-    address.sin_addr.s_addr = htonl(config.host);
-    address.sin_port        = htons(config.port);
-
-    // Prevent the OS from holding the TCP port when the server exits
-    int option = 1;
-    setsockopt(_fileno, SOL_SOCKET, SO_REUSEADDR, &option, sizeof(option));
-
-    // Bind to the binding address and start listening
-    if (bind(_fileno, (const sockaddr *)&address, sizeof(address)) != 0)
-    {
-        close(_fileno);
-        throw std::runtime_error("Unable to bind TCP listener socket");
-    }
-    if (listen(_fileno, 128) != 0)
-    {
-        close(_fileno);
-        throw std::runtime_error("Unable to listen on TCP listener socket");
-    }
 }
 
 /* Closes the server's listening socket */
@@ -48,13 +26,87 @@ void HttpServer::handleEvents(uint32_t eventMask)
     if ((eventMask & EPOLLIN) == 0)
         return;
 
+#ifdef __42_LIKES_WASTING_CPU_CYCLES__
+    acceptClient();
+#else
+    // Drain the backlog, but only up to the budget so that a connection storm doesn't starve the
+    // connected clients
+    try
+    {
+        for (size_t count = 0; count < _config.acceptBudget; count++)
+        {
+            if (!acceptClient())
+                return;
+        }
+    }
+    catch (...)
+    {
+        // A failed accept (e.g. EMFILE) leaves the rest of the backlog pending as well
+        if (_application._dispatcher.isEdgeTriggered())
+            _application._dispatcher.rearm(_fileno);
+        throw;
+    }
+
+    // The backlog may still hold connections which edge-triggered readiness won't report again
+    if (_application._dispatcher.isEdgeTriggered())
+        _application._dispatcher.rearm(_fileno);
+#endif // __42_LIKES_WASTING_CPU_CYCLES__
+}
+
+/* Handles an exception that occurred in `handleEvent()` */
+void HttpServer::handleException(const char *message)
+{
+    (void)message;
+}
+
+/* Accepts one pending connection, returns false when there was none */
+bool HttpServer::acceptClient()
+{
     int         fileno;
     sockaddr_in address;
     socklen_t   addressLength = sizeof(address);
 
-    if ((fileno = accept(_fileno, (sockaddr *)&address, &addressLength)) < 0)
+#ifdef __42_LIKES_WASTING_CPU_CYCLES__
+    fileno = accept(_fileno, (sockaddr *)&address, &addressLength);
+#else
+    // Clients are drained until they would block and must not leak into CGI processes
+    fileno = accept4(_fileno, (sockaddr *)&address, &addressLength, SOCK_NONBLOCK | SOCK_CLOEXEC);
+#endif // __42_LIKES_WASTING_CPU_CYCLES__
+    if (fileno < 0)
+    {
+#ifndef __42_LIKES_WASTING_CPU_CYCLES__
+        if (errno == EAGAIN || errno == EWOULDBLOCK)
+            return false;
+        // The connection was reset while pending, continue with the next one
+        if (errno == ECONNABORTED)
+            return true;
+#endif // __42_LIKES_WASTING_CPU_CYCLES__
         throw std::runtime_error("Unable to accept client");
+    }
+
+    takeClient(fileno, address);
+    return true;
+}
+
+#ifndef __42_LIKES_WASTING_CPU_CYCLES__
+/* Takes over a connection that the dispatcher accepted on the listening socket */
+void HttpServer::handleAccepted(int fileno)
+{
+    // The accept left out the peer's address; a connection reset since then is dropped
+    sockaddr_in address;
+    socklen_t   addressLength = sizeof(address);
+    if (getpeername(fileno, (sockaddr *)&address, &addressLength) != 0)
+    {
+        close(fileno);
+        return;
+    }
+    takeClient(fileno, address);
+}
+#endif // __42_LIKES_WASTING_CPU_CYCLES__
 
+/* Hands an accepted connection from the given address over to the application */
+void HttpServer::takeClient(int fileno, const sockaddr_in &address)
+{
     try
     {
         _application.takeClient(fileno, _config, ntohl(address.sin_addr.s_addr), ntohs(address.sin_port));
@@ -66,8 +118,47 @@ void HttpServer::handleEvents(uint32_t eventMask)
     }
 }
 
-/* Handles an exception that occurred in `handleEvent()` */
-void HttpServer::handleException(const char *message)
+/* Creates a TCP socket listening on the configuration's address; when `reusePort` is set, other
+   sockets may bind the same address so the kernel balances connections between them */
+int HttpServer::bindListener(const ServerConfig &config, bool reusePort)
 {
-    (void)message;
+    int fileno;
+#ifdef __42_LIKES_WASTING_CPU_CYCLES__
+    fileno = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+#else
+    // Accepting drains the backlog until it would block; the listener must not leak into CGI processes
+    fileno = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, IPPROTO_TCP);
+#endif // __42_LIKES_WASTING_CPU_CYCLES__
+    if (fileno < 0)
+        throw std::runtime_error("Unable to create TCP listener socket");
+
+    // Populate the binding address
+    sockaddr_in address = {};
+    address.sin_family      = AF_INET;
+    address.sin_addr.s_addr = htonl(config.host);
+    address.sin_port        = htons(config.port);
+
+    // Prevent the OS from holding the TCP port when the server exits
+    int option = 1;
+    setsockopt(fileno, SOL_SOCKET, SO_REUSEADDR, &option, sizeof(option));
+
+    // Let every worker bind its own listener on the same address
+    if (reusePort && setsockopt(fileno, SOL_SOCKET, SO_REUSEPORT, &option, sizeof(option)) != 0)
+    {
+        close(fileno);
+        throw std::runtime_error("Unable to enable port reuse on TCP listener socket");
+    }
+
+    // Bind to the binding address and start listening
+    if (bind(fileno, (const sockaddr *)&address, sizeof(address)) != 0)
+    {
+        close(fileno);
+        throw std::runtime_error("Unable to bind TCP listener socket");
+    }
+    if (listen(fileno, static_cast<int>(config.listenBacklog)) != 0)
+    {
+        close(fileno);
+        throw std::runtime_error("Unable to listen on TCP listener socket");
+    }
+    return fileno;
 }
@@ -4,13 +4,20 @@
 #include "config.hpp"
 #include "dispatcher.hpp"
 
+#include <map>
+#include <stdint.h>
+#include <netinet/in.h>
+
 class Application;
 
+/* Maps the binding key of a host and port to a socket that is already listening on it */
+typedef std::map<uint64_t, int> ListenerMap;
+
 class HttpServer: public Sink
 {
 public:
-    /* Constructs an HTTP server according to its configuration */
-    HttpServer(Application &application, const ServerConfig &config);
+    /* Constructs an HTTP server that takes ownership of the given listening socket */
+    HttpServer(Application &application, const ServerConfig &config, int fileno);
 
     /* Closes the server's listening socket */
     ~HttpServer();
@@ -20,6 +27,10 @@ public:
     {
         return _fileno;
     }
+
+    /* Creates a TCP socket listening on the configuration's address; when `reusePort` is set, other
+       sockets may bind the same address so the kernel balances connections between them */
+    static int bindListener(const ServerConfig &config, bool reusePort);
 private:
     Application        &_application;
     const ServerConfig &_config;
@@ -31,6 +42,17 @@ private:
     /* Handles an exception that occurred in `handleEvent()` */
     void handleException(const char *message);
 
+    /* Accepts one pending connection, returns false when there was none */
+    bool acceptClient();
+
+#ifndef __42_LIKES_WASTING_CPU_CYCLES__
+    /* Takes over a connection that the dispatcher accepted on the listening socket */
+    void handleAccepted(int fileno);
+#endif // __42_LIKES_WASTING_CPU_CYCLES__
+
+    /* Hands an accepted connection from the given address over to the application */
+    void takeClient(int fileno, const sockaddr_in &address);
+
     /* Disable copy-construction and copy-assignment */
     HttpServer(const HttpServer &other);
     HttpServer &operator=(const HttpServer &other);
@@ -1,8 +1,8 @@
-#include "application.hpp"
 #include "config_parser.hpp"
 #include "config_tokenizer.hpp"
 #include "debug_utility.hpp"
 #include "routing.hpp"
+#include "worker_pool.hpp"
 
 #include <iostream>
 
@@ -30,12 +30,11 @@ int main(int argc, char *argv[])
         return 1;
     }
 
-    // Start the application using the parsed configuration
+    // Start the workers using the parsed configuration
     try
     {
-        Application application(config);
-        application.configure();
-        application.mainLoop();
+        WorkerPool pool(config);
+        pool.run();
     }
     catch (std::exception &exception)
     {
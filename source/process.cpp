@@ -1,6 +1,8 @@
 #include "process.hpp"
 #include "slice.hpp"
+#include "utility.hpp"
 
+#include <fcntl.h>
 #include <unistd.h>
 #include <signal.h>
 #include <stdlib.h>
@@ -10,18 +12,22 @@
 
 
 /* Starts a child process using the given constant string arrays
-   The arrays must be NULL-terminated, see `man execve(2)` */
-Process::Process(const char **argArray, const char **envArray, const std::string &workingDirectory)
+   The arrays must be NULL-terminated, see `man execve(2)`
+   The child reads its standard input from `inputFileno` if given, otherwise from a pipe */
+Process::Process(const char **argArray, const char **envArray, const std::string &workingDirectory,
+    int inputFileno)
 {
-    startChild(argArray, envArray, workingDirectory);
+    startChild(argArray, envArray, workingDirectory, inputFileno);
 }
 
-/* Starts a child process using the given dynamic string vectors */
-Process::Process(const std::vector<std::string> &argVec, const std::vector<std::string> &envVec, const std::string &workingDirectory)
+/* Starts a child process using the given dynamic string vectors
+   The child reads its standard input from `inputFileno` if given, otherwise from a pipe */
+Process::Process(const std::vector<std::string> &argVec, const std::vector<std::string> &envVec, const std::string &workingDirectory,
+    int inputFileno)
 {
     std::vector<const char *> argvVector = toCharPointers(argVec);
     std::vector<const char *> envpVector = toCharPointers(envVec);
-    startChild(argvVector.data(), envpVector.data(), workingDirectory);
+    startChild(argvVector.data(), envpVector.data(), workingDirectory, inputFileno);
 }
 
 /* Kills the child process and closes the socket */
@@ -76,11 +82,14 @@ ProcessStatus Process::getStatus()
 }
 
 /* Starts a child process using the given constant string arrays */
-void Process::startChild(const char **argArray, const char **envArray, const std::string &workingDirectory)
+void Process::startChild(const char **argArray, const char **envArray, const std::string &workingDirectory,
+    int inputFileno)
 {
-    // Set up pipes for communication with the child
+    // Set up pipes for communication with the child, a given input needs none
     Pipe inputPipe, outputPipe;
-    setupPipeIO(inputPipe, outputPipe);
+    setupPipeIO(inputPipe, outputPipe, inputFileno < 0);
+    if (inputFileno < 0)
+        inputFileno = inputPipe.readFileno;
 
     // Fork the process and clean up on failure
     if ((_pid = fork()) < 0)
@@ -102,8 +111,11 @@ void Process::startChild(const char **argArray, const char **envArray, const std
         if (chdir(workingDirectory.c_str()) < 0)
             std::exit(255);
 
+        // Ignored signals stay ignored across execve(), but the script expects the default
+        signal(SIGPIPE, SIG_DFL);
+
         // Only execute the process when both dup2() calls succeeded
-        if (dup2(inputPipe.readFileno, STDIN_FILENO) >= 0 &&
+        if (dup2(inputFileno, STDIN_FILENO) >= 0 &&
             dup2(outputPipe.writeFileno, STDOUT_FILENO) >= 0)
         {
             execve(argArray[0], (char *const *)argArray, (char *const *)envArray);
@@ -136,18 +148,24 @@ std::vector<const char *> Process::toCharPointers(const std::vector<std::string>
     return outputVector;
 }
 
-/* Sets up pipes for communication with the child process */
-void Process::setupPipeIO(Pipe &inputPipe, Pipe &outputPipe)
+/* Sets up pipes for communication with the child process, the input pipe is left out if
+   `hasInput` is not set */
+void Process::setupPipeIO(Pipe &inputPipe, Pipe &outputPipe, bool hasInput)
 {
     int descriptors[2];
 
-    if (pipe(descriptors) != 0)
-        throw std::runtime_error("Unable to create input pipe");
-
-    inputPipe.readFileno = descriptors[0];
-    inputPipe.writeFileno = descriptors[1];
+    // Closing the left out pipe's descriptors is a harmless no-op
+    inputPipe.readFileno = -1;
+    inputPipe.writeFileno = -1;
+    if (hasInput)
+    {
+        if (createPipe(descriptors) != 0)
+            throw std::runtime_error("Unable to create input pipe");
+        inputPipe.readFileno = descriptors[0];
+        inputPipe.writeFileno = descriptors[1];
+    }
 
-    if (pipe(descriptors) != 0)
+    if (createPipe(descriptors) != 0)
     {
         close(inputPipe.readFileno);
         close(inputPipe.writeFileno);
@@ -156,4 +174,32 @@ void Process::setupPipeIO(Pipe &inputPipe, Pipe &outputPipe)
 
     outputPipe.readFileno = descriptors[0];
     outputPipe.writeFileno = descriptors[1];
+
+#ifndef __42_LIKES_WASTING_CPU_CYCLES__
+    // The parent-owned ends are drained until they would block
+    try
+    {
+        if (hasInput)
+            Utility::setNonBlocking(inputPipe.writeFileno);
+        Utility::setNonBlocking(outputPipe.readFileno);
+    }
+    catch (...)
+    {
+        close(inputPipe.readFileno);
+        close(inputPipe.writeFileno);
+        close(outputPipe.readFileno);
+        close(outputPipe.writeFileno);
+        throw;
+    }
+#endif // __42_LIKES_WASTING_CPU_CYCLES__
+}
+
+/* Creates a pipe whose ends are not inherited by other executed programs */
+int Process::createPipe(int descriptors[2])
+{
+#ifdef __42_LIKES_WASTING_CPU_CYCLES__
+    return pipe(descriptors);
+#else
+    return pipe2(descriptors, O_CLOEXEC);
+#endif // __42_LIKES_WASTING_CPU_CYCLES__
 }
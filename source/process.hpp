@@ -15,11 +15,15 @@ class Process
 {
 public:
     /* Starts a child process using the given constant string arrays
-       The arrays must be NULL-terminated, see `man execve(2)` */
-    Process(const char **argArray, const char **envArray, const std::string &workingDirectory);
+       The arrays must be NULL-terminated, see `man execve(2)`
+       The child reads its standard input from `inputFileno` if given, otherwise from a pipe */
+    Process(const char **argArray, const char **envArray, const std::string &workingDirectory,
+        int inputFileno = -1);
 
-    /* Starts a child process using the given dynamic string vectors */
-    Process(const std::vector<std::string> &argVec, const std::vector<std::string> &envVec, const std::string &workingDirectory);
+    /* Starts a child process using the given dynamic string vectors
+       The child reads its standard input from `inputFileno` if given, otherwise from a pipe */
+    Process(const std::vector<std::string> &argVec, const std::vector<std::string> &envVec, const std::string &workingDirectory,
+        int inputFileno = -1);
 
     /* Kills the child process and closes the socket */
     ~Process();
@@ -39,7 +43,8 @@ public:
         return _pid;
     }
 
-    /* Gets the file descriptor for writing into the child's standard input */
+    /* Gets the file descriptor for writing into the child's standard input, -1 if the child
+       reads from a given file descriptor instead */
     inline int getInputFileno()
     {
         return _inputFileno;
@@ -64,13 +69,18 @@ private:
     int           _outputFileno;
 
     /* Starts a child process using the given constant string arrays */
-    void startChild(const char **argArray, const char **envArray, const std::string &workingDirectory);
+    void startChild(const char **argArray, const char **envArray, const std::string &workingDirectory,
+        int inputFileno);
 
     /* Converts the given vector of C++ strings into a NULL-terminated vector of C strings */
     static std::vector<const char *> toCharPointers(const std::vector<std::string> &inputVec);
 
-    /* Sets up pipes for communication with the child process */
-    void setupPipeIO(Pipe &inputPipe, Pipe &outputPipe);
+    /* Sets up pipes for communication with the child process, the input pipe is left out if
+       `hasInput` is not set */
+    void setupPipeIO(Pipe &inputPipe, Pipe &outputPipe, bool hasInput);
+
+    /* Creates a pipe whose ends are not inherited by other executed programs */
+    static int createPipe(int descriptors[2]);
 
     /* Disable copy-construction and copy-assignment */
     Process(const Process &other);
@@ -0,0 +1,328 @@
+#include "response_cache.hpp"
+
+#include <errno.h>
+#include <unistd.h>
+#include <stdexcept>
+#include <sys/stat.h>
+#include <sys/inotify.h>
+
+/* The changes of a watched directory that may affect the responses of its files */
+#define RESPONSE_CACHE_WATCH_MASK (IN_MODIFY | IN_CLOSE_WRITE | IN_ATTRIB | IN_CREATE | IN_DELETE \
+    | IN_MOVED_FROM | IN_MOVED_TO | IN_DELETE_SELF | IN_MOVE_SELF | IN_ONLYDIR)
+
+/* The changes that end the watch of a directory */
+#define RESPONSE_CACHE_GONE_MASK (IN_DELETE_SELF | IN_MOVE_SELF | IN_UNMOUNT | IN_IGNORED)
+
+/* Constructs an empty response for the given file, status code, connection handling and
+   negotiated content coding */
+CachedResponse::CachedResponse(const std::string &path, int statusCode, bool keepAlive, const std::string &contentCoding)
+    : _path(path)
+    , _statusCode(statusCode)
+    , _keepAlive(keepAlive)
+    , _contentCoding(contentCoding)
+    , _references(1)
+    , _newer(NULL)
+    , _older(NULL)
+{
+}
+
+/* Drops a reference, the response is destroyed when the last one is gone */
+void CachedResponse::release()
+{
+    if (--_references == 0)
+        delete this;
+}
+
+/* Constructs a key from its parts */
+ResponseCache::Key::Key(const std::string &path, int statusCode, bool keepAlive, const std::string &contentCoding)
+    : path(path)
+    , statusCode(statusCode)
+    , keepAlive(keepAlive)
+    , contentCoding(contentCoding)
+{
+}
+
+/* Orders keys by their path first */
+bool ResponseCache::Key::operator<(const Key &other) const
+{
+    int comparison = path.compare(other.path);
+    if (comparison != 0)
+        return comparison < 0;
+    if (statusCode != other.statusCode)
+        return statusCode < other.statusCode;
+    if (keepAlive != other.keepAlive)
+        return keepAlive < other.keepAlive;
+    return contentCoding < other.contentCoding;
+}
+
+/* Constructs a cache holding up to `budget` bytes of responses, a budget of zero disables
+   caching; node types of uncached paths are answered by `fileCache` */
+ResponseCache::ResponseCache(FileCache &fileCache, size_t budget)
+    : _fileCache(fileCache)
+    , _budget(budget)
+    , _size(0)
+    , _fileno(-1)
+    , _newest(NULL)
+    , _oldest(NULL)
+{
+    if (budget == 0)
+        return;
+#ifdef __42_LIKES_WASTING_CPU_CYCLES__
+    throw std::runtime_error("The response cache is not supported in this build");
+#else
+    if ((_fileno = inotify_init1(IN_NONBLOCK | IN_CLOEXEC)) < 0)
+        throw std::runtime_error("Unable to create inotify instance");
+#endif // __42_LIKES_WASTING_CPU_CYCLES__
+}
+
+/* Drops the cache's references to all responses and closes the inotify instance */
+ResponseCache::~ResponseCache()
+{
+    clear();
+    if (_fileno >= 0)
+        close(_fileno);
+}
+
+/* Queries the type of node at the given FS path, cached files are known to be regular */
+NodeType ResponseCache::queryNodeType(const std::string &path)
+{
+    ResponseMap::iterator iterator = _responses.lower_bound(Key(path, 0, false, std::string()));
+    if (iterator != _responses.end() && iterator->first.path == path)
+        return NODE_TYPE_REGULAR;
+    return _fileCache.queryNodeType(path);
+}
+
+/* Gets a reference to the cached response for the given file, status code, connection
+   handling and negotiated content coding (empty if none was negotiated), which the caller
+   must release; returns NULL if there is none */
+CachedResponse *ResponseCache::find(const std::string &path, int statusCode, bool keepAlive,
+    const std::string &contentCoding)
+{
+    if (_fileno < 0)
+        return NULL;
+
+    ResponseMap::iterator iterator = _responses.find(Key(path, statusCode, keepAlive, contentCoding));
+    if (iterator == _responses.end())
+        return NULL;
+
+    CachedResponse *response = iterator->second;
+    unlink(response);
+    link(response);
+    return response->acquire();
+}
+
+/* Renders the given header and the file's content into a cached response,
+   silently gives up if the file can't be read or watched */
+void ResponseCache::insert(const std::string &path, int statusCode, bool keepAlive, const std::string &contentCoding,
+    Slice header, const CachedFile &file)
+{
+    Key key(path, statusCode, keepAlive, contentCoding);
+    size_t size = header.getLength() + file.getSize();
+    if (!accepts(file.getSize()) || size > _budget)
+        return;
+    if (_responses.find(key) != _responses.end())
+        return;
+
+    // Only trust the opened file if it is still the one at the path once changes are reported
+    struct stat status;
+    if (!watchDirectory(path))
+        return;
+    if (stat(path.c_str(), &status) != 0
+     || status.st_ino != file.getInode()
+     || static_cast<size_t>(status.st_size) != file.getSize()
+     || status.st_mtime != file.getModificationTime())
+        return;
+
+    // Render the header and the body into a single buffer
+    CachedResponse *response = new CachedResponse(path, statusCode, keepAlive, contentCoding);
+    try
+    {
+        response->_data.reserve(size);
+        response->_data.append(&header[0], header.getLength());
+        response->_data.resize(size);
+        if (file.getSize() > 0)
+        {
+            ssize_t result = pread(file.getFileno(), &response->_data[header.getLength()], file.getSize(), 0);
+            if (result < 0 || static_cast<size_t>(result) != file.getSize())
+            {
+                delete response;
+                return;
+            }
+        }
+
+        // Make room for the response by dropping the least recently used ones
+        while (_size + size > _budget)
+            remove(_oldest);
+        _responses.insert(std::make_pair(key, response));
+    }
+    catch (...)
+    {
+        delete response;
+        throw;
+    }
+    link(response);
+    _size += size;
+}
+
+/* Drops the responses of files whose directory reported changes */
+void ResponseCache::handleEvents(uint32_t eventMask)
+{
+    (void)eventMask;
+
+    // The union aligns the buffer for the events within it
+    union
+    {
+        struct inotify_event event;
+        char                 bytes[4096];
+    } buffer;
+
+    // Read until the queue is empty since edge-triggered readiness is only reported once
+    while (true)
+    {
+        ssize_t length = read(_fileno, buffer.bytes, sizeof(buffer.bytes));
+        if (length < 0)
+        {
+            if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)
+                return;
+            throw std::runtime_error("Unable to read file changes");
+        }
+
+        ssize_t offset = 0;
+        while (offset < length)
+        {
+            const struct inotify_event *event = reinterpret_cast<const struct inotify_event *>(&buffer.bytes[offset]);
+            handleChange(event->wd, event->mask, event->len > 0 ? event->name : "");
+            offset += sizeof(struct inotify_event) + event->len;
+        }
+    }
+}
+
+/* Clears the cache since changes might have been missed */
+void ResponseCache::handleException(const char *message)
+{
+    (void)message;
+    clear();
+}
+
+/* Watches the directory of the given path, returns false if that's impossible */
+bool ResponseCache::watchDirectory(const std::string &path)
+{
+    std::string directory = getDirectory(path);
+    int watch = inotify_add_watch(_fileno, directory.c_str(), RESPONSE_CACHE_WATCH_MASK);
+    if (watch < 0)
+        return false;
+
+    // The same directory may be reached through differently spelled paths
+    _watches[watch].insert(directory);
+    return true;
+}
+
+/* Handles an inotify event for the given watch and (possibly empty) file name */
+void ResponseCache::handleChange(int watch, uint32_t eventMask, const char *name)
+{
+    if (eventMask & IN_Q_OVERFLOW)
+    {
+        clear();
+        return;
+    }
+
+    WatchMap::iterator iterator = _watches.find(watch);
+    if (iterator == _watches.end())
+        return;
+
+    std::set<std::string>::const_iterator directory = iterator->second.begin();
+    for (; directory != iterator->second.end(); directory++)
+    {
+        if (*name != '\0')
+            invalidateFile(*directory + "/" + name);
+        if (eventMask & RESPONSE_CACHE_GONE_MASK)
+            invalidateDirectory(*directory);
+    }
+
+    // A directory that is gone is watched again once one of its files is cached
+    if (eventMask & RESPONSE_CACHE_GONE_MASK)
+    {
+        if (!(eventMask & IN_IGNORED))
+            inotify_rm_watch(_fileno, watch);
+        _watches.erase(iterator);
+    }
+}
+
+/* Drops all responses of the given file and the file itself from the open file cache */
+void ResponseCache::invalidateFile(const std::string &path)
+{
+    _fileCache.invalidate(path);
+
+    ResponseMap::iterator iterator = _responses.lower_bound(Key(path, 0, false, std::string()));
+    while (iterator != _responses.end() && iterator->first.path == path)
+    {
+        CachedResponse *response = iterator->second;
+        iterator++;
+        remove(response);
+    }
+}
+
+/* Drops all responses of files in the given directory */
+void ResponseCache::invalidateDirectory(const std::string &directory)
+{
+    ResponseMap::iterator iterator = _responses.begin();
+    while (iterator != _responses.end())
+    {
+        CachedResponse *response = iterator->second;
+        iterator++;
+        if (getDirectory(response->_path) == directory)
+            remove(response);
+    }
+}
+
+/* Drops all responses */
+void ResponseCache::clear()
+{
+    while (_newest != NULL)
+        remove(_newest);
+}
+
+/* Removes a response from the cache and drops the cache's reference */
+void ResponseCache::remove(CachedResponse *response)
+{
+    _responses.erase(Key(response->_path, response->_statusCode, response->_keepAlive, response->_contentCoding));
+    unlink(response);
+    _size -= response->_data.size();
+    response->release();
+}
+
+/* Links a response in front of the recently used list */
+void ResponseCache::link(CachedResponse *response)
+{
+    response->_older = _newest;
+    response->_newer = NULL;
+    if (_newest != NULL)
+        _newest->_newer = response;
+    else
+        _oldest = response;
+    _newest = response;
+}
+
+/* Unlinks a response from the recently used list */
+void ResponseCache::unlink(CachedResponse *response)
+{
+    if (response->_newer != NULL)
+        response->_newer->_older = response->_older;
+    else
+        _newest = response->_older;
+    if (response->_older != NULL)
+        response->_older->_newer = response->_newer;
+    else
+        _oldest = response->_newer;
+    response->_newer = NULL;
+    response->_older = NULL;
+}
+
+/* Gets the directory part of a path */
+std::string ResponseCache::getDirectory(const std::string &path)
+{
+    size_t position = path.rfind('/');
+    if (position == std::string::npos)
+        return ".";
+    return path.substr(0, position);
+}
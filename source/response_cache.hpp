@@ -0,0 +1,162 @@
+#ifndef RESPONSE_CACHE_hpp
+#define RESPONSE_CACHE_hpp
+
+#include "slice.hpp"
+#include "dispatcher.hpp"
+#include "file_cache.hpp"
+
+#include <map>
+#include <set>
+#include <string>
+#include <stdint.h>
+
+/* The largest file body that is kept in a rendered response */
+#define RESPONSE_CACHE_MAX_BODY_SIZE 65536
+
+/* A completely rendered response (status line, header fields and body) that is shared by the
+   cache and the responses sending it */
+class CachedResponse
+{
+public:
+    friend class ResponseCache;
+
+    /* Takes another reference to the response */
+    inline CachedResponse *acquire()
+    {
+        _references++;
+        return this;
+    }
+
+    /* Drops a reference, the response is destroyed when the last one is gone */
+    void release();
+
+    /* Gets the rendered response */
+    inline Slice getData() const
+    {
+        return Slice(_data);
+    }
+private:
+    std::string     _path;
+    int             _statusCode;
+    bool            _keepAlive;
+    std::string     _contentCoding;
+    std::string     _data;
+    size_t          _references;
+    CachedResponse *_newer;
+    CachedResponse *_older;
+
+    /* Constructs an empty response for the given file, status code, connection handling and
+       negotiated content coding */
+    CachedResponse(const std::string &path, int statusCode, bool keepAlive, const std::string &contentCoding);
+
+    /* Disable copy-construction and copy-assignment */
+    CachedResponse(const CachedResponse &other);
+    CachedResponse &operator=(const CachedResponse &other);
+};
+
+/* Keeps rendered responses of small files within a byte budget, the least recently used ones are
+   dropped first; responses are invalidated as soon as inotify reports a change in the directory
+   of their file */
+class ResponseCache: public Sink, public NodeTypeSource
+{
+public:
+    /* Constructs a cache holding up to `budget` bytes of responses, a budget of zero disables
+       caching; node types of uncached paths are answered by `fileCache` */
+    ResponseCache(FileCache &fileCache, size_t budget);
+
+    /* Drops the cache's references to all responses and closes the inotify instance */
+    ~ResponseCache();
+
+    /* Gets the inotify file descriptor to wait for changes on, -1 if caching is disabled */
+    inline int getFileno() const
+    {
+        return _fileno;
+    }
+
+    /* Gets whether a response with a body of the given size may be cached */
+    inline bool accepts(size_t bodySize) const
+    {
+        return _fileno >= 0 && bodySize <= RESPONSE_CACHE_MAX_BODY_SIZE;
+    }
+
+    /* Queries the type of node at the given FS path, cached files are known to be regular */
+    NodeType queryNodeType(const std::string &path);
+
+    /* Gets a reference to the cached response for the given file, status code, connection
+       handling and negotiated content coding (empty if none was negotiated), which the caller
+       must release; returns NULL if there is none */
+    CachedResponse *find(const std::string &path, int statusCode, bool keepAlive,
+        const std::string &contentCoding);
+
+    /* Renders the given header and the file's content into a cached response,
+       silently gives up if the file can't be read or watched */
+    void insert(const std::string &path, int statusCode, bool keepAlive, const std::string &contentCoding,
+        Slice header, const CachedFile &file);
+
+    /* Drops the responses of files whose directory reported changes */
+    void handleEvents(uint32_t eventMask);
+
+    /* Clears the cache since changes might have been missed */
+    void handleException(const char *message);
+private:
+    /* Identifies a response by its file, status code, connection handling and negotiated
+       content coding */
+    struct Key
+    {
+        std::string path;
+        int         statusCode;
+        bool        keepAlive;
+        std::string contentCoding;
+
+        /* Constructs a key from its parts */
+        Key(const std::string &path, int statusCode, bool keepAlive, const std::string &contentCoding);
+
+        /* Orders keys by their path first */
+        bool operator<(const Key &other) const;
+    };
+
+    typedef std::map<Key, CachedResponse *>           ResponseMap;
+    typedef std::map<int, std::set<std::string> >     WatchMap;
+
+    FileCache       &_fileCache;
+    size_t           _budget;
+    size_t           _size;
+    int              _fileno;
+    ResponseMap      _responses;
+    WatchMap         _watches;
+    CachedResponse  *_newest;
+    CachedResponse  *_oldest;
+
+    /* Watches the directory of the given path, returns false if that's impossible */
+    bool watchDirectory(const std::string &path);
+
+    /* Handles an inotify event for the given watch and (possibly empty) file name */
+    void handleChange(int watch, uint32_t eventMask, const char *name);
+
+    /* Drops all responses of the given file and the file itself from the open file cache */
+    void invalidateFile(const std::string &path);
+
+    /* Drops all responses of files in the given directory */
+    void invalidateDirectory(const std::string &directory);
+
+    /* Drops all responses */
+    void clear();
+
+    /* Removes a response from the cache and drops the cache's reference */
+    void remove(CachedResponse *response);
+
+    /* Links a response in front of the recently used list */
+    void link(CachedResponse *response);
+
+    /* Unlinks a response from the recently used list */
+    void unlink(CachedResponse *response);
+
+    /* Gets the directory part of a path */
+    static std::string getDirectory(const std::string &path);
+
+    /* Disable copy-construction and copy-assignment */
+    ResponseCache(const ResponseCache &other);
+    ResponseCache &operator=(const ResponseCache &other);
+};
+
+#endif // RESPONSE_CACHE_hpp
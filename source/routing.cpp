@@ -16,8 +16,11 @@ void RoutingInfo::setRedirectRoute(const RedirectRouteConfig *redirectRouteConfi
     _opaqueRoute = reinterpret_cast<const void *>(redirectRouteConfig);
 }
 
-/* Finds a route on a server configuration using the given query path */
-RoutingInfo RoutingInfo::findRoute(const ServerConfig &serverConfig, Slice queryPath)
+/* Finds a route on a server configuration using the given query path, the node types are
+   answered by the given (caching) source; routes to missing nodes are only taken if
+   `allowMissing` is set, e.g. for files that are about to be created */
+RoutingInfo RoutingInfo::findRoute(const ServerConfig &serverConfig, Slice queryPath, NodeTypeSource &nodeTypes,
+    bool allowMissing)
 {
     RoutingInfo info;
     NodeType    nodeType;
@@ -25,6 +28,7 @@ RoutingInfo RoutingInfo::findRoute(const ServerConfig &serverConfig, Slice query
 
     // Set initial info
     info.status = ROUTING_STATUS_NOT_FOUND;
+    info.fastCgiAddress = NULL;
     info.serverConfig = &serverConfig;
 
     // Search for a local route
@@ -40,7 +44,7 @@ RoutingInfo RoutingInfo::findRoute(const ServerConfig &serverConfig, Slice query
 
         // Build the full node path
         std::string path = config.rootDirectory + "/" + queryPath.cut(config.path.size()).stripStart('/').stripEnd('/').toString();
-        nodeType = Utility::queryNodeType(path);
+        nodeType = nodeTypes.queryNodeType(path);
 
         // Return early when a node exists but is not accessible
         if (nodeType == NODE_TYPE_NO_ACCESS || nodeType == NODE_TYPE_UNSUPPORTED)
@@ -50,11 +54,13 @@ RoutingInfo RoutingInfo::findRoute(const ServerConfig &serverConfig, Slice query
         }
 
         // Ignore routes where 
-        if (nodeType != NODE_TYPE_REGULAR && nodeType != NODE_TYPE_DIRECTORY)
+        if (nodeType != NODE_TYPE_REGULAR && nodeType != NODE_TYPE_DIRECTORY
+         && !(allowMissing && nodeType == NODE_TYPE_NOT_FOUND))
             continue;
 
         // Populate with the current route
         info.hasCgiInterpreter = false;
+        info.fastCgiAddress = NULL;
         bestLength = config.path.size();
         info.nodePath = path;
         info.setLocalRoute(&config, nodeType);
@@ -70,6 +76,18 @@ RoutingInfo RoutingInfo::findRoute(const ServerConfig &serverConfig, Slice query
                 break;
             }
         }
+
+        // Search for the FastCGI application, which then runs the script instead
+        std::map<std::string, FastCgiAddress>::const_iterator application = config.fastCgiTypes.begin();
+        for (; !info.hasCgiInterpreter && application != config.fastCgiTypes.end(); application++)
+        {
+            if (queryPath.endsWith(application->first))
+            {
+                info.hasCgiInterpreter = true;
+                info.fastCgiAddress = &application->second;
+                break;
+            }
+        }
     }
 
     // Search for a redirect route
@@ -85,6 +103,7 @@ RoutingInfo RoutingInfo::findRoute(const ServerConfig &serverConfig, Slice query
 
         // Populate with the current route
         info.hasCgiInterpreter = false;
+        info.fastCgiAddress = NULL;
         bestLength = config.path.size();
         info.setRedirectRoute(&config);
     }
@@ -3,6 +3,7 @@
 
 #include "config.hpp"
 #include "utility.hpp"
+#include "file_cache.hpp"
 
 #include <string>
 #include <stdexcept>
@@ -20,11 +21,12 @@ enum RoutingStatus
 class RoutingInfo
 {
 public:
-    RoutingStatus       status;
-    std::string         nodePath;
-    std::string         cgiInterpreter;
-    bool                hasCgiInterpreter;
-    const ServerConfig *serverConfig;
+    RoutingStatus         status;
+    std::string           nodePath;
+    std::string           cgiInterpreter;
+    bool                  hasCgiInterpreter;
+    const FastCgiAddress *fastCgiAddress; // Set if the script is passed to a FastCGI application
+    const ServerConfig   *serverConfig;
 
     /* Gets the local route's node type if the state is correct */
     inline NodeType getLocalNodeType() const
@@ -56,8 +58,11 @@ public:
     /* Sets the route pointer to the given redirect route; also sets the status */
     void setRedirectRoute(const RedirectRouteConfig *redirectRouteConfig);
 
-    /* Finds a route on a server configuration using the given query path */
-    static RoutingInfo findRoute(const ServerConfig &serverConfig, Slice queryPath);
+    /* Finds a route on a server configuration using the given query path, the node types are
+       answered by the given (caching) source; routes to missing nodes are only taken if
+       `allowMissing` is set, e.g. for files that are about to be created */
+    static RoutingInfo findRoute(const ServerConfig &serverConfig, Slice queryPath, NodeTypeSource &nodeTypes,
+        bool allowMissing = false);
 private:
     NodeType    _nodeType;
     const void *_opaqueRoute;
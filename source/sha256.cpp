@@ -0,0 +1,152 @@
+#include "sha256.hpp"
+
+#include <cstring>
+#include <algorithm>
+
+/* The round constants, the first 32 bits of the fractional parts of the cube roots of the
+   first 64 primes */
+static const uint32_t g_roundConstants[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+};
+
+/* Rotates a word right by the given number of bits */
+static inline uint32_t rotateRight(uint32_t word, int bits)
+{
+    return (word >> bits) | (word << (32 - bits));
+}
+
+/* Constructs a hash of no data */
+Sha256::Sha256()
+{
+    reset();
+}
+
+/* Starts over with a hash of no data */
+void Sha256::reset()
+{
+    // The first 32 bits of the fractional parts of the square roots of the first 8 primes
+    _state[0] = 0x6a09e667;
+    _state[1] = 0xbb67ae85;
+    _state[2] = 0x3c6ef372;
+    _state[3] = 0xa54ff53a;
+    _state[4] = 0x510e527f;
+    _state[5] = 0x9b05688c;
+    _state[6] = 0x1f83d9ab;
+    _state[7] = 0x5be0cd19;
+    _blockLength = 0;
+    _length = 0;
+}
+
+/* Adds the given data to the hash */
+void Sha256::update(Slice data)
+{
+    const uint8_t *bytes = reinterpret_cast<const uint8_t *>(data.getLength() > 0 ? &data[0] : NULL);
+    size_t length = data.getLength();
+    _length += length;
+
+    // Complete a partially filled block first
+    if (_blockLength > 0)
+    {
+        size_t copyLength = std::min(length, sizeof(_block) - _blockLength);
+        std::memcpy(&_block[_blockLength], bytes, copyLength);
+        _blockLength += copyLength;
+        bytes += copyLength;
+        length -= copyLength;
+        if (_blockLength < sizeof(_block))
+            return;
+        transform(_block);
+        _blockLength = 0;
+    }
+
+    // Whole blocks are mixed in straight from the data
+    for (; length >= sizeof(_block); bytes += sizeof(_block), length -= sizeof(_block))
+        transform(bytes);
+    if (length > 0)
+        std::memcpy(_block, bytes, length);
+    _blockLength = length;
+}
+
+/* Ends the hash and gets its digest as lowercase hexadecimal digits */
+std::string Sha256::finish()
+{
+    // Pad with a single set bit and zeros up to the big-endian bit length at the block's end
+    uint64_t bitLength = _length * 8;
+    _block[_blockLength++] = 0x80;
+    if (_blockLength > sizeof(_block) - 8)
+    {
+        std::memset(&_block[_blockLength], 0, sizeof(_block) - _blockLength);
+        transform(_block);
+        _blockLength = 0;
+    }
+    std::memset(&_block[_blockLength], 0, sizeof(_block) - 8 - _blockLength);
+    for (int index = 0; index < 8; index++)
+        _block[sizeof(_block) - 1 - index] = static_cast<uint8_t>(bitLength >> (index * 8));
+    transform(_block);
+
+    static const char digits[] = "0123456789abcdef";
+    std::string digest(64, '0');
+    for (int index = 0; index < 32; index++)
+    {
+        uint8_t byte = static_cast<uint8_t>(_state[index / 4] >> (24 - index % 4 * 8));
+        digest[index * 2] = digits[byte >> 4];
+        digest[index * 2 + 1] = digits[byte & 0xf];
+    }
+    reset();
+    return digest;
+}
+
+/* Mixes a complete block into the state */
+void Sha256::transform(const uint8_t *block)
+{
+    uint32_t schedule[64];
+    for (int index = 0; index < 16; index++)
+    {
+        schedule[index] = static_cast<uint32_t>(block[index * 4]) << 24
+            | static_cast<uint32_t>(block[index * 4 + 1]) << 16
+            | static_cast<uint32_t>(block[index * 4 + 2]) << 8
+            | static_cast<uint32_t>(block[index * 4 + 3]);
+    }
+    for (int index = 16; index < 64; index++)
+    {
+        uint32_t word0 = schedule[index - 15];
+        uint32_t word1 = schedule[index - 2];
+        uint32_t sigma0 = rotateRight(word0, 7) ^ rotateRight(word0, 18) ^ (word0 >> 3);
+        uint32_t sigma1 = rotateRight(word1, 17) ^ rotateRight(word1, 19) ^ (word1 >> 10);
+        schedule[index] = schedule[index - 16] + sigma0 + schedule[index - 7] + sigma1;
+    }
+
+    uint32_t a = _state[0], b = _state[1], c = _state[2], d = _state[3];
+    uint32_t e = _state[4], f = _state[5], g = _state[6], h = _state[7];
+    for (int index = 0; index < 64; index++)
+    {
+        uint32_t sum1 = rotateRight(e, 6) ^ rotateRight(e, 11) ^ rotateRight(e, 25);
+        uint32_t choice = (e & f) ^ (~e & g);
+        uint32_t temporary1 = h + sum1 + choice + g_roundConstants[index] + schedule[index];
+        uint32_t sum0 = rotateRight(a, 2) ^ rotateRight(a, 13) ^ rotateRight(a, 22);
+        uint32_t majority = (a & b) ^ (a & c) ^ (b & c);
+        uint32_t temporary2 = sum0 + majority;
+        h = g;
+        g = f;
+        f = e;
+        e = d + temporary1;
+        d = c;
+        c = b;
+        b = a;
+        a = temporary1 + temporary2;
+    }
+    _state[0] += a;
+    _state[1] += b;
+    _state[2] += c;
+    _state[3] += d;
+    _state[4] += e;
+    _state[5] += f;
+    _state[6] += g;
+    _state[7] += h;
+}
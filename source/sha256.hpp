@@ -0,0 +1,34 @@
+#ifndef SHA256_hpp
+#define SHA256_hpp
+
+#include "slice.hpp"
+
+#include <string>
+#include <stdint.h>
+
+/* Incrementally computes the SHA-256 digest of data */
+class Sha256
+{
+public:
+    /* Constructs a hash of no data */
+    Sha256();
+
+    /* Starts over with a hash of no data */
+    void reset();
+
+    /* Adds the given data to the hash */
+    void update(Slice data);
+
+    /* Ends the hash and gets its digest as lowercase hexadecimal digits */
+    std::string finish();
+private:
+    uint32_t _state[8];
+    uint8_t  _block[64];
+    size_t   _blockLength;
+    uint64_t _length;
+
+    /* Mixes a complete block into the state */
+    void transform(const uint8_t *block);
+};
+
+#endif // SHA256_hpp
@@ -7,12 +7,37 @@
 SignalManager::SignalManager()
     : _shouldQuit(false)
 {
+#ifdef __42_LIKES_WASTING_CPU_CYCLES__
     if (signal(SIGINT, handleQuitSignal) == SIG_ERR)
         throw std::runtime_error("Unable to register SIGINT");
     if (signal(SIGQUIT, handleQuitSignal) == SIG_ERR)
         throw std::runtime_error("Unable to register SIGQUIT");
     if (signal(SIGTERM, handleQuitSignal) == SIG_ERR)
         throw std::runtime_error("Unable to register SIGTERM");
+
+    // Writing to a script that stopped reading its input must fail instead of ending the server
+    if (signal(SIGPIPE, SIG_IGN) == SIG_ERR)
+        throw std::runtime_error("Unable to ignore SIGPIPE");
+#else
+    // Unlike `signal()`, this does not restart interrupted system calls, so blocking calls like
+    // `waitpid()` return as soon as a quit-type signal arrives
+    struct sigaction action = {};
+    action.sa_handler = handleQuitSignal;
+    sigemptyset(&action.sa_mask);
+    if (sigaction(SIGINT, &action, NULL) != 0)
+        throw std::runtime_error("Unable to register SIGINT");
+    if (sigaction(SIGQUIT, &action, NULL) != 0)
+        throw std::runtime_error("Unable to register SIGQUIT");
+    if (sigaction(SIGTERM, &action, NULL) != 0)
+        throw std::runtime_error("Unable to register SIGTERM");
+
+    // Writing to a script that stopped reading its input must fail instead of ending the server
+    struct sigaction ignore = {};
+    ignore.sa_handler = SIG_IGN;
+    sigemptyset(&ignore.sa_mask);
+    if (sigaction(SIGPIPE, &ignore, NULL) != 0)
+        throw std::runtime_error("Unable to ignore SIGPIPE");
+#endif // __42_LIKES_WASTING_CPU_CYCLES__
 }
 
 /** Handles various quit-type signals */
@@ -11,6 +11,12 @@ public:
     {
         return _instance._shouldQuit;
     }
+
+    /** Makes the application quit as if a quit-type signal was received */
+    static inline void requestQuit()
+    {
+        _instance._shouldQuit = true;
+    }
 private:
     static SignalManager _instance;
     volatile bool        _shouldQuit;
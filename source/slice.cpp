@@ -1,6 +1,7 @@
 #include "slice.hpp"
 #include "utility.hpp"
 
+#include <cctype>
 #include <ostream>
 #include <cstring>
 
@@ -20,6 +21,21 @@ bool Slice::operator!=(Slice other)
     return std::memcmp(_string, other._string, _length) != 0;
 }
 
+/* Case-invariant comparison to other slice */
+bool Slice::equalsIgnoreCase(Slice other) const
+{
+    if (_length != other._length)
+        return false;
+    for (size_t index = 0; index < _length; index++)
+    {
+        // Bytes from 0x80 on are negative as a `char`, which `tolower()` doesn't accept
+        if (std::tolower(static_cast<unsigned char>(_string[index]))
+         != std::tolower(static_cast<unsigned char>(other._string[index])))
+            return false;
+    }
+    return true;
+}
+
 /* Removes the slice's start until `delimiter` is reached and populates `outSlice` with it,
    the current slice will be the remainder excluding the delimiter */
 bool Slice::splitStart(char delimiter, Slice &outStart)
@@ -60,6 +60,9 @@ public:
     bool operator==(Slice other);
     bool operator!=(Slice other);
 
+    /* Case-invariant comparison to other slice */
+    bool equalsIgnoreCase(Slice other) const;
+
     /* Removes the slice's start until `delimiter` is reached and populates `outStart` with it,
        the current slice will be the remainder excluding the delimiter */
     bool splitStart(char delimiter, Slice &outStart);
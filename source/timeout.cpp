@@ -1,52 +1,44 @@
 #include "timeout.hpp"
+#include "timer_wheel.hpp"
 
-#include <ctime>
-#include <stdexcept>
+/* Destructor for deriving classes */
+TimeoutSink::~TimeoutSink()
+{
+}
 
-/* Constructs a timeout starting from the current time */
-Timeout::Timeout(uint64_t duration)
-    : _duration(duration)
+/* Constructs a stopped timeout that notifies the given sink when it expires */
+Timeout::Timeout(TimerWheel &wheel, TimeoutSink *sink)
+    : _wheel(wheel)
+    , _sink(sink)
+    , _deadline(0)
+    , _isStopped(true)
+    , _level(0)
+    , _index(0)
+    , _next(NULL)
+    , _previous(NULL)
 {
-    reset();
 }
 
-/* Resets the timeout's starting time to the current time */
-void Timeout::reset()
+/* Stops the timeout */
+Timeout::~Timeout()
 {
-    _startTime = getCurrentTime();
-    _isStopped = false;
+    stop();
 }
 
-/* Gets whether the timeout has expired or not */
-bool Timeout::isExpired()
+/* (Re)starts the timeout so it expires after the given duration from the wheel's current time */
+void Timeout::start(uint64_t duration)
 {
-    if (_isStopped)
-        return false;
-    uint64_t currentTime = getCurrentTime();
-    if (currentTime < _startTime)
-        throw std::runtime_error("Time moved backwards; did the system time change?");
-    return currentTime - _startTime >= _duration;
+    stop();
+    _deadline = _wheel.getTime() + duration;
+    _wheel.insert(this);
+    _isStopped = false;
 }
 
 /* Stops the timeout so it can never expire */
 void Timeout::stop()
 {
+    if (_isStopped)
+        return;
+    _wheel.remove(this);
     _isStopped = true;
 }
-
-/* Queries the current time from the operating system */
-uint64_t Timeout::getCurrentTime()
-{
-#ifdef __42_LIKES_WASTING_CPU_CYCLES__
-    // There is neither an C function allowed by subject nor a C++98
-    // standard function to obtain the current millisecond time
-    return static_cast<uint64_t>(std::time(NULL)) * 1000;
-#else
-    timespec ts;
-
-    if (clock_gettime(CLOCK_MONOTONIC_RAW, &ts) != 0)
-        throw std::runtime_error("Unable to query monotonic system time");
-
-    return ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
-#endif // __42_LIKES_WASTING_CPU_CYCLES__
-}
@@ -1,6 +1,7 @@
 #ifndef TIMEOUT_hpp
 #define TIMEOUT_hpp
 
+#include <stddef.h>
 #include <stdint.h>
 
 /* The timeout for a client to make a request */
@@ -12,33 +13,52 @@
 /* The timeout for a CGI process to respond */
 #define TIMEOUT_CGI_MS 10000
 
+class TimerWheel;
+
+struct TimeoutSink
+{
+    /* Handles the expiry of a timeout; must not throw */
+    virtual void handleTimeout() = 0;
+
+    /* Destructor for deriving classes */
+    virtual ~TimeoutSink();
+};
+
 class Timeout
 {
 public:
-    /* Constructs a timeout starting from the current time */
-    explicit Timeout(uint64_t duration);
+    friend class TimerWheel;
+
+    /* Constructs a stopped timeout that notifies the given sink when it expires */
+    Timeout(TimerWheel &wheel, TimeoutSink *sink);
 
-    /* Resets the timeout's starting time to the current time */
-    void reset();
+    /* Stops the timeout */
+    ~Timeout();
 
-    /* Gets whether the timeout has expired or not */
-    bool isExpired();
+    /* (Re)starts the timeout so it expires after the given duration from the wheel's current time */
+    void start(uint64_t duration);
 
     /* Stops the timeout so it can never expire */
     void stop();
 
     /* Gets whether the timeout was stopped or not */
-    inline bool isStopped()
+    inline bool isStopped() const
     {
         return _isStopped;
     }
 private:
-    uint64_t _duration;
-    uint64_t _startTime;
-    bool     _isStopped;
+    TimerWheel  &_wheel;
+    TimeoutSink *_sink;
+    uint64_t     _deadline;
+    bool         _isStopped;
+    size_t       _level;
+    size_t       _index;
+    Timeout     *_next;
+    Timeout     *_previous;
 
-    /* Queries the current time from the operating system */
-    static uint64_t getCurrentTime();
+    /* Disable copy-construction and copy-assignment */
+    Timeout(const Timeout &other);
+    Timeout &operator=(const Timeout &other);
 };
 
 #endif // TIMEOUT_hpp
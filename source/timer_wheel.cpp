@@ -0,0 +1,209 @@
+#include "timer_wheel.hpp"
+
+#include <ctime>
+#include <stdexcept>
+
+/* Mask that selects a slot on a level after shifting the tick */
+#define TIMER_WHEEL_SLOT_MASK (TIMER_WHEEL_SLOTS - 1)
+
+/* Span of ticks covered by all levels together */
+#define TIMER_WHEEL_SPAN (1ull << (TIMER_WHEEL_SLOT_BITS * TIMER_WHEEL_LEVELS))
+
+/* Constructs an empty timer wheel starting at the current time */
+TimerWheel::TimerWheel()
+    : _time(queryTime())
+    , _count(0)
+{
+    _tick = _time;
+    for (size_t level = 0; level < TIMER_WHEEL_LEVELS; level++)
+    {
+        _occupied[level] = 0;
+        for (size_t index = 0; index < TIMER_WHEEL_SLOTS; index++)
+            _slots[level][index] = NULL;
+    }
+}
+
+/* Queries the current time once and caches it for all timeouts started until the next update */
+void TimerWheel::updateTime()
+{
+    uint64_t time = queryTime();
+    if (time < _time)
+        throw std::runtime_error("Time moved backwards; did the system time change?");
+    _time = time;
+}
+
+/* Notifies the sinks of all timeouts that expired at or before the cached current time */
+void TimerWheel::expire()
+{
+    while (_tick <= _time)
+    {
+        // Skip straight to the current time when no timeout is pending
+        if (_count == 0)
+        {
+            _tick = _time + 1;
+            break;
+        }
+
+        // When the lowest level wraps around, pull the next slots of the higher levels down
+        size_t index = _tick & TIMER_WHEEL_SLOT_MASK;
+        if (index == 0)
+        {
+            for (size_t level = 1; level < TIMER_WHEEL_LEVELS; level++)
+            {
+                size_t levelIndex = (_tick >> (level * TIMER_WHEEL_SLOT_BITS)) & TIMER_WHEEL_SLOT_MASK;
+                cascade(level, levelIndex);
+                if (levelIndex != 0)
+                    break;
+            }
+        }
+
+        // Notify the sinks of the current slot's timeouts; each timeout is unlinked before its
+        // sink is notified, so sinks may restart, stop or destroy any timeout
+        while (_slots[0][index] != NULL)
+        {
+            Timeout *timeout = _slots[0][index];
+            remove(timeout);
+            timeout->_isStopped = true;
+            timeout->_sink->handleTimeout();
+        }
+        _tick++;
+
+        // Skip the empty remainder of the lowest level up to its next wrap-around
+        index = _tick & TIMER_WHEEL_SLOT_MASK;
+        if (index != 0 && (_occupied[0] >> index) == 0)
+        {
+            uint64_t wrapTick = (_tick | TIMER_WHEEL_SLOT_MASK) + 1;
+            _tick = wrapTick <= _time ? wrapTick : _time + 1;
+        }
+    }
+}
+
+/* Gets the number of milliseconds that may pass before a timeout needs to be expired,
+   clamped to the given maximum */
+int TimerWheel::getWaitTime(int maximum) const
+{
+    if (_count == 0)
+        return maximum;
+
+    // Timeouts on the lowest level expire at their slot's tick
+    uint64_t nextTick = UINT64_MAX;
+    if (_occupied[0] != 0)
+        nextTick = _tick + findOccupied(_occupied[0], _tick & TIMER_WHEEL_SLOT_MASK);
+
+    // Timeouts on higher levels may expire once their slot is cascaded, which happens on the first
+    // tick aligned to the level's span that selects the slot
+    for (size_t level = 1; level < TIMER_WHEEL_LEVELS; level++)
+    {
+        if (_occupied[level] == 0)
+            continue;
+        size_t   shift = level * TIMER_WHEEL_SLOT_BITS;
+        uint64_t position = (_tick + (1ull << shift) - 1) >> shift;
+        uint64_t cascadeTick = (position + findOccupied(_occupied[level], position & TIMER_WHEEL_SLOT_MASK)) << shift;
+        if (cascadeTick < nextTick)
+            nextTick = cascadeTick;
+    }
+
+    if (nextTick <= _time)
+        return 0;
+    if (nextTick - _time >= static_cast<uint64_t>(maximum))
+        return maximum;
+    return static_cast<int>(nextTick - _time);
+}
+
+/* Links a timeout into the slot that matches its deadline */
+void TimerWheel::insert(Timeout *timeout)
+{
+    // Timeouts that are already due are expired with the next processed tick
+    uint64_t expiry = timeout->_deadline;
+    if (expiry < _tick)
+        expiry = _tick;
+
+    // Clamp deadlines beyond the wheel's span; they are cascaded into the highest level again
+    if (expiry - _tick >= TIMER_WHEEL_SPAN)
+        expiry = _tick + TIMER_WHEEL_SPAN - 1;
+
+    // Select the lowest level whose span covers the remaining time
+    size_t level = 0;
+    while (level + 1 < TIMER_WHEEL_LEVELS && expiry - _tick >= (1ull << ((level + 1) * TIMER_WHEEL_SLOT_BITS)))
+        level++;
+    size_t index = (expiry >> (level * TIMER_WHEEL_SLOT_BITS)) & TIMER_WHEEL_SLOT_MASK;
+
+    // Link the timeout as the slot's new head
+    timeout->_level = level;
+    timeout->_index = index;
+    timeout->_previous = NULL;
+    timeout->_next = _slots[level][index];
+    if (timeout->_next != NULL)
+        timeout->_next->_previous = timeout;
+    _slots[level][index] = timeout;
+    _occupied[level] |= 1ull << index;
+    _count++;
+}
+
+/* Unlinks a timeout from its slot */
+void TimerWheel::remove(Timeout *timeout)
+{
+    if (timeout->_previous != NULL)
+        timeout->_previous->_next = timeout->_next;
+    else
+        _slots[timeout->_level][timeout->_index] = timeout->_next;
+    if (timeout->_next != NULL)
+        timeout->_next->_previous = timeout->_previous;
+    timeout->_next = NULL;
+    timeout->_previous = NULL;
+
+    if (_slots[timeout->_level][timeout->_index] == NULL)
+        _occupied[timeout->_level] &= ~(1ull << timeout->_index);
+    _count--;
+}
+
+/* Moves all timeouts of a higher level's slot down to the levels below */
+void TimerWheel::cascade(size_t level, size_t index)
+{
+    Timeout *timeout = _slots[level][index];
+    _slots[level][index] = NULL;
+    _occupied[level] &= ~(1ull << index);
+
+    while (timeout != NULL)
+    {
+        Timeout *next = timeout->_next;
+        _count--;
+        insert(timeout);
+        timeout = next;
+    }
+}
+
+/* Gets the distance from `start` to the next occupied slot in the given bitmap, wrapping around */
+size_t TimerWheel::findOccupied(uint64_t occupied, size_t start)
+{
+#ifdef __42_LIKES_WASTING_CPU_CYCLES__
+    for (size_t distance = 0; distance < TIMER_WHEEL_SLOTS; distance++)
+    {
+        if ((occupied >> ((start + distance) & TIMER_WHEEL_SLOT_MASK)) & 1)
+            return distance;
+    }
+    return TIMER_WHEEL_SLOTS;
+#else
+    uint64_t rotated = occupied >> start;
+    if (start != 0)
+        rotated |= occupied << (TIMER_WHEEL_SLOTS - start);
+    return static_cast<size_t>(__builtin_ctzll(rotated));
+#endif // __42_LIKES_WASTING_CPU_CYCLES__
+}
+
+/* Queries the current time from the operating system */
+uint64_t TimerWheel::queryTime()
+{
+#ifdef __42_LIKES_WASTING_CPU_CYCLES__
+    // There is neither an C function allowed by subject nor a C++98
+    // standard function to obtain the current millisecond time
+    return static_cast<uint64_t>(std::time(NULL)) * 1000;
+#else
+    timespec ts;
+
+    if (clock_gettime(CLOCK_MONOTONIC_RAW, &ts) != 0)
+        throw std::runtime_error("Unable to query monotonic system time");
+
+    return ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+#endif // __42_LIKES_WASTING_CPU_CYCLES__
+}
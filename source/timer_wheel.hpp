@@ -0,0 +1,70 @@
+#ifndef TIMER_WHEEL_hpp
+#define TIMER_WHEEL_hpp
+
+#include "timeout.hpp"
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Number of wheel levels; each level covers 64 times the span of the level below */
+#define TIMER_WHEEL_LEVELS 5
+
+/* Number of bits of the tick that select the slot on a level */
+#define TIMER_WHEEL_SLOT_BITS 6
+
+/* Number of slots per level */
+#define TIMER_WHEEL_SLOTS (1u << TIMER_WHEEL_SLOT_BITS)
+
+/* Hierarchical timer wheel with a tick of one millisecond; starting, stopping and expiring a
+   timeout takes constant time regardless of the amount of pending timeouts */
+class TimerWheel
+{
+public:
+    friend class Timeout;
+
+    /* Constructs an empty timer wheel starting at the current time */
+    TimerWheel();
+
+    /* Queries the current time once and caches it for all timeouts started until the next update */
+    void updateTime();
+
+    /* Gets the cached current time in milliseconds */
+    inline uint64_t getTime() const
+    {
+        return _time;
+    }
+
+    /* Notifies the sinks of all timeouts that expired at or before the cached current time */
+    void expire();
+
+    /* Gets the number of milliseconds that may pass before a timeout needs to be expired,
+       clamped to the given maximum */
+    int getWaitTime(int maximum) const;
+private:
+    Timeout  *_slots[TIMER_WHEEL_LEVELS][TIMER_WHEEL_SLOTS];
+    uint64_t  _occupied[TIMER_WHEEL_LEVELS];
+    uint64_t  _time;
+    uint64_t  _tick;
+    size_t    _count;
+
+    /* Links a timeout into the slot that matches its deadline */
+    void insert(Timeout *timeout);
+
+    /* Unlinks a timeout from its slot */
+    void remove(Timeout *timeout);
+
+    /* Moves all timeouts of a higher level's slot down to the levels below */
+    void cascade(size_t level, size_t index);
+
+    /* Gets the distance from `start` to the next occupied slot in the given bitmap, wrapping around */
+    static size_t findOccupied(uint64_t occupied, size_t start);
+
+    /* Queries the current time from the operating system */
+    static uint64_t queryTime();
+
+    /* Disable copy-construction and copy-assignment */
+    TimerWheel(const TimerWheel &other);
+    TimerWheel &operator=(const TimerWheel &other);
+};
+
+#endif // TIMER_WHEEL_hpp
@@ -1,10 +1,27 @@
 #include "upload_handler.hpp"
 #include "http_exception.hpp"
 
-#include <fstream>
+#include <ctime>
+#include <fcntl.h>
+#include <errno.h>
+#include <cstdio>
+#include <cstring>
+#include <dirent.h>
+#include <unistd.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+#ifndef __42_LIKES_WASTING_CPU_CYCLES__
+# include <sys/mman.h>
+#endif // __42_LIKES_WASTING_CPU_CYCLES__
+#include <iostream>
+#include <algorithm>
+#include <stdexcept>
+
+/* The most names that are tried for a temporary file before giving up */
+#define FILE_UPLOAD_MAX_NAME_ATTEMPTS 100
 
 /* Attempts to parse the request's `Content-Type` header to obtain the form boundary */
-static bool extractBoundary(const HttpRequest &request, Slice &outBoundary)
+bool UploadHandler::extractBoundary(const HttpRequest &request, Slice &outBoundary)
 {
     Slice prefix;
 
@@ -32,7 +49,7 @@ static bool extractBoundary(const HttpRequest &request, Slice &outBoundary)
         if (prefix.consumeStart(C_SLICE("boundary=")))
         {
             outBoundary = prefix;
-            return true;
+            return !prefix.isEmpty();
         }
         contentType.stripStart(' ');
     }
@@ -95,67 +112,912 @@ static bool extractFileName(Slice header, Slice &outFileName)
     return false;
 }
 
-/* Handles the content between form boundaries */
-static void handleField(Slice field, const RoutingInfo &routingInfo)
+/* Gets whether body bytes can be moved from the socket by `spliceBody()` right now */
+bool UploadSink::canSplice() const
 {
-    Slice header;
-    Slice fileName;
+    return false;
+}
+
+/* Moves up to `length` body bytes from the socket into the upload without copying them
+   through user space, returns the number of bytes moved which is zero if the socket would
+   block */
+size_t UploadSink::spliceBody(int fileno, size_t length)
+{
+    (void)fileno;
+    (void)length;
+    throw std::logic_error("The upload can't splice its body");
+}
+
+/* Constructs an upload of the form parts delimited by `boundary` into `directory`, the files
+   are deduplicated in the content-addressed `store` unless it's empty and dropped from
+   `fileCache` once they were replaced */
+MultipartUpload::MultipartUpload(Slice boundary, const std::string &directory, const std::string &store,
+    FileCache &fileCache)
+    : _phase(MULTIPART_PREAMBLE)
+    , _delimiter("\r\n--" + boundary.toString())
+    , _directory(Slice(directory).stripEnd('/').toString())
+    , _store(store)
+    , _fileCache(fileCache)
+    , _errorStatus(0)
+    , _isEmpty(true)
+{
+    // The first delimiter may start the body, so the body is treated as if it started with
+    // a line break
+    _carry = "\r\n";
+
+    // Bytes that don't occur within the delimiter skip past it entirely
+    size_t last = _delimiter.size() - 1;
+    for (size_t index = 0; index < 256; index++)
+        _shifts[index] = _delimiter.size();
+    for (size_t index = 0; index < last; index++)
+        _shifts[static_cast<unsigned char>(_delimiter[index])] = last - index;
+}
+
+/* Closes the file being written and removes it if it is incomplete */
+MultipartUpload::~MultipartUpload()
+{
+    discardPart();
+}
+
+/* Consumes the next bytes of the body, writing file parts as they arrive; an error stops
+   the upload and is reported by `finish()` */
+void MultipartUpload::writeBody(Slice data)
+{
+    if (_errorStatus != 0 || data.getLength() == 0)
+        return;
+    _isEmpty = false;
+
+    try
+    {
+        while (data.getLength() > 0)
+            consume(data);
+    }
+    catch (HttpException &exception)
+    {
+        _errorStatus = exception.getStatusCode();
+        discardPart();
+    }
+}
+
+/* Completes the upload once the whole body was written, throws the HTTP error that stopped
+   it or 400 if the body ended before its closing delimiter */
+void MultipartUpload::finish()
+{
+    if (_errorStatus != 0)
+        throw HttpException(_errorStatus);
+    if (!_isEmpty && _phase != MULTIPART_EPILOGUE)
+    {
+        discardPart();
+        throw HttpException(400);
+    }
+}
+
+/* Consumes bytes of the body according to the current phase */
+void MultipartUpload::consume(Slice &data)
+{
+    switch (_phase)
+    {
+    case MULTIPART_PREAMBLE:
+    case MULTIPART_PART_BODY:
+        if (consumeContent(data))
+        {
+            finishPart();
+            _header.clear();
+            _phase = MULTIPART_DELIMITER_END;
+        }
+        break;
+    case MULTIPART_DELIMITER_END:
+    {
+        size_t length = std::min(2 - _header.size(), data.getLength());
+        _header.append(&data[0], length);
+        data.consumeStart(length);
+        if (_header.size() < 2)
+            break;
+
+        // Two dashes close the body, a line break starts the next part's header
+        if (_header == "--")
+            _phase = MULTIPART_EPILOGUE;
+        else if (_header == "\r\n")
+            _phase = MULTIPART_PART_HEADER;
+        else
+            throw HttpException(400);
+        break;
+    }
+    case MULTIPART_PART_HEADER:
+        consumeHeader(data);
+        break;
+    case MULTIPART_EPILOGUE:
+        data.consumeStart(data.getLength());
+        break;
+    }
+}
+
+/* Consumes part content up to and including the next delimiter, returns whether one was
+   found; the start of a delimiter at the data's end is kept for the next bytes */
+bool MultipartUpload::consumeContent(Slice &data)
+{
+    // Check whether a delimiter that started in the previous bytes continues here
+    if (!_carry.empty())
+    {
+        std::string window = _carry;
+        window.append(&data[0], std::min(data.getLength(), _delimiter.size()));
+        for (size_t index = 0; index < _carry.size(); index++)
+        {
+            size_t length = std::min(window.size() - index, _delimiter.size());
+            if (window.compare(index, length, _delimiter, 0, length) != 0)
+                continue;
+            writeContent(Slice(_carry.data(), index));
 
-    // Ignore fields without a header or without a file name
-    if (!field.splitStart(C_SLICE("\r\n\r\n"), header))
+            // A complete delimiter ends the content
+            if (length == _delimiter.size())
+            {
+                data.consumeStart(_delimiter.size() - (_carry.size() - index));
+                _carry.clear();
+                return true;
+            }
+
+            // Otherwise the data is too short to tell and is kept entirely
+            _carry.erase(0, index);
+            _carry.append(&data[0], data.getLength());
+            data.consumeStart(data.getLength());
+            return false;
+        }
+        writeContent(Slice(_carry));
+        _carry.clear();
+    }
+
+    size_t position = findDelimiter(data);
+    if (position != std::string::npos)
+    {
+        writeContent(Slice(&data[0], position));
+        data.consumeStart(position + _delimiter.size());
+        return true;
+    }
+
+    // Hold back what may be the start of a delimiter
+    size_t partial = findPartialDelimiter(data);
+    writeContent(Slice(&data[0], partial));
+    _carry.assign(&data[partial], data.getLength() - partial);
+    data.consumeStart(data.getLength());
+    return false;
+}
+
+/* Consumes bytes of a part's header and starts the part once the header is complete */
+void MultipartUpload::consumeHeader(Slice &data)
+{
+    // The line break after the delimiter is kept in front, so an empty header ends right away
+    if (_header.empty())
+        _header = "\r\n";
+
+    // Copy as much of the header as allowed and search for its end from up to 3 bytes before
+    size_t oldLength = _header.size();
+    size_t copyLength = std::min(data.getLength(), MULTIPART_UPLOAD_MAX_HEADER_LENGTH - oldLength);
+    _header.append(&data[0], copyLength);
+    size_t position = _header.find("\r\n\r\n", oldLength < 3 ? 0 : oldLength - 3);
+    if (position == std::string::npos)
+    {
+        data.consumeStart(copyLength);
+        if (_header.size() == MULTIPART_UPLOAD_MAX_HEADER_LENGTH)
+            throw HttpException(400);
         return;
+    }
+
+    // Only consume the header's part of the data
+    data.consumeStart(position + 4 - oldLength);
+    startPart(position < 2 ? Slice() : Slice(&_header[2], position - 2));
+    _phase = MULTIPART_PART_BODY;
+}
+
+/* Opens a temporary file for a part if its header names a destination */
+void MultipartUpload::startPart(Slice header)
+{
+    // Ignore fields without a file name
+    Slice fileName;
     if (!extractFileName(header, fileName))
         return;
 
     // Clamp the file name to not go below the upload directory and assemble the full path
     if (!Utility::checkPathLevel(fileName))
         throw HttpException(403);
-    std::string path = Slice(routingInfo.nodePath).stripEnd('/').toString() + '/' + fileName.toString();
+    std::string path = _directory + '/' + fileName.toString();
 
-    // Attempt to write the file
-    std::ofstream stream(path.c_str(), std::ios::binary | std::ios::trunc);
-    if (!stream.is_open())
+    // A file linked to a blob of the store is replaced by the rename, never written in place
+    if (!_store.empty())
+        _hash.reset();
+
+    // The part is written to a temporary file next to its destination, which is only replaced
+    // once the part is complete
+    std::string temporaryPath;
+    for (size_t attempt = 0; temporaryPath.empty(); attempt++)
+    {
+        if (attempt == FILE_UPLOAD_MAX_NAME_ATTEMPTS)
+            throw HttpException(500);
+        std::string candidate = UploadHandler::createTemporaryPath(_directory);
+        int fileno = open(candidate.c_str(), O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0644);
+        if (fileno >= 0)
+        {
+            close(fileno);
+            temporaryPath = candidate;
+        }
+        else if (errno != EEXIST)
+            throw HttpException(500);
+    }
+
+    // Attempt to open the file
+    _file.clear();
+    _file.open(temporaryPath.c_str(), std::ios::binary | std::ios::trunc);
+    if (!_file.is_open())
+    {
+        std::remove(temporaryPath.c_str());
+        throw HttpException(500);
+    }
+    _temporaryPath = temporaryPath;
+    _filePath = path;
+}
+
+/* Closes the current part's file once its content is complete and moves it into place */
+void MultipartUpload::finishPart()
+{
+    if (!_file.is_open())
+        return;
+    _file.close();
+    if (_file.fail())
+        throw HttpException(500);
+    if (std::rename(_temporaryPath.c_str(), _filePath.c_str()) != 0)
         throw HttpException(500);
-    stream.write(&field[0], field.getLength());
-    if (!stream.good())
+    _temporaryPath.clear();
+    _fileCache.invalidate(_filePath);
+    if (!_store.empty())
+        UploadHandler::storeContent(_store, _hash.finish(), _filePath);
+    _filePath.clear();
+}
+
+/* Writes part content to the current part's file, if any */
+void MultipartUpload::writeContent(Slice data)
+{
+    if (!_file.is_open() || data.getLength() == 0)
+        return;
+    _file.write(&data[0], data.getLength());
+    if (!_file.good())
         throw HttpException(500);
+    if (!_store.empty())
+        _hash.update(data);
+}
+
+/* Closes and removes the temporary file of an incomplete part, its destination is left as
+   it was */
+void MultipartUpload::discardPart()
+{
+    if (_file.is_open())
+        _file.close();
+    if (!_temporaryPath.empty())
+        std::remove(_temporaryPath.c_str());
+    _temporaryPath.clear();
+    _filePath.clear();
+}
+
+/* Finds the first delimiter in the data using its Boyer-Moore-Horspool shifts */
+size_t MultipartUpload::findDelimiter(Slice data) const
+{
+    size_t length = _delimiter.size();
+    size_t last = length - 1;
+    size_t offset = 0;
+    while (offset + length <= data.getLength())
+    {
+        unsigned char character = data[offset + last];
+        if (character == static_cast<unsigned char>(_delimiter[last])
+         && std::memcmp(&data[offset], _delimiter.data(), last) == 0)
+            return offset;
+        offset += _shifts[character];
+    }
+    return std::string::npos;
+}
+
+/* Finds the offset of the shortest suffix of the data that starts a delimiter,
+   the data's length if there is none */
+size_t MultipartUpload::findPartialDelimiter(Slice data) const
+{
+    size_t length = data.getLength();
+    size_t offset = length >= _delimiter.size() ? length - _delimiter.size() + 1 : 0;
+    for (; offset < length; offset++)
+    {
+        if (data[offset] == '\r' && std::memcmp(&data[offset], _delimiter.data(), length - offset) == 0)
+            return offset;
+    }
+    return length;
+}
+
+/* Constructs an upload into the file at `path`, space for `length` bytes is reserved
+   up front if the body's length is known (non-zero); the file is deduplicated in the
+   content-addressed `store` unless it's empty */
+FileUpload::FileUpload(const std::string &path, size_t length, const std::string &store)
+    : _path(path)
+    , _store(store)
+    , _fileno(-1)
+    , _errorStatus(0)
+    , _length(0)
+{
+    _pipe[0] = -1;
+    _pipe[1] = -1;
+
+    size_t separator = path.rfind('/');
+    std::string directory = separator == std::string::npos ? "." : path.substr(0, separator);
+#ifdef __42_LIKES_WASTING_CPU_CYCLES__
+    (void)length;
+    openNamedTemporary(directory);
+#else
+    // An unnamed file vanishes by itself if the upload never completes
+    _fileno = open(directory.c_str(), O_TMPFILE | O_WRONLY | O_CLOEXEC, 0644);
+    if (_fileno < 0)
+    {
+        if (errno != EISDIR && errno != EOPNOTSUPP && errno != EINVAL)
+            throw HttpException(getErrorStatus());
+        openNamedTemporary(directory);
+    }
+
+    // Reserve the space so the file isn't fragmented and a full disk is reported right away
+    if (length > 0 && fallocate(_fileno, 0, 0, length) != 0 && errno != EOPNOTSUPP && errno != ENOSYS)
+    {
+        int status = getErrorStatus();
+        close(_fileno);
+        if (!_temporaryPath.empty())
+            std::remove(_temporaryPath.c_str());
+        throw HttpException(status);
+    }
+#endif // __42_LIKES_WASTING_CPU_CYCLES__
+}
+
+/* Constructs an upload into the file at `path` whose file is opened by the deriving class */
+FileUpload::FileUpload(const std::string &path, const std::string &store)
+    : _path(path)
+    , _store(store)
+    , _fileno(-1)
+    , _errorStatus(0)
+    , _length(0)
+{
+    _pipe[0] = -1;
+    _pipe[1] = -1;
+}
+
+/* Closes the file and removes it unless the upload was completed */
+FileUpload::~FileUpload()
+{
+    if (_fileno >= 0)
+        close(_fileno);
+    if (_pipe[0] >= 0)
+        close(_pipe[0]);
+    if (_pipe[1] >= 0)
+        close(_pipe[1]);
+    if (!_temporaryPath.empty())
+        std::remove(_temporaryPath.c_str());
 }
 
-/* Handles the upload of one or multiple files */
-void UploadHandler::handleUpload(const HttpRequest &request, const RoutingInfo &routingInfo)
+/* Writes the next bytes of the body; an error stops the upload and is reported by
+   `finish()` */
+void FileUpload::writeBody(Slice data)
 {
-    Slice body(request.body);
-    Slice field;
+    while (_errorStatus == 0 && data.getLength() > 0)
+    {
+        ssize_t written = write(_fileno, &data[0], data.getLength());
+        if (written <= 0)
+            _errorStatus = getErrorStatus();
+        else
+        {
+            if (!_store.empty())
+                _hash.update(Slice(&data[0], written));
+            data.consumeStart(written);
+            _length += written;
+        }
+    }
+}
 
+/* Gets whether body bytes can be moved from the socket by `spliceBody()` right now */
+bool FileUpload::canSplice() const
+{
+#ifdef __42_LIKES_WASTING_CPU_CYCLES__
+    return false;
+#else
+    // The content of deduplicated files is hashed as it passes, a failed upload drops the rest
+    // of the body, which is cheaper through the parser
+    return _errorStatus == 0 && _store.empty();
+#endif // __42_LIKES_WASTING_CPU_CYCLES__
+}
+
+/* Moves up to `length` body bytes from the socket through a pipe into the file without
+   copying them through user space, returns the number of bytes moved which is zero if the
+   socket would block */
+size_t FileUpload::spliceBody(int fileno, size_t length)
+{
+#ifdef __42_LIKES_WASTING_CPU_CYCLES__
+    (void)fileno;
+    (void)length;
+    throw std::logic_error("splice() is not supported in this build");
+#else
+    // The pipe is only needed once the body outgrows the bytes read along with the header
+    if (_pipe[0] < 0)
+    {
+        if (pipe2(_pipe, O_NONBLOCK | O_CLOEXEC) != 0)
+            throw std::runtime_error("Unable to create upload pipe");
+        fcntl(_pipe[1], F_SETPIPE_SZ, FILE_UPLOAD_PIPE_SIZE);
+    }
+
+    // The pipe is empty between calls, so it takes as much as its capacity allows
+    ssize_t received = splice(fileno, NULL, _pipe[1], NULL, std::min<size_t>(length, FILE_UPLOAD_PIPE_SIZE),
+        SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+    if (received < 0)
+    {
+        if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)
+            return 0;
+        throw std::runtime_error("Unable to read from client");
+    }
+    if (received == 0)
+        throw std::runtime_error("End of stream");
+    drainPipe(received);
+    return received;
+#endif // __42_LIKES_WASTING_CPU_CYCLES__
+}
+
+/* Moves the completed file into place, throws the HTTP error that stopped the upload */
+void FileUpload::finish()
+{
+    if (_errorStatus != 0)
+        throw HttpException(_errorStatus);
+
+#ifndef __42_LIKES_WASTING_CPU_CYCLES__
+    if (_temporaryPath.empty())
+    {
+        // A new file is linked into place directly, an existing one is replaced by renaming
+        std::string procPath = "/proc/self/fd/" + Utility::numberToString(_fileno);
+        if (linkat(AT_FDCWD, procPath.c_str(), AT_FDCWD, _path.c_str(), AT_SYMLINK_FOLLOW) == 0)
+        {
+            int result = close(_fileno);
+            _fileno = -1;
+            if (result != 0)
+                throw HttpException(500);
+            if (!_store.empty())
+                UploadHandler::storeContent(_store, _hash.finish(), _path);
+            return;
+        }
+        if (errno != EEXIST)
+            throw HttpException(getErrorStatus());
+
+        // Give the file a temporary name next to the one it replaces
+        for (size_t attempt = 0; _temporaryPath.empty(); attempt++)
+        {
+            if (attempt == FILE_UPLOAD_MAX_NAME_ATTEMPTS)
+                throw HttpException(500);
+            std::string path = UploadHandler::createTemporaryPath(_path.substr(0, _path.rfind('/')));
+            if (linkat(AT_FDCWD, procPath.c_str(), AT_FDCWD, path.c_str(), AT_SYMLINK_FOLLOW) == 0)
+                _temporaryPath = path;
+            else if (errno != EEXIST)
+                throw HttpException(getErrorStatus());
+        }
+    }
+#endif // __42_LIKES_WASTING_CPU_CYCLES__
+
+    // Closing reports delayed write errors, renaming replaces the file atomically
+    int result = close(_fileno);
+    _fileno = -1;
+    if (result != 0)
+        throw HttpException(500);
+    if (std::rename(_temporaryPath.c_str(), _path.c_str()) != 0)
+        throw HttpException(getErrorStatus());
+    _temporaryPath.clear();
+    if (!_store.empty())
+        UploadHandler::storeContent(_store, _hash.finish(), _path);
+}
+
+/* Opens a temporary file with a unique name in the given directory */
+void FileUpload::openNamedTemporary(const std::string &directory)
+{
+    for (size_t attempt = 0; attempt < FILE_UPLOAD_MAX_NAME_ATTEMPTS; attempt++)
+    {
+        std::string path = UploadHandler::createTemporaryPath(directory);
+        _fileno = open(path.c_str(), O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0644);
+        if (_fileno >= 0)
+        {
+            _temporaryPath = path;
+            return;
+        }
+        if (errno != EEXIST)
+            throw HttpException(getErrorStatus());
+    }
+    throw HttpException(500);
+}
+
+/* Writes the given number of bytes from the pipe into the file, bytes are dropped once
+   the upload failed */
+void FileUpload::drainPipe(size_t length)
+{
+#ifdef __42_LIKES_WASTING_CPU_CYCLES__
+    (void)length;
+#else
+    while (length > 0)
+    {
+        ssize_t written = -1;
+        if (_errorStatus == 0)
+        {
+            written = splice(_pipe[0], NULL, _fileno, NULL, length, SPLICE_F_MOVE);
+            if (written <= 0)
+                _errorStatus = getErrorStatus();
+            else
+                _length += written;
+        }
+
+        // The bytes still have to leave the pipe to keep the body in sync
+        if (_errorStatus != 0)
+        {
+            char buffer[4096];
+            written = read(_pipe[0], buffer, std::min(length, sizeof(buffer)));
+            if (written <= 0)
+                throw std::runtime_error("Unable to drain upload pipe");
+        }
+        length -= written;
+    }
+#endif // __42_LIKES_WASTING_CPU_CYCLES__
+}
+
+/* Gets the HTTP error matching the `errno` of a failed file operation */
+int FileUpload::getErrorStatus()
+{
+    switch (errno)
+    {
+    case ENOENT:
+    case ENOTDIR:
+    case EISDIR:
+        return 409;
+    case EACCES:
+    case EPERM:
+    case EROFS:
+        return 403;
+    case ENOSPC:
+    case EDQUOT:
+    case EFBIG:
+        return 507;
+    default:
+        return 500;
+    }
+}
+
+/* Constructs an upload of the given range into the file at `path`, throws 409 if the range
+   doesn't continue the partial upload or another range of it is being received; the completed
+   file is deduplicated in the content-addressed `store` unless it's empty */
+ResumableUpload::ResumableUpload(const std::string &path, const ContentRange &range, const std::string &store,
+    const std::string &stateDirectory)
+    : FileUpload(path, store)
+    , _stateDirectory(stateDirectory)
+    , _offset(range.offset)
+    , _isComplete(range.hasTotal && range.offset + range.length == range.total)
+    , _isRecorded(false)
+{
+    if (!range.hasBody)
+        throw HttpException(409);
+
+    // The lock on the partial file keeps other requests for the same file out until this one is
+    // done; the file must still be the one at its path once the lock is taken
+    std::string partialPath = getPartialPath(path, stateDirectory);
+    _fileno = open(partialPath.c_str(), O_WRONLY | O_CREAT | O_CLOEXEC, 0644);
+    if (_fileno < 0)
+        throw HttpException(getErrorStatus());
+    struct stat fileStatus, pathStatus;
+    if (flock(_fileno, LOCK_EX | LOCK_NB) != 0 || fstat(_fileno, &fileStatus) != 0
+     || stat(partialPath.c_str(), &pathStatus) != 0 || fileStatus.st_ino != pathStatus.st_ino)
+    {
+        close(_fileno);
+        _fileno = -1;
+        throw HttpException(409);
+    }
+
+    // Without an unexpired state the partial upload starts over from the first byte
+    size_t offset;
+    if (!readOffset(path, stateDirectory, offset))
+        offset = 0;
+    if (range.offset != offset)
+    {
+        close(_fileno);
+        _fileno = -1;
+        throw HttpException(409);
+    }
+
+    // Bytes past the recorded length are left over from an interrupted write
+    if (ftruncate(_fileno, range.offset) != 0 || lseek(_fileno, range.offset, SEEK_SET) < 0)
+    {
+        int status = getErrorStatus();
+        close(_fileno);
+        _fileno = -1;
+        throw HttpException(status);
+    }
+}
+
+/* Records how much of the range was received, so the client can resume from there */
+ResumableUpload::~ResumableUpload()
+{
+    if (!_isRecorded)
+        recordState();
+}
+
+/* Records the received range, the file is moved into place if it was the last one; throws
+   the HTTP error that stopped the upload */
+void ResumableUpload::finish()
+{
+    if (_errorStatus != 0)
+        throw HttpException(_errorStatus);
+
+    if (!_isComplete)
+    {
+        if (!recordState())
+            throw HttpException(500);
+        return;
+    }
+
+    // The ranges arrived in separate requests, so the content is hashed once it's complete
+    std::string digest;
+    if (!_store.empty() && !hashPartialFile(digest))
+        throw HttpException(500);
+
+    // The partial file becomes the file, its state is done with; the file is only closed, which
+    // releases its lock, once it was moved
+    _isRecorded = true;
+    if (std::rename(getPartialPath(_path, _stateDirectory).c_str(), _path.c_str()) != 0)
+        throw HttpException(getErrorStatus());
+    std::remove(getStatePath(_path, _stateDirectory).c_str());
+    int result = close(_fileno);
+    _fileno = -1;
+    if (result != 0)
+        throw HttpException(500);
+    if (!_store.empty())
+        UploadHandler::storeContent(_store, digest, _path);
+}
+
+/* Gets the number of bytes received by the unexpired partial upload of the file at `path`,
+   an expired partial upload is removed */
+size_t ResumableUpload::queryOffset(const std::string &path, const std::string &stateDirectory)
+{
+    size_t offset;
+    if (readOffset(path, stateDirectory, offset))
+        return offset;
+    discard(path, stateDirectory);
+    return 0;
+}
+
+/* Removes the partial upload of the file at `path`, if there is one that isn't being received
+   right now */
+void ResumableUpload::discard(const std::string &path, const std::string &stateDirectory)
+{
+    if (stateDirectory.empty())
+        return;
+
+    // A locked partial file belongs to a request that is still receiving a range
+    std::string partialPath = getPartialPath(path, stateDirectory);
+    int fileno = open(partialPath.c_str(), O_WRONLY | O_CLOEXEC);
+    if (fileno >= 0 && flock(fileno, LOCK_EX | LOCK_NB) != 0)
+    {
+        close(fileno);
+        return;
+    }
+    std::remove(partialPath.c_str());
+    std::remove(getStatePath(path, stateDirectory).c_str());
+    if (fileno >= 0)
+        close(fileno);
+}
+
+/* Reads the number of bytes received by the partial upload of the file at `path`, returns
+   false if there is no unexpired partial upload */
+bool ResumableUpload::readOffset(const std::string &path, const std::string &stateDirectory, size_t &outOffset)
+{
+    std::ifstream state(getStatePath(path, stateDirectory).c_str());
+    size_t offset;
+    time_t expiry;
+    if (!(state >> offset >> expiry) || expiry <= std::time(NULL))
+        return false;
+
+    // A partial file that lost bytes is only resumed from what it still holds
+    struct stat status;
+    if (stat(getPartialPath(path, stateDirectory).c_str(), &status) != 0)
+        return false;
+    outOffset = std::min(offset, static_cast<size_t>(status.st_size));
+    return true;
+}
+
+/* Writes the number of received bytes and a renewed expiry to the state file */
+bool ResumableUpload::recordState()
+{
+    _isRecorded = true;
+    std::ofstream state(getStatePath(_path, _stateDirectory).c_str(), std::ios::trunc);
+    state << _offset + _length << ' ' << std::time(NULL) + RESUMABLE_UPLOAD_LIFETIME << '\n';
+    state.close();
+    return !state.fail();
+}
+
+/* Hashes the content of the complete partial file, returns false if it can't be read */
+bool ResumableUpload::hashPartialFile(std::string &outDigest)
+{
+    std::ifstream file(getPartialPath(_path, _stateDirectory).c_str(), std::ios::binary);
+    char buffer[65536];
+    _hash.reset();
+    while (file.read(buffer, sizeof(buffer)) || file.gcount() > 0)
+        _hash.update(Slice(buffer, file.gcount()));
+    if (file.bad())
+        return false;
+    outDigest = _hash.finish();
+    return true;
+}
+
+/* Gets the path of the partial file for the file at `path` */
+std::string ResumableUpload::getPartialPath(const std::string &path, const std::string &stateDirectory)
+{
+    return getUploadFilePath(path, stateDirectory, ".part");
+}
+
+/* Gets the path of the state file for the file at `path` */
+std::string ResumableUpload::getStatePath(const std::string &path, const std::string &stateDirectory)
+{
+    return getUploadFilePath(path, stateDirectory, ".upload");
+}
+
+/* Gets the path of the given file of a partial upload for the file at `path` */
+std::string ResumableUpload::getUploadFilePath(const std::string &path, const std::string &stateDirectory,
+    const char *suffix)
+{
+    // The state directory is outside of the root, so the files can't be requested themselves
+    Sha256 hash;
+    hash.update(Slice(path));
+    return stateDirectory + "/" + hash.finish() + suffix;
+}
+
+/* Constructs an empty spool, in memory if `inMemory` is set and that's possible, otherwise
+   in an unnamed temporary file */
+BodySpool::BodySpool(bool inMemory)
+    : FileUpload(std::string(), std::string())
+{
+#ifdef __42_LIKES_WASTING_CPU_CYCLES__
+    (void)inMemory;
+    // The file is only reachable through its descriptor once its name is removed
+    for (size_t attempt = 0; _fileno < 0 && attempt < FILE_UPLOAD_MAX_NAME_ATTEMPTS; attempt++)
+    {
+        std::string path = UploadHandler::createTemporaryPath("/tmp");
+        _fileno = open(path.c_str(), O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC, 0600);
+        if (_fileno >= 0)
+            std::remove(path.c_str());
+        else if (errno != EEXIST)
+            break;
+    }
+#else
+    if (inMemory)
+        _fileno = memfd_create("webserv-body", MFD_CLOEXEC);
+    if (_fileno < 0)
+        _fileno = open("/tmp", O_TMPFILE | O_RDWR | O_CLOEXEC, 0600);
+#endif // __42_LIKES_WASTING_CPU_CYCLES__
+    if (_fileno < 0)
+        throw HttpException(getErrorStatus());
+}
+
+/* Rewinds the spool so it's read from the start, throws the HTTP error that stopped it */
+void BodySpool::finish()
+{
+    if (_errorStatus != 0)
+        throw HttpException(_errorStatus);
+    if (lseek(_fileno, 0, SEEK_SET) < 0)
+        throw HttpException(500);
+}
+
+/* Handles the upload of one or multiple files from a buffered body, the replaced files are
+   dropped from `fileCache` */
+void UploadHandler::handleUpload(const HttpRequest &request, const RoutingInfo &routingInfo, FileCache &fileCache)
+{
     // Extract the form boundary from the request's content type header
-    Slice boundarySlice;
-    if (!extractBoundary(request, boundarySlice))
+    Slice boundary;
+    if (!extractBoundary(request, boundary))
         throw HttpException(400);
-    std::string boundary = "--" + boundarySlice.toString();
 
-    // Consume the first boundary
-    if (body.getLength() == 0)
+    MultipartUpload upload(boundary, routingInfo.nodePath, routingInfo.getLocalRoute()->uploadStore, fileCache);
+    upload.writeBody(Slice(request.body));
+    upload.finish();
+}
+
+/* Replaces the uploaded file at `path` with a hard link to the blob of its content in
+   `store`, which is named by the content's `digest`; the file becomes that blob if the
+   store doesn't have it yet, and is kept as it is if it can't be linked */
+void UploadHandler::storeContent(const std::string &store, const std::string &digest, const std::string &path)
+{
+    // Blobs are spread over subdirectories by the first byte of their digest
+    std::string directory = Slice(store).stripEnd('/').toString() + "/" + digest.substr(0, 2);
+    std::string blobPath = directory + "/" + digest;
+
+    // New content is kept by linking the uploaded file into the store
+    int result = link(path.c_str(), blobPath.c_str());
+    if (result != 0 && errno == ENOENT)
+    {
+        if (mkdir(directory.c_str(), 0755) != 0 && errno != EEXIST)
+        {
+            reportStoreFailure("Unable to create the blob directory", directory);
+            return;
+        }
+        result = link(path.c_str(), blobPath.c_str());
+    }
+    if (result == 0)
         return;
-    if (!body.consumeStart(boundary))
-        throw HttpException(400);
-    if (!body.consumeStart(C_SLICE("\r\n")))
-        throw HttpException(400);
+    if (errno != EEXIST)
+    {
+        reportStoreFailure("Unable to link the upload to its blob", blobPath);
+        return;
+    }
 
-    // Also consume the CRLF after the first boundary
-    boundary = "\r\n" + boundary;
+    // Known content replaces the uploaded copy with another link to the blob, which frees it
+    size_t separator = path.rfind('/');
+    std::string pathDirectory = separator == std::string::npos ? "." : path.substr(0, separator);
+    for (size_t attempt = 0; attempt < FILE_UPLOAD_MAX_NAME_ATTEMPTS; attempt++)
+    {
+        std::string temporaryPath = createTemporaryPath(pathDirectory);
+        if (link(blobPath.c_str(), temporaryPath.c_str()) == 0)
+        {
+            if (std::rename(temporaryPath.c_str(), path.c_str()) != 0)
+            {
+                reportStoreFailure("Unable to replace the upload with its blob", path);
+                std::remove(temporaryPath.c_str());
+            }
+            return;
+        }
+        if (errno != EEXIST)
+        {
+            reportStoreFailure("Unable to link the blob to the upload", blobPath);
+            return;
+        }
+    }
+    errno = EEXIST;
+    reportStoreFailure("Unable to find a temporary name for the upload", path);
+}
 
-    // Consume boundaries
-    while (body.getLength() > 0)
+/* Removes the blobs of `store` that no uploaded file links to anymore, which is the case
+   once a blob is its own only link; must run while no upload is stored */
+void UploadHandler::collectStore(const std::string &store)
+{
+    std::string root = Slice(store).stripEnd('/').toString();
+    DIR *storeHandle = opendir(root.c_str());
+    if (storeHandle == NULL)
     {
-        // Extract and handle the form field up to the next boundary
-        if (!body.splitStart(boundary, field))
-            throw HttpException(400);
-        handleField(field, routingInfo);
+        reportStoreFailure("Unable to open the upload store", root);
+        return;
+    }
 
-        // Break if the final boundary is reached
-        if (body.consumeStart(C_SLICE("--")))
-            break;
-        if (!body.consumeStart(C_SLICE("\r\n")))
-            throw HttpException(400);
+    // Blobs are only looked for in the subdirectories named by the first byte of a digest
+    dirent *subdirectory;
+    while ((subdirectory = readdir(storeHandle)) != NULL)
+    {
+        if (std::strlen(subdirectory->d_name) != 2 || subdirectory->d_name[0] == '.')
+            continue;
+        std::string directory = root + "/" + subdirectory->d_name;
+        DIR *directoryHandle = opendir(directory.c_str());
+        if (directoryHandle == NULL)
+            continue;
+
+        dirent *blob;
+        while ((blob = readdir(directoryHandle)) != NULL)
+        {
+            std::string blobPath = directory + "/" + blob->d_name;
+            struct stat status;
+            if (blob->d_name[0] == '.' || lstat(blobPath.c_str(), &status) != 0)
+                continue;
+            if (S_ISREG(status.st_mode) && status.st_nlink == 1 && unlink(blobPath.c_str()) != 0)
+                reportStoreFailure("Unable to remove the unreferenced blob", blobPath);
+        }
+        closedir(directoryHandle);
     }
+    closedir(storeHandle);
+}
+
+/* Reports that the upload store couldn't be used for `path`, using the current `errno` */
+void UploadHandler::reportStoreFailure(const char *message, const std::string &path)
+{
+    std::cerr << "warning: " << message << " " << path << ": " << std::strerror(errno) << std::endl;
+}
+
+/* Creates a name for a temporary file in the given directory, which may be taken already */
+std::string UploadHandler::createTemporaryPath(const std::string &directory)
+{
+    // Worker threads share the counter, worker processes are told apart by their ID; the file
+    // is created exclusively anyway
+    static size_t counter = 0;
+    size_t value = __atomic_add_fetch(&counter, 1, __ATOMIC_RELAXED);
+    return directory + "/.webserv-upload-" + Utility::numberToString(getpid()) + "-" + Utility::numberToString(value);
 }
@@ -1,13 +1,295 @@
 #ifndef UPLOAD_HANDLER_hpp
 #define UPLOAD_HANDLER_hpp
 
+#include "sha256.hpp"
 #include "routing.hpp"
+#include "file_cache.hpp"
 #include "http_request.hpp"
+#include "http_request_parser.hpp"
+
+#include <string>
+#include <fstream>
+
+/* The longest header of a form part */
+#define MULTIPART_UPLOAD_MAX_HEADER_LENGTH 8192
+
+/* The capacity requested for the pipe that carries spliced body bytes into a file */
+#define FILE_UPLOAD_PIPE_SIZE 1048576
+
+/* The largest request body of a known length that a CGI process reads from memory, longer
+   ones and those of an unknown length are spooled into a file as they arrive */
+#define BODY_SPOOL_THRESHOLD 65536
+
+/* The seconds a partial upload is kept for its client to resume it */
+#define RESUMABLE_UPLOAD_LIFETIME 86400
+
+/* A body sink that stores an upload, which is completed once the whole body arrived */
+class UploadSink: public BodySink
+{
+public:
+    /* Completes the upload once the whole body was written, throws the HTTP error that stopped
+       it */
+    virtual void finish() = 0;
+
+    /* Gets whether body bytes can be moved from the socket by `spliceBody()` right now */
+    virtual bool canSplice() const;
+
+    /* Moves up to `length` body bytes from the socket into the upload without copying them
+       through user space, returns the number of bytes moved which is zero if the socket would
+       block */
+    virtual size_t spliceBody(int fileno, size_t length);
+};
+
+/* Position of an upload within the multipart body */
+enum MultipartPhase
+{
+    /* Skipping bytes until the first delimiter */
+    MULTIPART_PREAMBLE,
+    /* Expecting the CRLF after a delimiter or the two dashes that close the body */
+    MULTIPART_DELIMITER_END,
+    /* Collecting the header of a part */
+    MULTIPART_PART_HEADER,
+    /* Writing the content of a part until the next delimiter */
+    MULTIPART_PART_BODY,
+    /* Skipping bytes after the closing delimiter */
+    MULTIPART_EPILOGUE
+};
+
+/* Writes the files of a `multipart/form-data` body as its bytes arrive, so only a small
+   window of the body is held in memory */
+class MultipartUpload: public UploadSink
+{
+public:
+    /* Constructs an upload of the form parts delimited by `boundary` into `directory`, the files
+       are deduplicated in the content-addressed `store` unless it's empty and dropped from
+       `fileCache` once they were replaced */
+    MultipartUpload(Slice boundary, const std::string &directory, const std::string &store,
+        FileCache &fileCache);
+
+    /* Closes the file being written and removes it if it is incomplete */
+    ~MultipartUpload();
+
+    /* Consumes the next bytes of the body, writing file parts as they arrive; an error stops
+       the upload and is reported by `finish()` */
+    void writeBody(Slice data);
+
+    /* Completes the upload once the whole body was written, throws the HTTP error that stopped
+       it or 400 if the body ended before its closing delimiter */
+    void finish();
+private:
+    MultipartPhase _phase;
+    std::string    _delimiter;
+    size_t         _shifts[256];
+    std::string    _directory;
+    std::string    _store;
+    FileCache     &_fileCache;
+    Sha256         _hash;
+    std::string    _carry;
+    std::string    _header;
+    std::ofstream  _file;
+    std::string    _filePath;
+    std::string    _temporaryPath;
+    int            _errorStatus;
+    bool           _isEmpty;
+
+    /* Consumes bytes of the body according to the current phase */
+    void consume(Slice &data);
+
+    /* Consumes part content up to and including the next delimiter, returns whether one was
+       found; the start of a delimiter at the data's end is kept for the next bytes */
+    bool consumeContent(Slice &data);
+
+    /* Consumes bytes of a part's header and starts the part once the header is complete */
+    void consumeHeader(Slice &data);
+
+    /* Opens a temporary file for a part if its header names a destination */
+    void startPart(Slice header);
+
+    /* Closes the current part's file once its content is complete and moves it into place */
+    void finishPart();
+
+    /* Writes part content to the current part's file, if any */
+    void writeContent(Slice data);
+
+    /* Closes and removes the temporary file of an incomplete part, its destination is left as
+       it was */
+    void discardPart();
+
+    /* Finds the first delimiter in the data using its Boyer-Moore-Horspool shifts */
+    size_t findDelimiter(Slice data) const;
+
+    /* Finds the offset of the shortest suffix of the data that starts a delimiter,
+       the data's length if there is none */
+    size_t findPartialDelimiter(Slice data) const;
+
+    /* Disable copy-construction and copy-assignment */
+    MultipartUpload(const MultipartUpload &other);
+    MultipartUpload &operator=(const MultipartUpload &other);
+};
+
+/* Stores a raw request body as the file at a path, which is only replaced once the whole body
+   was written; the body is first written to an unnamed temporary file next to it */
+class FileUpload: public UploadSink
+{
+public:
+    /* Constructs an upload into the file at `path`, space for `length` bytes is reserved
+       up front if the body's length is known (non-zero); the file is deduplicated in the
+       content-addressed `store` unless it's empty */
+    FileUpload(const std::string &path, size_t length, const std::string &store);
+
+    /* Closes the file and removes it unless the upload was completed */
+    ~FileUpload();
+
+    /* Writes the next bytes of the body; an error stops the upload and is reported by
+       `finish()` */
+    void writeBody(Slice data);
+
+    /* Gets whether body bytes can be moved from the socket by `spliceBody()` right now */
+    bool canSplice() const;
+
+    /* Moves up to `length` body bytes from the socket through a pipe into the file without
+       copying them through user space, returns the number of bytes moved which is zero if the
+       socket would block */
+    size_t spliceBody(int fileno, size_t length);
+
+    /* Moves the completed file into place, throws the HTTP error that stopped the upload */
+    void finish();
+protected:
+    std::string _path;
+    std::string _store;
+    Sha256      _hash;
+    std::string _temporaryPath;
+    int         _fileno;
+    int         _pipe[2];
+    int         _errorStatus;
+    size_t      _length;
+
+    /* Constructs an upload into the file at `path` whose file is opened by the deriving class */
+    FileUpload(const std::string &path, const std::string &store);
+
+    /* Opens a temporary file with a unique name in the given directory */
+    void openNamedTemporary(const std::string &directory);
+
+    /* Writes the given number of bytes from the pipe into the file, bytes are dropped once
+       the upload failed */
+    void drainPipe(size_t length);
+
+    /* Gets the HTTP error matching the `errno` of a failed file operation */
+    static int getErrorStatus();
+
+    /* Disable copy-construction and copy-assignment */
+    FileUpload(const FileUpload &other);
+    FileUpload &operator=(const FileUpload &other);
+};
+
+/* Appends a range of a file's content to its partial upload, which is moved into place once
+   its last byte arrived; the received length and expiry of the partial upload are kept in a
+   state file, so interrupted uploads can be resumed; both files are named by the hash of the
+   file's path in the route's state directory, which is outside of any root */
+class ResumableUpload: public FileUpload
+{
+public:
+    /* Constructs an upload of the given range into the file at `path`, throws 409 if the range
+       doesn't continue the partial upload or another range of it is being received; the
+       completed file is deduplicated in the content-addressed `store` unless it's empty */
+    ResumableUpload(const std::string &path, const ContentRange &range, const std::string &store,
+        const std::string &stateDirectory);
+
+    /* Records how much of the range was received, so the client can resume from there */
+    ~ResumableUpload();
+
+    /* Records the received range, the file is moved into place if it was the last one; throws
+       the HTTP error that stopped the upload */
+    void finish();
+
+    /* Gets the number of bytes received by the unexpired partial upload of the file at `path`,
+       an expired partial upload is removed */
+    static size_t queryOffset(const std::string &path, const std::string &stateDirectory);
+
+    /* Removes the partial upload of the file at `path`, if there is one that isn't being
+       received right now */
+    static void discard(const std::string &path, const std::string &stateDirectory);
+private:
+    std::string _stateDirectory;
+    size_t      _offset;
+    bool        _isComplete;
+    bool        _isRecorded;
+
+    /* Writes the number of received bytes and a renewed expiry to the state file */
+    bool recordState();
+
+    /* Reads the number of bytes received by the partial upload of the file at `path`, returns
+       false if there is no unexpired partial upload */
+    static bool readOffset(const std::string &path, const std::string &stateDirectory, size_t &outOffset);
+
+    /* Hashes the content of the complete partial file, returns false if it can't be read */
+    bool hashPartialFile(std::string &outDigest);
+
+    /* Gets the path of the partial file for the file at `path` */
+    static std::string getPartialPath(const std::string &path, const std::string &stateDirectory);
+
+    /* Gets the path of the state file for the file at `path` */
+    static std::string getStatePath(const std::string &path, const std::string &stateDirectory);
+
+    /* Gets the path of the given file of a partial upload for the file at `path` */
+    static std::string getUploadFilePath(const std::string &path, const std::string &stateDirectory,
+        const char *suffix);
+};
+
+/* Keeps a request body in an anonymous file as it arrives, which a CGI process then reads as
+   its standard input */
+class BodySpool: public FileUpload
+{
+public:
+    /* Constructs an empty spool, in memory if `inMemory` is set and that's possible, otherwise
+       in an unnamed temporary file */
+    BodySpool(bool inMemory);
+
+    /* Rewinds the spool so it's read from the start, throws the HTTP error that stopped it */
+    void finish();
+
+    /* Gets the spool's file descriptor */
+    inline int getFileno() const
+    {
+        return _fileno;
+    }
+
+    /* Gets the length of the spooled body */
+    inline size_t getLength() const
+    {
+        return _length;
+    }
+
+    /* Gets whether writing to the spool failed, which drops the rest of the body */
+    inline bool hasFailed() const
+    {
+        return _errorStatus != 0;
+    }
+};
 
 namespace UploadHandler
 {
-    /* Handles the upload of one or multiple files */
-    void handleUpload(const HttpRequest &request, const RoutingInfo &routingInfo);
+    /* Attempts to parse the request's `Content-Type` header to obtain the form boundary */
+    bool extractBoundary(const HttpRequest &request, Slice &outBoundary);
+
+    /* Handles the upload of one or multiple files from a buffered body, the replaced files are
+       dropped from `fileCache` */
+    void handleUpload(const HttpRequest &request, const RoutingInfo &routingInfo, FileCache &fileCache);
+
+    /* Replaces the uploaded file at `path` with a hard link to the blob of its content in
+       `store`, which is named by the content's `digest`; the file becomes that blob if the
+       store doesn't have it yet, and is kept as it is, with a warning, if it can't be linked */
+    void storeContent(const std::string &store, const std::string &digest, const std::string &path);
+
+    /* Removes the blobs of `store` that no uploaded file links to anymore, which is the case
+       once a blob is its own only link; must run while no upload is stored */
+    void collectStore(const std::string &store);
+
+    /* Reports that the upload store couldn't be used for `path`, using the current `errno` */
+    void reportStoreFailure(const char *message, const std::string &path);
+
+    /* Creates a name for a temporary file in the given directory, which may be taken already */
+    std::string createTemporaryPath(const std::string &directory);
 };
 
 #endif // UPLOAD_HANDLER_hpp
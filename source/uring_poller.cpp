@@ -0,0 +1,179 @@
+#include "uring_poller.hpp"
+
+#ifndef __42_LIKES_WASTING_CPU_CYCLES__
+
+#include <errno.h>
+#include <cstring>
+#include <unistd.h>
+#include <stdexcept>
+#include <sys/mman.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+
+/* Sets up a ring with (at least) the given number of submission entries */
+UringPoller::UringPoller(unsigned int entries)
+    : _fileno(-1)
+    , _ringMemory(MAP_FAILED)
+    , _ringSize(0)
+    , _sqes(static_cast<io_uring_sqe *>(MAP_FAILED))
+    , _sqesSize(0)
+    , _sqLocalTail(0)
+{
+    io_uring_params params;
+    std::memset(&params, 0, sizeof(params));
+
+    if ((_fileno = static_cast<int>(syscall(SYS_io_uring_setup, entries, &params))) < 0)
+        throw std::runtime_error("Unable to set up io_uring instance");
+
+    // Waiting with a timeout requires the extended argument; the single mapping and the lossless
+    // completion queue keep this implementation simple
+    const unsigned int features = IORING_FEAT_SINGLE_MMAP | IORING_FEAT_NODROP | IORING_FEAT_EXT_ARG;
+    if ((params.features & features) != features)
+    {
+        close(_fileno);
+        throw std::runtime_error("Kernel's io_uring implementation is too old");
+    }
+
+    // Map the submission and completion rings, which share a single mapping, and the entries
+    size_t sqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned int);
+    size_t cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    _ringSize = sqRingSize > cqRingSize ? sqRingSize : cqRingSize;
+    _ringMemory = mmap(NULL, _ringSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, _fileno, IORING_OFF_SQ_RING);
+    _sqesSize = params.sq_entries * sizeof(io_uring_sqe);
+    _sqes = static_cast<io_uring_sqe *>(mmap(NULL, _sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, _fileno, IORING_OFF_SQES));
+    if (_ringMemory == MAP_FAILED || _sqes == MAP_FAILED)
+    {
+        if (_ringMemory != MAP_FAILED)
+            munmap(_ringMemory, _ringSize);
+        if (_sqes != MAP_FAILED)
+            munmap(_sqes, _sqesSize);
+        close(_fileno);
+        throw std::runtime_error("Unable to map io_uring rings");
+    }
+
+    char *ring = static_cast<char *>(_ringMemory);
+    _sqHead      = reinterpret_cast<unsigned int *>(ring + params.sq_off.head);
+    _sqTail      = reinterpret_cast<unsigned int *>(ring + params.sq_off.tail);
+    _sqArray     = reinterpret_cast<unsigned int *>(ring + params.sq_off.array);
+    _sqMask      = *reinterpret_cast<unsigned int *>(ring + params.sq_off.ring_mask);
+    _sqEntries   = params.sq_entries;
+    _sqLocalTail = *_sqTail;
+    _cqHead      = reinterpret_cast<unsigned int *>(ring + params.cq_off.head);
+    _cqTail      = reinterpret_cast<unsigned int *>(ring + params.cq_off.tail);
+    _cqMask      = *reinterpret_cast<unsigned int *>(ring + params.cq_off.ring_mask);
+    _cqes        = reinterpret_cast<io_uring_cqe *>(ring + params.cq_off.cqes);
+
+    // Every submission slot always refers to the entry of the same index
+    for (unsigned int index = 0; index < _sqEntries; index++)
+        _sqArray[index] = index;
+}
+
+/* Unmaps the rings and closes the ring's file descriptor */
+UringPoller::~UringPoller()
+{
+    munmap(_sqes, _sqesSize);
+    munmap(_ringMemory, _ringSize);
+    close(_fileno);
+}
+
+/* Queues a one-shot poll for the given events on a file descriptor */
+void UringPoller::queuePoll(int fileno, uint32_t eventMask, uint64_t userData)
+{
+    io_uring_sqe *sqe = nextSqe();
+    sqe->opcode        = IORING_OP_POLL_ADD;
+    sqe->fd            = fileno;
+    sqe->poll32_events = eventMask & ~(EPOLLET | EPOLLEXCLUSIVE);
+    sqe->user_data     = userData;
+}
+
+/* Queues an accept on a listening socket that completes once for every connection, with the
+   connection's file descriptor as result, until it fails or is cancelled */
+void UringPoller::queueMultishotAccept(int fileno, uint64_t userData)
+{
+    // The peer address would be overwritten by the next connection, so it isn't requested
+    io_uring_sqe *sqe = nextSqe();
+    sqe->opcode       = IORING_OP_ACCEPT;
+    sqe->fd           = fileno;
+    sqe->ioprio       = IORING_ACCEPT_MULTISHOT;
+    sqe->accept_flags = SOCK_NONBLOCK | SOCK_CLOEXEC;
+    sqe->user_data    = userData;
+}
+
+/* Queues the cancellation of the request that was queued with the given user data */
+void UringPoller::queueCancellation(uint64_t userData)
+{
+    io_uring_sqe *sqe = nextSqe();
+    sqe->opcode    = IORING_OP_ASYNC_CANCEL;
+    sqe->fd        = -1;
+    sqe->addr      = userData;
+    sqe->user_data = URING_POLLER_IGNORED_USER_DATA;
+}
+
+/* Submits all queued requests and waits (in the given timeout) for a completion,
+   returns false when the wait was interrupted by a signal */
+bool UringPoller::submitAndWait(int timeout)
+{
+    __kernel_timespec timespec;
+    timespec.tv_sec  = timeout / 1000;
+    timespec.tv_nsec = (timeout % 1000) * 1000000ll;
+
+    io_uring_getevents_arg argument;
+    std::memset(&argument, 0, sizeof(argument));
+    if (timeout >= 0)
+        argument.ts = reinterpret_cast<uintptr_t>(&timespec);
+
+    if (enter(1, IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG, &argument, sizeof(argument)) >= 0)
+        return true;
+
+    // Expired timeouts and completion overflows still leave the completions to be processed
+    if (errno == ETIME || errno == EBUSY)
+        return true;
+    if (errno == EINTR)
+        return false;
+    throw std::runtime_error("Unable to wait for io_uring completions");
+}
+
+/* Takes the next completion from the ring, returns false if there is none; `outHasMore` is
+   set while the request that completed stays active */
+bool UringPoller::popCompletion(uint64_t &outUserData, int32_t &outResult, bool &outHasMore)
+{
+    unsigned int head = *_cqHead;
+    if (head == __atomic_load_n(_cqTail, __ATOMIC_ACQUIRE))
+        return false;
+
+    const io_uring_cqe &cqe = _cqes[head & _cqMask];
+    outUserData = cqe.user_data;
+    outResult   = cqe.res;
+    outHasMore  = (cqe.flags & IORING_CQE_F_MORE) != 0;
+    __atomic_store_n(_cqHead, head + 1, __ATOMIC_RELEASE);
+    return true;
+}
+
+/* Gets a cleared submission entry, submits the queued ones first if the queue is full */
+io_uring_sqe *UringPoller::nextSqe()
+{
+    if (_sqLocalTail - __atomic_load_n(_sqHead, __ATOMIC_ACQUIRE) >= _sqEntries)
+    {
+        if (enter(0, 0, NULL, 0) < 0 && errno != EINTR && errno != EBUSY)
+            throw std::runtime_error("Unable to submit io_uring requests");
+        if (_sqLocalTail - __atomic_load_n(_sqHead, __ATOMIC_ACQUIRE) >= _sqEntries)
+            throw std::runtime_error("io_uring submission queue is full");
+    }
+
+    io_uring_sqe *sqe = &_sqes[_sqLocalTail & _sqMask];
+    std::memset(sqe, 0, sizeof(*sqe));
+    _sqLocalTail++;
+    return sqe;
+}
+
+/* Publishes the queued submission entries and enters the kernel */
+int UringPoller::enter(unsigned int minComplete, unsigned int flags, const void *argument, size_t argumentSize)
+{
+    __atomic_store_n(_sqTail, _sqLocalTail, __ATOMIC_RELEASE);
+    unsigned int queued = _sqLocalTail - __atomic_load_n(_sqHead, __ATOMIC_ACQUIRE);
+    return static_cast<int>(syscall(SYS_io_uring_enter, _fileno, queued, minComplete, flags, argument, argumentSize));
+}
+
+#endif // __42_LIKES_WASTING_CPU_CYCLES__
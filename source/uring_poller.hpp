@@ -0,0 +1,69 @@
+#ifndef URING_POLLER_hpp
+#define URING_POLLER_hpp
+
+#include <stddef.h>
+#include <stdint.h>
+
+struct io_uring_sqe;
+struct io_uring_cqe;
+
+/* User data of requests whose completions carry no information */
+#define URING_POLLER_IGNORED_USER_DATA UINT64_MAX
+
+/* Minimal io_uring instance that submits one-shot poll requests and multishot accepts; queued
+   requests and the wait for their completions share a single system call */
+class UringPoller
+{
+public:
+    /* Sets up a ring with (at least) the given number of submission entries */
+    explicit UringPoller(unsigned int entries);
+
+    /* Unmaps the rings and closes the ring's file descriptor */
+    ~UringPoller();
+
+    /* Queues a one-shot poll for the given events on a file descriptor */
+    void queuePoll(int fileno, uint32_t eventMask, uint64_t userData);
+
+    /* Queues an accept on a listening socket that completes once for every connection, with the
+       connection's file descriptor as result, until it fails or is cancelled */
+    void queueMultishotAccept(int fileno, uint64_t userData);
+
+    /* Queues the cancellation of the request that was queued with the given user data */
+    void queueCancellation(uint64_t userData);
+
+    /* Submits all queued requests and waits (in the given timeout) for a completion,
+       returns false when the wait was interrupted by a signal */
+    bool submitAndWait(int timeout);
+
+    /* Takes the next completion from the ring, returns false if there is none; `outHasMore` is
+       set while the request that completed stays active */
+    bool popCompletion(uint64_t &outUserData, int32_t &outResult, bool &outHasMore);
+private:
+    int           _fileno;
+    void         *_ringMemory;
+    size_t        _ringSize;
+    io_uring_sqe *_sqes;
+    size_t        _sqesSize;
+    unsigned int *_sqHead;
+    unsigned int *_sqTail;
+    unsigned int *_sqArray;
+    unsigned int  _sqMask;
+    unsigned int  _sqEntries;
+    unsigned int  _sqLocalTail;
+    unsigned int *_cqHead;
+    unsigned int *_cqTail;
+    unsigned int  _cqMask;
+    io_uring_cqe *_cqes;
+
+    /* Gets a cleared submission entry, submits the queued ones first if the queue is full */
+    io_uring_sqe *nextSqe();
+
+    /* Publishes the queued submission entries and enters the kernel */
+    int enter(unsigned int minComplete, unsigned int flags, const void *argument, size_t argumentSize);
+
+    /* Disable copy-construction and copy-assignment */
+    UringPoller(const UringPoller &other);
+    UringPoller &operator=(const UringPoller &other);
+};
+
+#endif // URING_POLLER_hpp
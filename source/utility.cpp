@@ -1,12 +1,64 @@
 #include "utility.hpp"
 
 #include <errno.h>
+#include <fcntl.h>
 #include <unistd.h>
 #include <iostream>
 #include <stdexcept>
 #include <sys/stat.h>
 #include <cstring>
 #include <netdb.h>
+#include <iomanip>
+
+/* Abbreviated week day names, starting with the Unix epoch's Thursday */
+static const char *const g_weekDays[] = { "Thu", "Fri", "Sat", "Sun", "Mon", "Tue", "Wed" };
+
+/* Abbreviated month names */
+static const char *const g_months[] = {
+    "Jan", "Feb", "Mar", "Apr", "May", "Jun", "Jul", "Aug", "Sep", "Oct", "Nov", "Dec"
+};
+
+/* Converts a count of days since the Unix epoch to a (proleptic Gregorian) calendar date */
+static void daysToDate(int64_t days, int64_t &outYear, unsigned &outMonth, unsigned &outDay)
+{
+    // Count in 400-year eras starting on March 1st, 0000 so the leap day ends each year
+    days += 719468;
+    int64_t  era       = (days >= 0 ? days : days - 146096) / 146097;
+    unsigned dayOfEra  = static_cast<unsigned>(days - era * 146097);
+    unsigned yearOfEra = (dayOfEra - dayOfEra / 1460 + dayOfEra / 36524 - dayOfEra / 146096) / 365;
+    unsigned dayOfYear = dayOfEra - (365 * yearOfEra + yearOfEra / 4 - yearOfEra / 100);
+    unsigned month     = (5 * dayOfYear + 2) / 153;
+
+    outDay   = dayOfYear - (153 * month + 2) / 5 + 1;
+    outMonth = month < 10 ? month + 3 : month - 9;
+    outYear  = static_cast<int64_t>(yearOfEra) + era * 400 + (outMonth <= 2 ? 1 : 0);
+}
+
+/* Converts a (proleptic Gregorian) calendar date to a count of days since the Unix epoch */
+static int64_t dateToDays(int64_t year, unsigned month, unsigned day)
+{
+    // Count in 400-year eras starting on March 1st, 0000 so the leap day ends each year
+    if (month <= 2)
+        year--;
+    int64_t  era       = (year >= 0 ? year : year - 399) / 400;
+    unsigned yearOfEra = static_cast<unsigned>(year - era * 400);
+    unsigned dayOfYear = (153 * (month > 2 ? month - 3 : month + 9) + 2) / 5 + day - 1;
+    unsigned dayOfEra  = yearOfEra * 365 + yearOfEra / 4 - yearOfEra / 100 + dayOfYear;
+    return era * 146097 + static_cast<int64_t>(dayOfEra) - 719468;
+}
+
+/* Attempts to convert `count` decimal digits at the given offset of a string slice */
+static bool parseDigits(Slice string, size_t offset, size_t count, unsigned &outResult)
+{
+    outResult = 0;
+    for (size_t index = offset; index < offset + count; index++)
+    {
+        if (string[index] < '0' || string[index] > '9')
+            return false;
+        outResult = outResult * 10 + static_cast<unsigned>(string[index] - '0');
+    }
+    return true;
+}
 
 /* Finds the substring `needle` in the given string `haystack` */
 const void *Utility::find(const void *haystack, size_t haystackLength, const void *needle, size_t needleLength)
@@ -59,7 +111,7 @@ NodeType Utility::queryNodeType(const char *path)
     {
         if (errno == EACCES)
             return NODE_TYPE_NO_ACCESS;
-        if (errno == ENOENT)
+        if (errno == ENOENT || errno == ENOTDIR)
             return NODE_TYPE_NOT_FOUND;
         throw std::runtime_error("Unable to query file information");
     }
@@ -226,3 +278,65 @@ bool Utility::decodeUrl(Slice string, std::string &outResult)
     outResult = stream.str();
     return true;
 }
+
+/* Switches the given file descriptor into non-blocking mode */
+void Utility::setNonBlocking(int fileno)
+{
+    // The other status flags of the file descriptor are kept
+    int flags = fcntl(fileno, F_GETFL);
+    if (flags < 0 || fcntl(fileno, F_SETFL, flags | O_NONBLOCK) != 0)
+        throw std::runtime_error("Unable to switch file descriptor into non-blocking mode");
+}
+
+/* Formats a Unix timestamp as an HTTP date; eg. "Sun, 06 Nov 1994 08:49:37 GMT" */
+std::string Utility::formatHttpDate(time_t time)
+{
+    int64_t days    = static_cast<int64_t>(time) / 86400;
+    int64_t seconds = static_cast<int64_t>(time) % 86400;
+    if (seconds < 0)
+    {
+        seconds += 86400;
+        days--;
+    }
+
+    int64_t  year;
+    unsigned month;
+    unsigned day;
+    daysToDate(days, year, month, day);
+
+    std::stringstream stream;
+    stream << g_weekDays[(days % 7 + 7) % 7] << ", "
+           << std::setfill('0') << std::setw(2) << day << ' '
+           << g_months[month - 1] << ' '
+           << std::setw(4) << year << ' '
+           << std::setw(2) << seconds / 3600 << ':'
+           << std::setw(2) << seconds / 60 % 60 << ':'
+           << std::setw(2) << seconds % 60 << " GMT";
+    return stream.str();
+}
+
+/* Attempts to convert an HTTP date in its preferred format to a Unix timestamp */
+bool Utility::parseHttpDate(Slice string, time_t &outResult)
+{
+    // The fixed-length format is "Sun, 06 Nov 1994 08:49:37 GMT", the week day is redundant
+    if (string.getLength() != 29 || string[3] != ',' || string[4] != ' ' || string[7] != ' '
+     || string[11] != ' ' || string[16] != ' ' || string[19] != ':' || string[22] != ':'
+     || !Slice(&string[25], 4).equalsIgnoreCase(C_SLICE(" GMT")))
+        return false;
+
+    unsigned day, year, hours, minutes, seconds;
+    if (!parseDigits(string, 5, 2, day) || !parseDigits(string, 12, 4, year)
+     || !parseDigits(string, 17, 2, hours) || !parseDigits(string, 20, 2, minutes)
+     || !parseDigits(string, 23, 2, seconds))
+        return false;
+
+    unsigned month = 0;
+    while (month < 12 && !Slice(&string[8], 3).equalsIgnoreCase(Slice(g_months[month], 3)))
+        month++;
+    if (month == 12 || day < 1 || day > 31 || hours > 23 || minutes > 59 || seconds > 60)
+        return false;
+
+    int64_t days = dateToDays(year, month + 1, day);
+    outResult = static_cast<time_t>(days * 86400 + hours * 3600 + minutes * 60 + seconds);
+    return true;
+}
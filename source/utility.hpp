@@ -10,6 +10,7 @@
 #include <sstream>
 #include <cstddef>
 #include <stdint.h>
+#include <time.h>
 
 enum NodeType
 {
@@ -64,6 +65,15 @@ namespace Utility
 
     /* Attempts to convert a URL-encoded string slice to a URL-decoded string */
     bool decodeUrl(Slice string, std::string &outResult);
+
+    /* Switches the given file descriptor into non-blocking mode */
+    void setNonBlocking(int fileno);
+
+    /* Formats a Unix timestamp as an HTTP date; eg. "Sun, 06 Nov 1994 08:49:37 GMT" */
+    std::string formatHttpDate(time_t time);
+
+    /* Attempts to convert an HTTP date in its preferred format to a Unix timestamp */
+    bool parseHttpDate(Slice string, time_t &outResult);
 }
 
 #endif // UTILITY_hpp
@@ -0,0 +1,359 @@
+#include "worker_pool.hpp"
+#include "signal_manager.hpp"
+#include "upload_handler.hpp"
+
+#include <errno.h>
+#include <sched.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <set>
+#include <iostream>
+#include <stdexcept>
+#include <sys/wait.h>
+
+/* Constructs the pool according to the configuration; thread workers get their applications
+   configured here while process workers get the shared listeners bound here */
+WorkerPool::WorkerPool(ApplicationConfig &config)
+    : _config(config)
+{
+#ifdef __42_LIKES_WASTING_CPU_CYCLES__
+    if (config.workerCount > 1 || config.workerAffinity || config.workerMode != WORKER_MODE_THREADS)
+        throw std::runtime_error("Multiple workers and CPU pinning are not supported in this build");
+#endif // __42_LIKES_WASTING_CPU_CYCLES__
+
+    // Reserve all slots up front so that worker references stay valid for the threads
+    _workers.reserve(config.workerCount);
+    for (size_t index = 0; index < config.workerCount; index++)
+    {
+        Worker worker;
+        worker.application     = NULL;
+        worker.index           = index;
+        worker.pinToCpu        = config.workerAffinity;
+        worker.pid             = -1;
+        worker.startTime       = 0;
+        worker.restartTime     = 0;
+        worker.startupFailures = 0;
+        worker.isStarted       = false;
+        _workers.push_back(worker);
+    }
+
+    // Blobs that lost all their uploads are removed before any worker stores new ones
+    std::set<std::string> stores;
+    for (size_t server = 0; server < config.servers.size(); server++)
+    {
+        const std::vector<LocalRouteConfig> &routes = config.servers[server].localRoutes;
+        for (size_t route = 0; route < routes.size(); route++)
+            if (!routes[route].uploadStore.empty() && stores.insert(routes[route].uploadStore).second)
+                UploadHandler::collectStore(routes[route].uploadStore);
+    }
+
+    try
+    {
+        if (config.workerMode == WORKER_MODE_PROCESSES)
+        {
+            // Bind every address once; the children inherit the listeners
+            for (size_t index = 0; index < config.servers.size(); index++)
+            {
+                uint64_t bindingKey = config.servers[index].getBindingKey();
+                if (_listeners.find(bindingKey) == _listeners.end())
+                    _listeners[bindingKey] = HttpServer::bindListener(config.servers[index], false);
+            }
+        }
+        else
+        {
+            // Configure every application from this thread since configuring links the endpoints
+            // of the shared server configurations
+            for (size_t index = 0; index < _workers.size(); index++)
+            {
+                _workers[index].application = new Application(config);
+                _workers[index].application->configure();
+            }
+        }
+    }
+    catch (...)
+    {
+        for (size_t index = 0; index < _workers.size(); index++)
+            delete _workers[index].application;
+        for (ListenerMap::iterator listener = _listeners.begin(); listener != _listeners.end(); listener++)
+            close(listener->second);
+        throw;
+    }
+}
+
+/* Releases all worker applications and shared listeners */
+WorkerPool::~WorkerPool()
+{
+    for (size_t index = 0; index < _workers.size(); index++)
+        delete _workers[index].application;
+    for (ListenerMap::iterator listener = _listeners.begin(); listener != _listeners.end(); listener++)
+        close(listener->second);
+}
+
+/* Runs all workers until an exit condition occurs */
+void WorkerPool::run()
+{
+    if (_config.workerMode == WORKER_MODE_PROCESSES)
+        runProcesses();
+    else
+        runThreads();
+}
+
+/* Runs the workers as threads; the calling thread runs the first worker */
+void WorkerPool::runThreads()
+{
+#ifndef __42_LIKES_WASTING_CPU_CYCLES__
+    // Start the additional workers on their own threads
+    for (size_t index = 1; index < _workers.size(); index++)
+    {
+        Worker &worker = _workers[index];
+        if (pthread_create(&worker.thread, NULL, threadMain, &worker) != 0)
+        {
+            worker.failure = "Unable to start worker thread";
+            SignalManager::requestQuit();
+            break;
+        }
+        worker.isStarted = true;
+    }
+#endif // __42_LIKES_WASTING_CPU_CYCLES__
+
+    // Run the first worker on the calling thread
+    if (!SignalManager::shouldQuit())
+        runWorker(_workers[0]);
+
+#ifndef __42_LIKES_WASTING_CPU_CYCLES__
+    // Interrupt the other workers' waits so they observe the quit condition immediately
+    for (size_t index = 1; index < _workers.size(); index++)
+    {
+        if (_workers[index].isStarted)
+            pthread_kill(_workers[index].thread, SIGTERM);
+    }
+    for (size_t index = 1; index < _workers.size(); index++)
+    {
+        if (_workers[index].isStarted)
+            pthread_join(_workers[index].thread, NULL);
+    }
+#endif // __42_LIKES_WASTING_CPU_CYCLES__
+
+    // Report the first failure like a single-threaded server would have
+    for (size_t index = 0; index < _workers.size(); index++)
+    {
+        if (!_workers[index].failure.empty())
+            throw std::runtime_error(_workers[index].failure);
+    }
+}
+
+/* Runs the workers as child processes and restarts them when they exit unexpectedly */
+void WorkerPool::runProcesses()
+{
+    // Quit-type signals and worker exits are only taken while waiting for them, so none can arrive
+    // between checking for them and starting to wait
+    sigset_t signals, originalMask;
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGCHLD);
+    sigaddset(&signals, SIGINT);
+    sigaddset(&signals, SIGQUIT);
+    sigaddset(&signals, SIGTERM);
+    if (sigprocmask(SIG_BLOCK, &signals, &originalMask) != 0)
+        throw std::runtime_error("Unable to block signals");
+
+    for (size_t index = 0; index < _workers.size(); index++)
+        startProcess(_workers[index], originalMask);
+
+    // Supervise the workers until the master is asked to quit or none is left
+    while (!SignalManager::shouldQuit())
+    {
+        int status;
+        int pid;
+        while ((pid = waitpid(-1, &status, WNOHANG)) > 0)
+        {
+            for (size_t index = 0; index < _workers.size(); index++)
+            {
+                if (_workers[index].pid == pid)
+                {
+                    handleProcessExit(_workers[index], status);
+                    break;
+                }
+            }
+        }
+        if (pid < 0 && errno != ECHILD)
+            throw std::runtime_error("Unable to wait for worker processes");
+
+        // Restart the workers that are due and find the next one that isn't
+        time_t now = std::time(NULL);
+        time_t nextRestartTime = 0;
+        bool hasWorkers = false;
+        for (size_t index = 0; index < _workers.size() && !SignalManager::shouldQuit(); index++)
+        {
+            Worker &worker = _workers[index];
+            if (worker.restartTime != 0 && worker.restartTime <= now)
+            {
+                worker.restartTime = 0;
+                startProcess(worker, originalMask);
+            }
+            if (worker.restartTime != 0 && (nextRestartTime == 0 || worker.restartTime < nextRestartTime))
+                nextRestartTime = worker.restartTime;
+            hasWorkers = hasWorkers || worker.pid > 0 || worker.restartTime != 0;
+        }
+        if (!hasWorkers || SignalManager::shouldQuit())
+            break;
+
+        // Wait for a worker to exit or a quit-type signal, but no longer than the next restart
+        timespec timeout;
+        timeout.tv_sec  = nextRestartTime - now;
+        timeout.tv_nsec = 0;
+        int number = sigtimedwait(&signals, NULL, nextRestartTime != 0 ? &timeout : NULL);
+        if (number == SIGINT || number == SIGQUIT || number == SIGTERM)
+            SignalManager::requestQuit();
+        else if (number < 0 && errno != EAGAIN && errno != EINTR)
+            throw std::runtime_error("Unable to wait for signals");
+    }
+
+    // Forward the quit request to the workers and wait for them to finish their loops
+    for (size_t index = 0; index < _workers.size(); index++)
+    {
+        if (_workers[index].pid > 0)
+            kill(_workers[index].pid, SIGTERM);
+    }
+    for (size_t index = 0; index < _workers.size(); index++)
+    {
+        if (_workers[index].pid > 0)
+            waitpid(_workers[index].pid, NULL, 0);
+        _workers[index].pid = -1;
+    }
+    sigprocmask(SIG_SETMASK, &originalMask, NULL);
+
+    // Report a worker that was given up like a single-process server would have failed
+    for (size_t index = 0; index < _workers.size(); index++)
+    {
+        if (!_workers[index].failure.empty())
+            throw std::runtime_error(_workers[index].failure);
+    }
+}
+
+/* Handles the exit of the given worker process, schedules its restart unless it shut down
+   cleanly or keeps failing at startup */
+void WorkerPool::handleProcessExit(Worker &worker, int status)
+{
+    worker.pid = -1;
+    if (SignalManager::shouldQuit())
+        return;
+
+    // Workers only exit cleanly when they were asked to quit themselves
+    if (WIFEXITED(status) && WEXITSTATUS(status) == 0)
+    {
+        std::cerr << "worker " << worker.index << " shut down" << std::endl;
+        return;
+    }
+    std::cerr << "worker " << worker.index;
+    if (WIFSIGNALED(status))
+        std::cerr << " was killed by signal " << WTERMSIG(status);
+    else
+        std::cerr << " exited with status " << WEXITSTATUS(status);
+
+    // Back off exponentially from a worker that keeps failing right after being started, and
+    // give up on it eventually
+    time_t now = std::time(NULL);
+    if (now - worker.startTime < WORKER_POOL_STARTUP_SECONDS)
+        worker.startupFailures++;
+    else
+        worker.startupFailures = 0;
+    if (worker.startupFailures >= WORKER_POOL_MAX_STARTUP_FAILURES)
+    {
+        std::cerr << "; giving up" << std::endl;
+        worker.failure = "Worker process keeps failing at startup";
+        SignalManager::requestQuit();
+        return;
+    }
+    time_t delay = worker.startupFailures == 0 ? 0 : static_cast<time_t>(1) << (worker.startupFailures - 1);
+    std::cerr << "; restarting in " << delay << "s" << std::endl;
+    worker.restartTime = now + delay;
+}
+
+/* Forks a child process for the given worker, which starts with the given signal mask */
+void WorkerPool::startProcess(Worker &worker, const sigset_t &signalMask)
+{
+    int pid = fork();
+    if (pid < 0)
+        throw std::runtime_error("Unable to fork worker process");
+    if (pid == 0)
+    {
+        sigprocmask(SIG_SETMASK, &signalMask, NULL);
+        runProcess(worker);
+    }
+    worker.pid = pid;
+    worker.startTime = std::time(NULL);
+}
+
+/* Runs a worker inside its freshly forked child process; never returns */
+void WorkerPool::runProcess(Worker &worker)
+{
+    // The dispatcher must be created after forking so that each worker owns its interest list
+    try
+    {
+        Application application(_config);
+        application.configure(&_listeners);
+        worker.application = &application;
+        runWorker(worker);
+        worker.application = NULL;
+    }
+    catch (const std::exception &exception)
+    {
+        worker.failure = exception.what();
+    }
+
+    if (!worker.failure.empty())
+    {
+        std::cerr << "fatal: " << worker.failure << std::endl;
+        std::exit(1);
+    }
+    std::exit(0);
+}
+
+/* Runs a worker's main loop and records any failure instead of propagating it */
+void WorkerPool::runWorker(Worker &worker)
+{
+    try
+    {
+        if (worker.pinToCpu)
+            pinCurrentThread(worker.index);
+        worker.application->mainLoop();
+    }
+    catch (const std::exception &exception)
+    {
+        worker.failure = exception.what();
+    }
+    catch (...)
+    {
+        worker.failure = "Thrown type is not derived from std::exception";
+    }
+
+    // A failing worker takes down the others to mirror a single-threaded server's behavior
+    if (!worker.failure.empty())
+        SignalManager::requestQuit();
+}
+
+/* Entry point of worker threads */
+void *WorkerPool::threadMain(void *argument)
+{
+    runWorker(*static_cast<Worker *>(argument));
+    return NULL;
+}
+
+/* Pins the calling thread to a CPU chosen by the worker's index */
+void WorkerPool::pinCurrentThread(size_t index)
+{
+#ifdef __42_LIKES_WASTING_CPU_CYCLES__
+    (void)index;
+#else
+    long cpuCount = sysconf(_SC_NPROCESSORS_ONLN);
+    if (cpuCount < 1)
+        throw std::runtime_error("Unable to query the number of CPUs");
+
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(index % static_cast<size_t>(cpuCount), &set);
+    if (pthread_setaffinity_np(pthread_self(), sizeof(set), &set) != 0)
+        throw std::runtime_error("Unable to pin worker to CPU");
+#endif // __42_LIKES_WASTING_CPU_CYCLES__
+}
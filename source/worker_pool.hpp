@@ -0,0 +1,81 @@
+#ifndef WORKER_POOL_hpp
+#define WORKER_POOL_hpp
+
+#include "config.hpp"
+#include "application.hpp"
+
+#include <string>
+#include <ctime>
+#include <vector>
+#include <signal.h>
+#include <pthread.h>
+
+/* A worker process that exits within this many seconds of being started failed at startup */
+#define WORKER_POOL_STARTUP_SECONDS 5
+
+/* The number of consecutive startup failures of a worker process after which the pool gives up */
+#define WORKER_POOL_MAX_STARTUP_FAILURES 5
+
+class WorkerPool
+{
+public:
+    /* Constructs the pool according to the configuration; thread workers get their applications
+       configured here while process workers get the shared listeners bound here */
+    WorkerPool(ApplicationConfig &config);
+
+    /* Releases all worker applications and shared listeners */
+    ~WorkerPool();
+
+    /* Runs all workers until an exit condition occurs */
+    void run();
+private:
+    /* State of a single reactor, running either as a thread or as a child process */
+    struct Worker
+    {
+        Application *application;
+        size_t       index;
+        bool         pinToCpu;
+        pthread_t    thread;
+        int          pid;
+        time_t       startTime;
+        time_t       restartTime;
+        size_t       startupFailures;
+        bool         isStarted;
+        std::string  failure;
+    };
+
+    ApplicationConfig   &_config;
+    std::vector<Worker>  _workers;
+    ListenerMap          _listeners;
+
+    /* Runs the workers as threads; the calling thread runs the first worker */
+    void runThreads();
+
+    /* Runs the workers as child processes and restarts them when they exit unexpectedly */
+    void runProcesses();
+
+    /* Handles the exit of the given worker process, schedules its restart unless it shut down
+       cleanly or keeps failing at startup */
+    void handleProcessExit(Worker &worker, int status);
+
+    /* Forks a child process for the given worker, which starts with the given signal mask */
+    void startProcess(Worker &worker, const sigset_t &signalMask);
+
+    /* Runs a worker inside its freshly forked child process; never returns */
+    void runProcess(Worker &worker);
+
+    /* Runs a worker's main loop and records any failure instead of propagating it */
+    static void runWorker(Worker &worker);
+
+    /* Entry point of worker threads */
+    static void *threadMain(void *argument);
+
+    /* Pins the calling thread to a CPU chosen by the worker's index */
+    static void pinCurrentThread(size_t index);
+
+    /* Disable copy-construction and copy-assignment */
+    WorkerPool(const WorkerPool &other);
+    WorkerPool &operator=(const WorkerPool &other);
+};
+
+#endif // WORKER_POOL_hpp